@@ -0,0 +1,57 @@
+#ifndef ALLOCATION_TRACKER_H
+#define ALLOCATION_TRACKER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations made through global operator new, to measure code like the model loader.
+// The counting operator new/delete are defined in the one translation unit that has
+// ALLOCATION_TRACKER_IMPLEMENTATION defined before including this header (like the stb libraries);
+// without that the counters simply stay at zero.
+struct AllocationTracker {
+    static std::atomic<size_t>& Count()
+    {
+        static std::atomic<size_t> count{ 0 };
+        return count;
+    }
+    static std::atomic<size_t>& Bytes()
+    {
+        static std::atomic<size_t> bytes{ 0 };
+        return bytes;
+    }
+
+    // allocations, bytes and wall time between construction and the call to Allocations(), AllocatedBytes() or Milliseconds()
+    class Scope
+    {
+    public:
+        Scope() : count(Count()), bytes(Bytes()), start(std::chrono::steady_clock::now()) {}
+
+        size_t Allocations() const { return Count() - count; }
+        size_t AllocatedBytes() const { return Bytes() - bytes; }
+        double Milliseconds() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+
+    private:
+        size_t count, bytes;
+        std::chrono::steady_clock::time_point start;
+    };
+};
+
+#ifdef ALLOCATION_TRACKER_IMPLEMENTATION
+void* operator new(std::size_t size)
+{
+    AllocationTracker::Count().fetch_add(1, std::memory_order_relaxed);
+    AllocationTracker::Bytes().fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+#endif
+#endif
@@ -0,0 +1,85 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Pieces shared by the on-disk caches of things that are slow to make at startup (the sky faces,
+// the text atlas, the image-based lighting, the program binaries).
+// A cache file starts with a Header naming its owner (magic), its layout (version) and the source
+// file it was derived from; a cache whose header doesn't match is simply made again. Files are
+// written through Write(), which only ever puts complete files under the final name.
+namespace DiskCache
+{
+    struct Header {
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint64_t sourceSize = 0;  // the file the cache was derived from; zero when there is none
+        int64_t sourceTime = 0;
+    };
+
+    // header for a cache of 'source'; false if the source can't be found, and the header then has no source
+    inline bool Describe(const std::string& source, uint32_t magic, uint32_t version, Header& header)
+    {
+        header = Header();
+        header.magic = magic;
+        header.version = version;
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(source, error);
+        if (error)
+            return false;
+        auto time = std::filesystem::last_write_time(source, error);
+        if (error)
+            return false;
+        header.sourceSize = static_cast<uint64_t>(size);
+        header.sourceTime = static_cast<int64_t>(time.time_since_epoch().count());
+        return true;
+    }
+
+    inline bool Matches(const Header& cached, const Header& expected)
+    {
+        return cached.magic == expected.magic && cached.version == expected.version
+            && cached.sourceSize == expected.sourceSize && cached.sourceTime == expected.sourceTime;
+    }
+
+    // writes 'path' (creating its directory) through payload(std::ofstream&), header included.
+    // The bytes go to a .tmp next to it that is renamed over 'path' once complete, so a crash or a
+    // full disk never leaves a truncated cache behind. 'owner' names the caller in the error message.
+    template <typename Payload>
+    inline bool Write(const std::string& path, const char* owner, Payload payload)
+    {
+        std::error_code error;
+        std::filesystem::path directory = std::filesystem::path(path).parent_path();
+        if (!directory.empty())
+            std::filesystem::create_directories(directory, error);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (file)
+                payload(file);
+            if (!file)
+            {
+                std::cout << "ERROR::" << owner << "::CACHE_WRITE_FAILED: " << temporary << std::endl;
+                return false;
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            std::cout << "ERROR::" << owner << "::CACHE_WRITE_FAILED: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // milliseconds since 'start', for the load timings of the cache users
+    inline double ElapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+#endif
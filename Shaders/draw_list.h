@@ -0,0 +1,106 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+
+#include <geometry_pool.h>
+#include <model.h>
+#include <render_queue.h>
+#include <shader_m.h>
+#include <texture_atlas.h>
+
+// Turns model draws into RenderQueue items: one item per mesh, keyed by program, texture and
+// distance to the camera. Atlased meshes use the atlas program and texture, so they all end up in
+// one batch no matter which model they belong to. A model drawn many times (the asteroid belt)
+// becomes one instanced item rather than one draw per copy. Meshes with LODs (the SphereLibrary
+// spheres) draw the level that suits their distance.
+class DrawList
+{
+public:
+    DrawList(RenderQueue& queue, Shader& shader, Shader& atlasShader, const TextureAtlas& atlas)
+        : queue(queue), shader(shader), atlasShader(atlasShader), atlas(atlas)
+    {
+    }
+
+    // camera position used for the depth part of the sort keys
+    void SetCamera(const glm::vec3& position, float farPlane)
+    {
+        cameraPosition = position;
+        maxDistance = farPlane;
+    }
+
+    // 'shadowReceiver' is the index EclipseShadows::AddReceiver() gave the model, or -1
+    void Add(const Model& model, const glm::mat4& transform, int shadowReceiver = -1)
+    {
+        AddInstances(model, &transform, 1, shadowReceiver);
+    }
+
+    // queues 'count' copies of 'model', one per transform
+    void AddInstances(const Model& model, const glm::mat4* transforms, unsigned int count, int shadowReceiver = -1)
+    {
+        if (count == 0)
+            return;
+
+        // sort the whole group by its centre
+        glm::vec3 centre(0.0f);
+        for (unsigned int i = 0; i < count; i++)
+            centre += glm::vec3(transforms[i][3]);
+        centre /= float(count);
+        float distance = glm::length(centre - cameraPosition);
+        unsigned int depth = SortKey::DepthBucket(distance, maxDistance);
+        // meshes with LODs pick one level for the group, by distance over the first copy's size
+        const glm::mat4& first = transforms[0];
+        float scale = glm::max(glm::length(glm::vec3(first[0])), glm::max(glm::length(glm::vec3(first[1])), glm::length(glm::vec3(first[2]))));
+
+        for (const Mesh& mesh : model.meshes)
+        {
+            if (mesh.range.indexCount == 0)
+                continue;
+            bool atlased = mesh.atlasLayer >= 0;
+
+            RenderItem item;
+            item.program = atlased ? atlasShader.ID : shader.ID;
+            item.vao = GeometryPool::Get().VAO;
+            item.textureTarget = atlased ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+            item.texture = atlased ? atlas.ID : diffuseOf(mesh);
+            item.range = mesh.lods.empty() ? mesh.range : mesh.LodRange(distance / glm::max(mesh.bounds.w * scale, 1e-6f));
+            item.instanceCount = count;
+            item.firstInstance = queue.AllocateInstances(count);
+
+            InstanceData* instances = queue.Instances(item.firstInstance);
+            glm::vec2 material = model.Material();
+            for (unsigned int i = 0; i < count; i++)
+            {
+                instances[i].model = transforms[i];
+                instances[i].params.z = material.x;
+                instances[i].params.w = material.y;
+                instances[i].lighting.x = float(shadowReceiver);
+                if (atlased)
+                {
+                    instances[i].atlasRect = mesh.atlasRect;
+                    instances[i].params.x = float(mesh.atlasLayer);
+                }
+            }
+            queue.Submit(SortKey::Make(PASS_OPAQUE, item.program, 0, item.texture, depth), item);
+        }
+    }
+
+private:
+    RenderQueue& queue;
+    Shader& shader;
+    Shader& atlasShader;
+    const TextureAtlas& atlas;
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float maxDistance = 1000.0f;
+
+    static unsigned int diffuseOf(const Mesh& mesh)
+    {
+        for (const Texture& texture : mesh.textures)
+            if (texture.type == "texture_diffuse")
+                return texture.id;
+        return 0;
+    }
+};
+#endif
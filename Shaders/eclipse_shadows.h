@@ -0,0 +1,348 @@
+#ifndef ECLIPSE_SHADOWS_H
+#define ECLIPSE_SHADOWS_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include <geometry_pool.h>
+#include <gl_state.h>
+#include <memory_usage.h>
+#include <model.h>
+#include <shader_m.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Shadows from the sun for the PBR scene shaders, without a shadow map of the whole system.
+// Nearly every caster is a sphere, so planets and moons are described to the fragment shader
+// analytically: each receiver gets the OCCLUDERS_PER_RECEIVER spheres most likely to eclipse it,
+// and the shader works out how much of the sun's disc each one covers from the fragment, which
+// gives penumbrae and annular eclipses for free. The spheres that can possibly come between a
+// receiver and the sun are found with a sweep over the spheres sorted by distance from the sun:
+// anything starting farther out than the receiver reaches can't be in front of it.
+// The few casters that are not spheres (the ship, the satellite) each get a layer of a small depth
+// texture array instead, fitted to their bounds and reaching CASTER_REACH radii behind them; the
+// sun is so big from there that their shadows are gone within that distance anyway.
+// Everything goes to the shaders in the ShadowData uniform block (src/common/shadow_data.glsl) at
+// BINDING, and the caster maps on TEXTURE_UNIT.
+class EclipseShadows
+{
+public:
+    static const unsigned int BINDING = 1;        // FrameUniforms uses 0
+    static const int MAX_SPHERES = 16;            // src/common/shadow_data.glsl has the same limits
+    static const int MAX_RECEIVERS = 32;
+    static const int OCCLUDERS_PER_RECEIVER = 4;
+    static const int MAX_CASTER_MAPS = 2;
+    static const int CASTER_MAP_SIZE = 1024;
+    static const int TEXTURE_UNIT = 3;            // after the scene's diffuse map and EnvironmentLighting's two
+    static constexpr float CASTER_REACH = 4.0f;   // caster map depth behind the caster, in its radii
+
+    struct Stats {
+        unsigned int spheres = 0;
+        unsigned int receivers = 0;
+        unsigned int tested = 0;      // sphere/receiver pairs the sweep left to test
+        unsigned int assigned = 0;    // pairs that made it into the block
+        unsigned int casterMaps = 0;
+        float selectMs = 0.0f;
+    };
+
+    EclipseShadows()
+    {
+        glGenBuffers(1, &UBO);
+        GLState::Get().BindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), NULL, GL_DYNAMIC_DRAW);
+    }
+
+    ~EclipseShadows()
+    {
+        // GL objects are freed in Delete(), while the context still exists
+    }
+
+    EclipseShadows(const EclipseShadows&) = delete;
+    EclipseShadows& operator=(const EclipseShadows&) = delete;
+
+    // points the program's ShadowData block at the shared binding
+    void Attach(const Shader& shader) const
+    {
+        shader.setBlockBinding("ShadowData", BINDING);
+    }
+
+    // starts a frame's shadows, lit by a sun of 'radius' at 'position'
+    void Begin(const glm::vec3& position, float radius)
+    {
+        sun = glm::vec4(position, radius);
+        spheres.clear();
+        receivers.clear();
+        casters.clear();
+    }
+
+    // a sphere that casts shadows; returns its index (for AddReceiver), or -1 when there are too many
+    int AddSphere(const glm::vec3& centre, float radius)
+    {
+        if (spheres.size() == MAX_SPHERES)
+            return -1;
+        spheres.push_back(glm::vec4(centre, radius));
+        return static_cast<int>(spheres.size()) - 1;
+    }
+
+    // something drawn this frame that should receive shadows, bounded by the sphere 'centre' and
+    // 'radius'; 'self' is its own sphere, which only counts when the receiver reaches beyond it
+    // (Saturn's rings). Returns the index the draw passes to the shader, or -1 when there are too many.
+    int AddReceiver(const glm::vec3& centre, float radius, int self = -1)
+    {
+        if (receivers.size() == MAX_RECEIVERS)
+            return -1;
+        receivers.push_back({ glm::vec4(centre, radius), self });
+        return static_cast<int>(receivers.size()) - 1;
+    }
+
+    // a caster that is not a sphere, drawn into a caster map of its own
+    void AddCaster(const Model& model, const glm::mat4& transform)
+    {
+        if (casters.size() < MAX_CASTER_MAPS)
+            casters.push_back({ &model, transform });
+    }
+
+    // picks each receiver's occluders, fits the caster maps and uploads the block
+    void Upload()
+    {
+        auto start = std::chrono::steady_clock::now();
+        stats = Stats();
+        stats.spheres = static_cast<unsigned int>(spheres.size());
+        stats.receivers = static_cast<unsigned int>(receivers.size());
+
+        Block block;
+        block.sun = sun;
+        std::copy(spheres.begin(), spheres.end(), block.spheres);
+        selectOccluders(block);
+        fitCasterMaps(block);
+        stats.selectMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        GLState::Get().BindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), NULL, GL_DYNAMIC_DRAW); // orphan last frame's data
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+        GLState::Get().BindUniformRange(BINDING, UBO, 0, sizeof(Block));
+    }
+
+    // draws the casters into their maps with 'depthShader' (src/shadow_depth.vs) and binds the maps
+    // on TEXTURE_UNIT; call after Upload(), before the scene
+    void RenderCasterMaps(Shader& depthShader)
+    {
+        if (!depthTexture)
+            createMaps();
+        if (!casters.empty())
+        {
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, CASTER_MAP_SIZE, CASTER_MAP_SIZE);
+            GLState::Get().SetDepthTest(true);
+            GLState::Get().SetDepthMask(true);
+            depthShader.use();
+            for (size_t i = 0; i < casters.size(); i++)
+            {
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, static_cast<GLint>(i));
+                glClear(GL_DEPTH_BUFFER_BIT);
+                depthShader.setMat4("lightMatrix", casterProjections[i]);
+                depthShader.setMat4("model", casters[i].transform);
+                for (const Mesh& mesh : casters[i].model->meshes)
+                    if (mesh.range.indexCount)
+                        GeometryPool::Get().DrawSingle(mesh.range);
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        }
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, depthTexture);
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        usage.gpuBytes = sizeof(Block) + (depthTexture ? static_cast<size_t>(CASTER_MAP_SIZE) * CASTER_MAP_SIZE * MAX_CASTER_MAPS * 4 : 0);
+        usage.cpuBytes = spheres.capacity() * sizeof(glm::vec4) + receivers.capacity() * sizeof(Receiver) + casters.capacity() * sizeof(Caster);
+        return usage;
+    }
+
+    // frees the buffer, the maps and their framebuffer; call while the context is still current
+    void Delete()
+    {
+        if (UBO)
+        {
+            glDeleteBuffers(1, &UBO);
+            GLState::Get().BufferDeleted(UBO);
+            UBO = 0;
+        }
+        if (depthTexture)
+        {
+            glDeleteTextures(1, &depthTexture);
+            GLState::Get().TextureDeleted(depthTexture);
+            glDeleteFramebuffers(1, &framebuffer);
+            depthTexture = framebuffer = 0;
+        }
+    }
+
+private:
+    // std140 layout of the ShadowData block
+    struct Block {
+        glm::vec4 sun;                                       // xyz: position, w: radius
+        glm::vec4 spheres[MAX_SPHERES];                      // xyz: centre, w: radius
+        glm::ivec4 receivers[MAX_RECEIVERS];                 // per receiver, indices into spheres, -1 past the last
+        glm::mat4 casterMaps[MAX_CASTER_MAPS];               // world -> caster map texture coordinates and depth
+        glm::vec4 casterFade[MAX_CASTER_MAPS];               // depth * x + y: 0 at the caster's centre, 1 at the end of its reach
+        glm::ivec4 shadowCounts;                             // x: caster maps in use
+    };
+    static_assert(sizeof(Block) == 16 + MAX_SPHERES * 16 + MAX_RECEIVERS * 16 + MAX_CASTER_MAPS * 80 + 16, "Block must match the std140 layout");
+
+    struct Receiver {
+        glm::vec4 bounds;
+        int self;
+    };
+    struct Caster {
+        const Model* model;
+        glm::mat4 transform;
+    };
+
+    unsigned int UBO = 0, depthTexture = 0, framebuffer = 0;
+    glm::vec4 sun = glm::vec4(0.0f);
+    std::vector<glm::vec4> spheres;
+    std::vector<Receiver> receivers;
+    std::vector<Caster> casters;
+    glm::mat4 casterProjections[MAX_CASTER_MAPS];
+    std::vector<int> order; // sphere indices by their nearest distance to the sun
+    Stats stats;
+
+    float nearSide(int sphere) const
+    {
+        return glm::length(glm::vec3(spheres[sphere]) - glm::vec3(sun)) - spheres[sphere].w;
+    }
+
+    // for every receiver, the spheres whose penumbra cone reaches it, the ones covering the most
+    // of the sun first
+    void selectOccluders(Block& block)
+    {
+        order.resize(spheres.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = static_cast<int>(i);
+        std::sort(order.begin(), order.end(), [this](int a, int b) { return nearSide(a) < nearSide(b); });
+
+        glm::vec3 sunCentre(sun);
+        for (size_t r = 0; r < receivers.size(); r++)
+        {
+            const Receiver& receiver = receivers[r];
+            glm::vec3 centre(receiver.bounds);
+            float radius = receiver.bounds.w;
+            float reach = glm::length(centre - sunCentre) + radius;
+            float sunSize = sun.w / glm::max(glm::length(centre - sunCentre), sun.w);
+
+            int chosen[OCCLUDERS_PER_RECEIVER];
+            float scores[OCCLUDERS_PER_RECEIVER];
+            int count = 0;
+            for (int sphere : order)
+            {
+                if (nearSide(sphere) >= reach)
+                    break; // the rest are all farther from the sun than any part of the receiver
+                stats.tested++;
+                const glm::vec4& occluder = spheres[sphere];
+                if (sphere == receiver.self && radius <= occluder.w * 1.05f)
+                    continue;
+                // penumbra cone: the lines touching both the sun and the occluder on opposite sides
+                glm::vec3 axis = glm::vec3(occluder) - sunCentre;
+                float distance = glm::length(axis);
+                if (distance <= sun.w)
+                    continue;
+                axis /= distance;
+                float along = glm::dot(centre - sunCentre, axis);
+                if (along + radius < distance - occluder.w)
+                    continue; // entirely on the sun's side of it
+                float across = glm::length(centre - sunCentre - axis * along);
+                float cone = occluder.w + glm::max(along - distance, 0.0f) * (sun.w + occluder.w) / distance;
+                if (across - radius > cone)
+                    continue;
+                // how big it looks next to the sun, from the receiver
+                float score = occluder.w / glm::max(glm::length(glm::vec3(occluder) - centre), occluder.w) / sunSize;
+                int at = count < OCCLUDERS_PER_RECEIVER ? count++ : OCCLUDERS_PER_RECEIVER;
+                while (at > 0 && scores[at - 1] < score)
+                {
+                    if (at < OCCLUDERS_PER_RECEIVER)
+                    {
+                        chosen[at] = chosen[at - 1];
+                        scores[at] = scores[at - 1];
+                    }
+                    at--;
+                }
+                if (at < OCCLUDERS_PER_RECEIVER)
+                {
+                    chosen[at] = sphere;
+                    scores[at] = score;
+                }
+            }
+            block.receivers[r] = glm::ivec4(-1);
+            for (int i = 0; i < count; i++)
+                block.receivers[r][i] = chosen[i];
+            stats.assigned += count;
+        }
+    }
+
+    // an orthographic view down the sun's rays through each caster: from just in front of it to
+    // CASTER_REACH radii behind, as wide as its bounds. Depth follows GLState's convention, so the
+    // maps are drawn with the same depth test as the scene.
+    void fitCasterMaps(Block& block)
+    {
+        bool reverseZ = GLState::Get().ReverseZ();
+        for (size_t i = 0; i < casters.size(); i++)
+        {
+            glm::vec4 bounds = casters[i].model->Bounds();
+            const glm::mat4& transform = casters[i].transform;
+            float scale = glm::max(glm::length(glm::vec3(transform[0])), glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+            glm::vec3 centre = glm::vec3(transform * glm::vec4(glm::vec3(bounds), 1.0f));
+            float radius = bounds.w * scale, depth = radius * (1.0f + CASTER_REACH);
+            glm::vec3 direction = glm::normalize(centre - glm::vec3(sun));
+            glm::vec3 up = glm::abs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            glm::mat4 view = glm::lookAt(centre - direction * radius, centre, up);
+            glm::mat4 projection = reverseZ ? glm::orthoRH_ZO(-radius, radius, -radius, radius, depth, 0.0f) : glm::ortho(-radius, radius, -radius, radius, 0.0f, depth);
+            casterProjections[i] = projection * view;
+
+            // clip space to texture coordinates and window depth, moved a few texels of depth
+            // towards the sun against acne
+            float bias = 3.0f * (2.0f * radius / CASTER_MAP_SIZE) / depth;
+            glm::mat4 toTexture(1.0f);
+            toTexture = glm::translate(toTexture, glm::vec3(0.5f, 0.5f, reverseZ ? bias : 0.5f - bias));
+            toTexture = glm::scale(toTexture, glm::vec3(0.5f, 0.5f, reverseZ ? 1.0f : 0.5f));
+            block.casterMaps[i] = toTexture * casterProjections[i];
+
+            // window depth of a point 't' along the view: t / depth, or 1 - t / depth reversed; the
+            // fade runs from the centre (t = radius) to the far end
+            float scaleT = depth / (depth - radius);
+            block.casterFade[i] = reverseZ ? glm::vec4(-scaleT, 1.0f, 0.0f, 0.0f) : glm::vec4(scaleT, -radius / (depth - radius), 0.0f, 0.0f);
+        }
+        block.shadowCounts = glm::ivec4(static_cast<int>(casters.size()), 0, 0, 0);
+        stats.casterMaps = static_cast<unsigned int>(casters.size());
+    }
+
+    void createMaps()
+    {
+        glGenTextures(1, &depthTexture);
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, depthTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, CASTER_MAP_SIZE, CASTER_MAP_SIZE, MAX_CASTER_MAPS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // hardware comparison, with bilinear filtering of the results
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GLState::Get().DepthTestFunc());
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,495 @@
+#ifndef ENVIRONMENT_LIGHTING_H
+#define ENVIRONMENT_LIGHTING_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+
+#include <disk_cache.h>
+#include <gl_state.h>
+#include <memory_usage.h>
+#include <shader_m.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ENVIRONMENT_LANES 4
+#else
+#define ENVIRONMENT_LANES 1
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Image-based lighting from the sky cubemap, for the PBR scene shaders (split-sum approximation):
+//  - diffuse: the sky's irradiance as 9 spherical harmonic coefficients, projected on the CPU from a
+//    small mip of the cubemap, 4 texels at a time with SSE2, and convolved with the cosine lobe, so
+//    the shaders get irradiance from a handful of multiply-adds (FrameData.irradiance)
+//  - specular: PrefilterMap, a cubemap whose mips hold the sky blurred by the GGX lobe of roughness
+//    0, 0.2 ... 1, made on the GPU with importance sampling
+//  - BrdfLut: the scale and bias the Fresnel term gets against (N.V, roughness), also made on the GPU
+// The convolutions run once per sky: the results are read back and cached on disk (texture_cache/
+// by default) keyed by the sky source file's size and time, like the Skybox faces. The LUT depends
+// on nothing and has a cache file of its own. Sky texels are taken as sRGB and made linear.
+class EnvironmentLighting
+{
+public:
+    static const int PREFILTER_SIZE = 128;  // texels along a face of the sharpest level
+    static const int PREFILTER_LEVELS = 6;  // src/scene.fs has the same count
+    static const int LUT_SIZE = 128;
+    static const int SH_FACE_SIZE = 64;     // largest face size of the sky mip the harmonics come from
+
+    unsigned int PrefilterMap = 0;
+    unsigned int BrdfLut = 0;
+
+    struct Timing {
+        double harmonicsMs = 0.0;  // projection of the sky mip, read back included
+        double prefilterMs = 0.0;
+        double lutMs = 0.0;
+        double cacheMs = 0.0;      // reading or writing both cache files
+        bool cacheHit = false;
+        bool lutCacheHit = false;
+    };
+
+    EnvironmentLighting() {}
+    ~EnvironmentLighting()
+    {
+        // GL objects are freed in Delete(), while the context still exists
+    }
+
+    EnvironmentLighting(const EnvironmentLighting&) = delete;
+    EnvironmentLighting& operator=(const EnvironmentLighting&) = delete;
+
+    // makes (or reads back from the cache) the lighting of the cubemap 'sky', which must have its mip
+    // chain; 'sourcePath' is the file the sky came from, which keys the cache
+    void Build(unsigned int sky, const std::string& sourcePath, const std::string& cacheDirectory = "texture_cache")
+    {
+        timing = Timing();
+        CacheHeader expected;
+        bool keyed = DiskCache::Describe(sourcePath, CACHE_MAGIC, CACHE_VERSION, expected.key);
+        std::string cachePath = cacheDirectory + "/" + std::filesystem::path(sourcePath).stem().string() + ".ibl";
+
+        std::vector<uint16_t> prefiltered;
+        auto start = std::chrono::steady_clock::now();
+        if (keyed && readCache(cachePath, expected, prefiltered))
+        {
+            timing.cacheHit = true;
+            createPrefilterMap(prefiltered.data());
+            timing.cacheMs += DiskCache::ElapsedMs(start);
+        }
+        else
+        {
+            projectHarmonics(sky);
+            timing.harmonicsMs = DiskCache::ElapsedMs(start);
+            start = std::chrono::steady_clock::now();
+            createPrefilterMap(nullptr);
+            renderPrefilter(sky);
+            prefiltered = readPrefilter();
+            timing.prefilterMs = DiskCache::ElapsedMs(start);
+            if (keyed)
+            {
+                start = std::chrono::steady_clock::now();
+                DiskCache::Write(cachePath, "ENVIRONMENT", [&](std::ofstream& file) {
+                    file.write(reinterpret_cast<const char*>(&expected), sizeof(expected));
+                    file.write(reinterpret_cast<const char*>(irradiance), sizeof(irradiance));
+                    file.write(reinterpret_cast<const char*>(prefiltered.data()), prefiltered.size() * sizeof(uint16_t));
+                });
+                timing.cacheMs += DiskCache::ElapsedMs(start);
+            }
+        }
+
+        start = std::chrono::steady_clock::now();
+        std::string lutPath = cacheDirectory + "/brdf.lut";
+        std::vector<uint16_t> lut(static_cast<size_t>(LUT_SIZE) * LUT_SIZE * 2);
+        if (readLut(lutPath, lut))
+        {
+            timing.lutCacheHit = true;
+            createLut(lut.data());
+            timing.cacheMs += DiskCache::ElapsedMs(start);
+        }
+        else
+        {
+            createLut(nullptr);
+            renderLut();
+            GLState::Get().BindTexture(0, GL_TEXTURE_2D, BrdfLut);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, lut.data());
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            timing.lutMs = DiskCache::ElapsedMs(start);
+            start = std::chrono::steady_clock::now();
+            LutHeader header;
+            DiskCache::Write(lutPath, "ENVIRONMENT", [&](std::ofstream& file) {
+                file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                file.write(reinterpret_cast<const char*>(lut.data()), lut.size() * sizeof(uint16_t));
+            });
+            timing.cacheMs += DiskCache::ElapsedMs(start);
+        }
+    }
+
+    // irradiance coefficients, already convolved with the cosine lobe: E(n) = sum c[i] * Y[i](n)
+    const glm::vec3* Irradiance() const { return irradiance; }
+    const Timing& GetTiming() const { return timing; }
+
+    static const char* SimdName()
+    {
+        return ENVIRONMENT_LANES == 4 ? "SSE2" : "scalar";
+    }
+
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        size_t texels = 0;
+        for (int level = 0; level < PREFILTER_LEVELS; level++)
+            texels += static_cast<size_t>(6) * levelSize(level) * levelSize(level);
+        usage.gpuBytes = (PrefilterMap ? texels * 3 * sizeof(uint16_t) : 0) + (BrdfLut ? static_cast<size_t>(LUT_SIZE) * LUT_SIZE * 2 * sizeof(uint16_t) : 0);
+        return usage;
+    }
+
+    // frees the textures; call while the context is still current
+    void Delete()
+    {
+        for (unsigned int* texture : { &PrefilterMap, &BrdfLut })
+        {
+            if (!*texture)
+                continue;
+            glDeleteTextures(1, texture);
+            GLState::Get().TextureDeleted(*texture);
+            *texture = 0;
+        }
+    }
+
+private:
+    static const uint32_t CACHE_MAGIC = 0x204C4249; // "IBL "
+    static const uint32_t LUT_MAGIC = 0x2054554C;   // "LUT "
+    static const uint32_t CACHE_VERSION = 2;
+
+    struct CacheHeader {
+        DiskCache::Header key;     // keyed by the sky file the lighting came from
+        int32_t size = PREFILTER_SIZE;
+        int32_t levels = PREFILTER_LEVELS;
+    };
+    struct LutHeader {
+        DiskCache::Header key{ LUT_MAGIC, CACHE_VERSION }; // depends on no file
+        int32_t size = LUT_SIZE;
+        int32_t padding = 0;
+    };
+
+    glm::vec3 irradiance[9] = {};
+    Timing timing;
+
+    static int levelSize(int level)
+    {
+        return glm::max(PREFILTER_SIZE >> level, 1);
+    }
+
+    // reads back the first sky mip no bigger than SH_FACE_SIZE and projects it onto the first three
+    // bands of real spherical harmonics, each texel weighted by the solid angle it covers
+    void projectHarmonics(unsigned int sky)
+    {
+        GLState::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, sky);
+        int level = 0, size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &size);
+        while (size > SH_FACE_SIZE)
+        {
+            size = glm::max(size / 2, 1);
+            level++;
+        }
+        if (size <= 0)
+            return;
+        std::vector<float> texels(static_cast<size_t>(size) * size * 3);
+        float sums[27] = {}; // 9 coefficients of r, then of g, then of b
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        for (int face = 0; face < 6; face++)
+        {
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, texels.data());
+            for (float& texel : texels)
+                texel = std::pow(glm::clamp(texel, 0.0f, 1.0f), 2.2f);
+            projectFace(face, size, texels.data(), sums);
+        }
+
+        // the cosine lobe convolution scales each band: pi, 2pi/3, pi/4
+        static const float bandScale[9] = { 3.141593f, 2.094395f, 2.094395f, 2.094395f, 0.785398f, 0.785398f, 0.785398f, 0.785398f, 0.785398f };
+        for (int i = 0; i < 9; i++)
+            irradiance[i] = glm::vec3(sums[i], sums[9 + i], sums[18 + i]) * bandScale[i];
+    }
+
+    // texel (x, y) of a face looks along faceDirection(s, t) with s, t in (-1, 1); it covers a solid
+    // angle of (2 / size)^2 / (1 + s^2 + t^2)^1.5
+    static void projectFace(int face, int size, const float* texels, float* sums)
+    {
+        float step = 2.0f / size, texelArea = step * step;
+        for (int y = 0; y < size; y++)
+        {
+            float t = (y + 0.5f) * step - 1.0f;
+            const float* row = texels + static_cast<size_t>(y) * size * 3;
+            int x = 0;
+#if ENVIRONMENT_LANES == 4
+            __m128 sumsSimd[27];
+            for (__m128& sum : sumsSimd)
+                sum = _mm_setzero_ps();
+            const __m128 tt = _mm_set1_ps(t), one = _mm_set1_ps(1.0f), area = _mm_set1_ps(texelArea);
+            for (; x + 4 <= size; x += 4)
+            {
+                __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_set_ps(x + 3.5f, x + 2.5f, x + 1.5f, x + 0.5f), _mm_set1_ps(step)), one);
+                __m128 dx, dy, dz;
+                faceDirection(face, s, tt, dx, dy, dz);
+                __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+                // solid angle: area / lengthSquared^1.5
+                __m128 weight = _mm_mul_ps(area, _mm_mul_ps(inverseLength, _mm_mul_ps(inverseLength, inverseLength)));
+                dx = _mm_mul_ps(dx, inverseLength);
+                dy = _mm_mul_ps(dy, inverseLength);
+                dz = _mm_mul_ps(dz, inverseLength);
+                __m128 basis[9];
+                harmonics(dx, dy, dz, basis);
+                const float* p = row + x * 3;
+                __m128 r = _mm_mul_ps(_mm_set_ps(p[9], p[6], p[3], p[0]), weight);
+                __m128 g = _mm_mul_ps(_mm_set_ps(p[10], p[7], p[4], p[1]), weight);
+                __m128 b = _mm_mul_ps(_mm_set_ps(p[11], p[8], p[5], p[2]), weight);
+                for (int i = 0; i < 9; i++)
+                {
+                    sumsSimd[i] = _mm_add_ps(sumsSimd[i], _mm_mul_ps(basis[i], r));
+                    sumsSimd[9 + i] = _mm_add_ps(sumsSimd[9 + i], _mm_mul_ps(basis[i], g));
+                    sumsSimd[18 + i] = _mm_add_ps(sumsSimd[18 + i], _mm_mul_ps(basis[i], b));
+                }
+            }
+            for (int i = 0; i < 27; i++)
+            {
+                float lanes[4];
+                _mm_storeu_ps(lanes, sumsSimd[i]);
+                sums[i] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            }
+#endif
+            for (; x < size; x++)
+            {
+                float s = (x + 0.5f) * step - 1.0f;
+                float dx, dy, dz;
+                faceDirection(face, s, t, dx, dy, dz);
+                float lengthSquared = dx * dx + dy * dy + dz * dz, inverseLength = 1.0f / std::sqrt(lengthSquared);
+                float weight = texelArea * inverseLength * inverseLength * inverseLength;
+                float basis[9];
+                harmonics(dx * inverseLength, dy * inverseLength, dz * inverseLength, basis);
+                const float* p = row + x * 3;
+                for (int i = 0; i < 9; i++)
+                {
+                    sums[i] += basis[i] * p[0] * weight;
+                    sums[9 + i] += basis[i] * p[1] * weight;
+                    sums[18 + i] += basis[i] * p[2] * weight;
+                }
+            }
+        }
+    }
+
+    // the GL cube face layout, as in Skybox; written once for floats and SIMD lanes
+    template <typename T>
+    static void faceDirection(int face, T s, T t, T& x, T& y, T& z)
+    {
+        T positive = splat(1.0f, T()), negative = splat(-1.0f, T());
+        switch (face)
+        {
+        case 0: x = positive; y = negate(t); z = negate(s); break;
+        case 1: x = negative; y = negate(t); z = s; break;
+        case 2: x = s; y = positive; z = t; break;
+        case 3: x = s; y = negative; z = negate(t); break;
+        case 4: x = s; y = negate(t); z = positive; break;
+        default: x = negate(s); y = negate(t); z = negative; break;
+        }
+    }
+
+    // the 9 real harmonics of bands 0-2 at a unit direction
+    template <typename T>
+    static void harmonics(T x, T y, T z, T* basis)
+    {
+        basis[0] = splat(0.282095f, T());
+        basis[1] = multiply(splat(0.488603f, T()), y);
+        basis[2] = multiply(splat(0.488603f, T()), z);
+        basis[3] = multiply(splat(0.488603f, T()), x);
+        basis[4] = multiply(splat(1.092548f, T()), multiply(x, y));
+        basis[5] = multiply(splat(1.092548f, T()), multiply(y, z));
+        basis[6] = multiply(splat(0.315392f, T()), subtract(multiply(splat(3.0f, T()), multiply(z, z)), splat(1.0f, T())));
+        basis[7] = multiply(splat(1.092548f, T()), multiply(x, z));
+        basis[8] = multiply(splat(0.546274f, T()), subtract(multiply(x, x), multiply(y, y)));
+    }
+
+    // the arithmetic the templates above use, for a float and for 4 lanes
+    static float splat(float value, float) { return value; }
+    static float negate(float value) { return -value; }
+    static float multiply(float a, float b) { return a * b; }
+    static float subtract(float a, float b) { return a - b; }
+#if ENVIRONMENT_LANES == 4
+    static __m128 splat(float value, __m128) { return _mm_set1_ps(value); }
+    static __m128 negate(__m128 value) { return _mm_sub_ps(_mm_setzero_ps(), value); }
+    static __m128 multiply(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+    static __m128 subtract(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+#endif
+
+    // immutable-size RGB16F cube with the whole mip chain of PREFILTER_LEVELS; 'texels' are all the
+    // levels one after the other, six faces each, or null to leave them undefined
+    void createPrefilterMap(const uint16_t* texels)
+    {
+        glGenTextures(1, &PrefilterMap);
+        GLState::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, PrefilterMap);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        for (int level = 0; level < PREFILTER_LEVELS; level++)
+        {
+            int size = levelSize(level);
+            for (int face = 0; face < 6; face++)
+            {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB16F, size, size, 0, GL_RGB, GL_HALF_FLOAT, texels);
+                if (texels)
+                    texels += static_cast<size_t>(size) * size * 3;
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, PREFILTER_LEVELS - 1);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        for (GLenum wrap : { GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T, GL_TEXTURE_WRAP_R })
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, wrap, GL_CLAMP_TO_EDGE);
+    }
+
+    void createLut(const uint16_t* texels)
+    {
+        glGenTextures(1, &BrdfLut);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, BrdfLut);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, LUT_SIZE, LUT_SIZE, 0, GL_RG, GL_HALF_FLOAT, texels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    // draws a fullscreen triangle into each face of each level with src/ibl_prefilter.fs
+    void renderPrefilter(unsigned int sky)
+    {
+        Shader prefilter("src/ibl.vs", "src/ibl_prefilter.fs");
+        int skySize = 0;
+        GLState::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, sky);
+        glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &skySize);
+        prefilter.use();
+        prefilter.setInt("environment", 0);
+        prefilter.setFloat("environmentSize", static_cast<float>(skySize));
+        renderPasses([&]() {
+            for (int level = 0; level < PREFILTER_LEVELS; level++)
+            {
+                int size = levelSize(level);
+                glViewport(0, 0, size, size);
+                prefilter.setFloat("size", static_cast<float>(size));
+                prefilter.setFloat("roughness", level / float(PREFILTER_LEVELS - 1));
+                for (int face = 0; face < 6; face++)
+                {
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, PrefilterMap, level);
+                    prefilter.setInt("face", face);
+                    glDrawArrays(GL_TRIANGLES, 0, 3);
+                }
+            }
+        });
+        glDeleteProgram(prefilter.ID);
+        GLState::Get().ProgramDeleted(prefilter.ID);
+    }
+
+    void renderLut()
+    {
+        Shader integrate("src/ibl.vs", "src/ibl_brdf.fs");
+        integrate.use();
+        renderPasses([&]() {
+            glViewport(0, 0, LUT_SIZE, LUT_SIZE);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, BrdfLut, 0);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        });
+        glDeleteProgram(integrate.ID);
+        GLState::Get().ProgramDeleted(integrate.ID);
+    }
+
+    // runs 'draw' with a framebuffer bound, no depth test or blending and an empty VAO, then puts the
+    // default framebuffer, the viewport and those states back
+    template <typename Draw>
+    void renderPasses(Draw draw)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        unsigned int framebuffer, vao;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenVertexArrays(1, &vao);
+        GLState::Get().BindVertexArray(vao);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+        GLState::Get().SetDepthTest(false);
+        GLState::Get().SetBlend(false);
+        draw();
+        GLState::Get().SetDepthTest(depthTest == GL_TRUE);
+        GLState::Get().SetBlend(blend == GL_TRUE);
+        GLState::Get().BindVertexArray(0);
+        glDeleteVertexArrays(1, &vao);
+        GLState::Get().VertexArrayDeleted(vao);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    std::vector<uint16_t> readPrefilter() const
+    {
+        size_t total = 0;
+        for (int level = 0; level < PREFILTER_LEVELS; level++)
+            total += static_cast<size_t>(6) * levelSize(level) * levelSize(level) * 3;
+        std::vector<uint16_t> texels(total);
+        GLState::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, PrefilterMap);
+        glPixelStorei(GL_PACK_ALIGNMENT, 2);
+        uint16_t* out = texels.data();
+        for (int level = 0; level < PREFILTER_LEVELS; level++)
+        {
+            int size = levelSize(level);
+            for (int face = 0; face < 6; face++)
+            {
+                glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_HALF_FLOAT, out);
+                out += static_cast<size_t>(size) * size * 3;
+            }
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        return texels;
+    }
+
+    bool readCache(const std::string& path, const CacheHeader& expected, std::vector<uint16_t>& prefiltered)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        CacheHeader header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || !DiskCache::Matches(header.key, expected.key) || header.size != PREFILTER_SIZE || header.levels != PREFILTER_LEVELS)
+            return false;
+        glm::vec3 coefficients[9];
+        file.read(reinterpret_cast<char*>(coefficients), sizeof(coefficients));
+        size_t total = 0;
+        for (int level = 0; level < PREFILTER_LEVELS; level++)
+            total += static_cast<size_t>(6) * levelSize(level) * levelSize(level) * 3;
+        prefiltered.resize(total);
+        file.read(reinterpret_cast<char*>(prefiltered.data()), total * sizeof(uint16_t));
+        if (!file)
+            return false;
+        std::copy(coefficients, coefficients + 9, irradiance);
+        return true;
+    }
+
+    static bool readLut(const std::string& path, std::vector<uint16_t>& lut)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        LutHeader header, expected;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || !DiskCache::Matches(header.key, expected.key) || header.size != expected.size)
+            return false;
+        file.read(reinterpret_cast<char*>(lut.data()), lut.size() * sizeof(uint16_t));
+        return static_cast<bool>(file);
+    }
+};
+#endif
@@ -0,0 +1,173 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Reports files that were written under a set of directory trees, from a background thread.
+// On Linux it blocks on inotify (close-after-write and rename-into-place, which is how most editors
+// save), adding watches for directories created later. Elsewhere it falls back to comparing
+// modification times every 'pollInterval'. The render thread collects the changes once per frame
+// with TakeChanges(); a file saved several times in between is reported once.
+class FileWatcher
+{
+public:
+    FileWatcher(const std::vector<std::string>& roots, std::chrono::milliseconds pollInterval = std::chrono::milliseconds(500))
+        : roots(roots), pollInterval(pollInterval)
+    {
+        worker = std::thread(&FileWatcher::run, this);
+    }
+
+    ~FileWatcher()
+    {
+        stopping = true;
+        if (worker.joinable())
+            worker.join();
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // files changed since the last call, as lexically normal paths under one of the roots
+    std::vector<std::string> TakeChanges()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> taken(changed.begin(), changed.end());
+        changed.clear();
+        return taken;
+    }
+
+    // true when change notifications come from inotify rather than polling
+    bool Native() const { return native; }
+
+private:
+    std::vector<std::string> roots;
+    std::chrono::milliseconds pollInterval;
+    std::thread worker;
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> native{ false };
+    std::mutex mutex;
+    std::set<std::string> changed;
+
+    void report(const std::filesystem::path& file)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.insert(file.lexically_normal().generic_string());
+    }
+
+    void run()
+    {
+#ifdef __linux__
+        if (runInotify())
+            return;
+#endif
+        runPolling();
+    }
+
+#ifdef __linux__
+    // returns false if inotify is unavailable, so the caller can poll instead
+    bool runInotify()
+    {
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+            return false;
+        const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+        std::unordered_map<int, std::filesystem::path> directories; // watch descriptor -> directory
+        auto watch = [&](const std::filesystem::path& directory) {
+            int wd = inotify_add_watch(fd, directory.string().c_str(), mask);
+            if (wd >= 0)
+                directories[wd] = directory;
+        };
+        for (const std::string& root : roots)
+        {
+            std::error_code error;
+            if (!std::filesystem::is_directory(root, error))
+                continue;
+            watch(root);
+            for (auto it = std::filesystem::recursive_directory_iterator(root, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+                if (it->is_directory(error))
+                    watch(it->path());
+        }
+        native = true;
+
+        alignas(inotify_event) char buffer[16 * 1024];
+        while (!stopping)
+        {
+            pollfd descriptor{ fd, POLLIN, 0 };
+            if (poll(&descriptor, 1, 100) <= 0)
+                continue;
+            ssize_t length;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* p = buffer; p < buffer + length; )
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                    p += sizeof(inotify_event) + event->len;
+                    auto directory = directories.find(event->wd);
+                    if (directory == directories.end() || event->len == 0)
+                        continue;
+                    std::filesystem::path path = directory->second / event->name;
+                    if (event->mask & IN_ISDIR)
+                    {
+                        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                            watch(path);
+                    }
+                    else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                        report(path);
+                }
+            }
+        }
+        close(fd);
+        return true;
+    }
+#endif
+
+    void runPolling()
+    {
+        std::unordered_map<std::string, std::filesystem::file_time_type> times;
+        bool first = true;
+        while (!stopping)
+        {
+            for (const std::string& root : roots)
+            {
+                std::error_code error;
+                for (auto it = std::filesystem::recursive_directory_iterator(root, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+                {
+                    if (!it->is_regular_file(error))
+                        continue;
+                    std::filesystem::file_time_type time = it->last_write_time(error);
+                    auto known = times.find(it->path().string());
+                    if (known == times.end())
+                    {
+                        times[it->path().string()] = time;
+                        if (!first)
+                            report(it->path());
+                    }
+                    else if (known->second != time)
+                    {
+                        known->second = time;
+                        report(it->path());
+                    }
+                }
+            }
+            first = false;
+            // sleep in short steps so the destructor doesn't wait a whole interval
+            for (auto slept = std::chrono::milliseconds(0); slept < pollInterval && !stopping; slept += std::chrono::milliseconds(50))
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+};
+#endif
@@ -0,0 +1,155 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include <gl_state.h>
+#include <shader_m.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Per-frame camera and lighting data, laid out to match the std140 FrameData block in src/common/frame_data.glsl,
+// which every shader #includes.
+struct FrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::mat4 skyView;            // view without translation, for the skybox
+    glm::vec3 cameraPosition;
+    float time;                   // packs into cameraPosition's vec4 slot under std140
+    glm::vec4 clipPlanes;         // x: near, y: far, z: NDC depth of the far plane (0 with reverse-Z, else 1)
+    glm::vec4 sunPosition;        // xyz: world position of the sun, the scene's one light; w: its intensity
+    glm::vec4 irradiance[9];      // the sky's irradiance as spherical harmonics (EnvironmentLighting), w unused
+};
+static_assert(sizeof(FrameData) == 4 * 64 + 3 * 16 + 9 * 16, "FrameData must match the std140 layout");
+
+// Writes FrameData once per frame into a ring of slices of one uniform buffer and binds the current
+// slice at FrameUniforms::BINDING. Every program's FrameData block is pointed at that binding once
+// (Attach), so no per-program camera uniforms are uploaded at all. A slice is only rewritten after
+// the fence of the frame that last used it has signalled, so the GPU never reads a half-written one.
+class FrameUniforms
+{
+public:
+    static const unsigned int BINDING = 0;
+
+    FrameUniforms(unsigned int ringSize = 3)
+        : slices(ringSize < 1 ? 1 : ringSize)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (sizeof(FrameData) + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &UBO);
+        GLState::Get().BindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, stride * slices.size(), NULL, GL_DYNAMIC_DRAW);
+    }
+
+    // the projection to render with: the usual GL one, or with GLState's reverse-Z its [0, 1] depth
+    // version with near and far swapped. CPU-side culling keeps using the usual one.
+    static glm::mat4 Projection(float fovY, float aspect, float nearPlane, float farPlane)
+    {
+        if (GLState::Get().ReverseZ())
+            return glm::perspectiveRH_ZO(fovY, aspect, farPlane, nearPlane);
+        return glm::perspective(fovY, aspect, nearPlane, farPlane);
+    }
+
+    // points the program's FrameData block at the shared binding
+    void Attach(const Shader& shader) const
+    {
+        shader.setBlockBinding("FrameData", BINDING);
+    }
+
+    // the light for the next Update(): the sun sits at 'position' and shines with 'intensity'
+    void SetSun(const glm::vec3& position, float intensity)
+    {
+        sun = glm::vec4(position, intensity);
+    }
+
+    // the ambient light for the next Update(): 9 coefficients, see EnvironmentLighting::Irradiance()
+    void SetIrradiance(const glm::vec3* coefficients)
+    {
+        for (int i = 0; i < 9; i++)
+            irradiance[i] = glm::vec4(coefficients[i], 0.0f);
+    }
+
+    // fills in the derived matrices, uploads into the next free slice and binds it
+    void Update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float time, float nearPlane, float farPlane)
+    {
+        FrameData data;
+        data.view = view;
+        data.projection = projection;
+        data.viewProjection = projection * view;
+        data.skyView = glm::mat4(glm::mat3(view));
+        data.cameraPosition = cameraPosition;
+        data.time = time;
+        data.clipPlanes = glm::vec4(nearPlane, farPlane, float(GLState::Get().FarDepth()), 0.0f);
+        data.sunPosition = sun;
+        std::copy(irradiance, irradiance + 9, data.irradiance);
+
+        Slice& slice = slices[current];
+        if (slice.fence)
+        {
+            // only blocks if the GPU is more than ringSize frames behind
+            if (glClientWaitSync(slice.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+                std::cout << "ERROR::FRAME_UNIFORMS::FENCE_TIMEOUT" << std::endl;
+            glDeleteSync(slice.fence);
+            slice.fence = 0;
+        }
+
+        GLintptr offset = static_cast<GLintptr>(current * stride);
+        GLState::Get().BindBuffer(GL_UNIFORM_BUFFER, UBO);
+        void* target = glMapBufferRange(GL_UNIFORM_BUFFER, offset, sizeof(FrameData), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (target)
+        {
+            *static_cast<FrameData*>(target) = data;
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        else
+            glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(FrameData), &data);
+        GLState::Get().BindUniformRange(BINDING, UBO, offset, sizeof(FrameData));
+        frame = data;
+    }
+
+    // call once the frame's draws are issued; fences the slice they read and moves to the next one
+    void EndFrame()
+    {
+        slices[current].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current = (current + 1) % slices.size();
+    }
+
+    // the data uploaded by the last Update()
+    const FrameData& Current() const { return frame; }
+
+    // frees the buffer; call while the context is still current
+    void Delete()
+    {
+        for (Slice& slice : slices)
+        {
+            if (slice.fence)
+                glDeleteSync(slice.fence);
+            slice.fence = 0;
+        }
+        glDeleteBuffers(1, &UBO);
+        GLState::Get().BufferDeleted(UBO);
+        UBO = 0;
+    }
+
+private:
+    struct Slice {
+        GLsync fence = 0;
+    };
+
+    unsigned int UBO = 0;
+    size_t stride = 0;
+    size_t current = 0;
+    std::vector<Slice> slices;
+    FrameData frame;
+    glm::vec4 sun = glm::vec4(0.0f);
+    glm::vec4 irradiance[9] = {};
+};
+#endif
@@ -0,0 +1,323 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+
+#include <gl_extensions.h>
+#include <gl_state.h>
+#include <memory_usage.h>
+
+#include <cstddef>
+#include <vector>
+
+#define MAX_BONE_INFLUENCE 4
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+    //bone indexes which will influence this vertex
+    int m_BoneIDs[MAX_BONE_INFLUENCE];
+    //weights from each bone
+    float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// per-draw data read through instanced vertex attributes 7..13
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 atlasRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f); // see AtlasRegion
+    glm::vec4 params = glm::vec4(-1.0f, 0.0f, 0.0f, 0.9f);    // x: atlas layer (-1 when not atlased), y: source instance (GpuCulling), zw: Model::Material()
+    glm::vec4 lighting = glm::vec4(-1.0f, 0.0f, 0.0f, 0.0f);  // x: eclipse receiver (EclipseShadows), -1 for none
+};
+
+// layout defined by the GL spec for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// where a mesh lives inside the pool
+struct MeshRange {
+    GLint  baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+    GLuint vertexCount = 0;
+};
+
+// One vertex buffer, one index buffer and one VAO for all static geometry.
+// Meshes sub-allocate their vertices and indices here instead of owning buffers, so a whole frame
+// can be drawn from a single VAO: the caller uploads per-draw InstanceData and a list of indirect
+// commands once, then each material batch is one glMultiDrawElementsIndirect. Without GL 4.3 there
+// is no base instance or draw ID to find the per-draw data, so the fallback issues one
+// glDrawElementsInstancedBaseVertex per command with the instance attributes rebased; it still
+// never switches VAO or buffers.
+class GeometryPool
+{
+public:
+    struct Stats {
+        unsigned int drawCalls = 0; // GL draw calls issued this frame
+        unsigned int commands = 0;  // indirect commands those calls covered
+        size_t triangles = 0;       // of the commands built on the CPU; DrawIndirect()'s are written on the GPU
+    };
+
+    unsigned int VAO = 0;
+
+    static GeometryPool& Get()
+    {
+        static GeometryPool instance;
+        return instance;
+    }
+
+    // copies the mesh into the shared buffers, growing them if needed
+    MeshRange Allocate(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+    {
+        if (!VAO)
+            create();
+        reserve(vertexBuffer, vertexCapacity, vertexCount_ + vertexCount, sizeof(Vertex), GL_ARRAY_BUFFER);
+        reserve(indexBuffer, indexCapacity, indexCount_ + indexCount, sizeof(unsigned int), GL_ELEMENT_ARRAY_BUFFER);
+
+        MeshRange range;
+        range.baseVertex = static_cast<GLint>(vertexCount_);
+        range.firstIndex = static_cast<GLuint>(indexCount_);
+        range.indexCount = static_cast<GLuint>(indexCount);
+        range.vertexCount = static_cast<GLuint>(vertexCount);
+
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, vertexCount_ * sizeof(Vertex), vertexCount * sizeof(Vertex), vertices);
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount_ * sizeof(unsigned int), indexCount * sizeof(unsigned int), indices);
+
+        vertexCount_ += vertexCount;
+        indexCount_ += indexCount;
+        return range;
+    }
+
+    // uploads this frame's per-draw data and indirect commands; batches index into both
+    void Upload(const std::vector<InstanceData>& instances, const std::vector<DrawElementsIndirectCommand>& commands)
+    {
+        if (!VAO)
+            create();
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), NULL, GL_STREAM_DRAW); // orphan last frame's data
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+
+        uploadedCommands = commands;
+        if (GLExt::HasMultiDrawIndirect)
+        {
+            GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        }
+    }
+
+    // draws uploaded commands [first, first + count) with whatever program and textures are bound
+    void MultiDraw(size_t first, size_t count)
+    {
+        if (count == 0)
+            return;
+        GLState::Get().BindVertexArray(VAO);
+        for (size_t i = first; i < first + count; i++)
+            stats.triangles += static_cast<size_t>(uploadedCommands[i].count / 3) * uploadedCommands[i].instanceCount;
+        if (GLExt::HasMultiDrawIndirect)
+        {
+            GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            GLExt::MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(first * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(count), 0);
+            stats.drawCalls++;
+        }
+        else
+        {
+            for (size_t i = first; i < first + count; i++)
+            {
+                const DrawElementsIndirectCommand& command = uploadedCommands[i];
+                pointInstanceAttributes(command.baseInstance);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, reinterpret_cast<const void*>(command.firstIndex * sizeof(unsigned int)),
+                                                  command.instanceCount, command.baseVertex);
+                stats.drawCalls++;
+            }
+            pointInstanceAttributes(0);
+        }
+        stats.commands += static_cast<unsigned int>(count);
+    }
+
+    // draws 'count' indirect commands from another buffer (written on the GPU, see GpuCulling), with
+    // attributes 7..13 reading InstanceData from 'instances' for the duration of the call. GL 4.3 only.
+    void DrawIndirect(unsigned int commandBuffer, unsigned int instances, size_t first, size_t count)
+    {
+        if (count == 0 || !GLExt::HasMultiDrawIndirect)
+            return;
+        GLState::Get().BindVertexArray(VAO);
+        pointInstanceAttributes(0, instances);
+        GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        GLExt::MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(first * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(count), 0);
+        pointInstanceAttributes(0);
+        stats.drawCalls++;
+        stats.commands += static_cast<unsigned int>(count);
+    }
+
+    // draws one mesh on its own with the currently bound program (attributes 7..13 read instance 0)
+    void DrawSingle(const MeshRange& range)
+    {
+        GLState::Get().BindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, reinterpret_cast<const void*>(range.firstIndex * sizeof(unsigned int)), range.baseVertex);
+        stats.drawCalls++;
+        stats.commands++;
+        stats.triangles += range.indexCount / 3;
+    }
+
+    // the vertex and index buffers as allocated (capacity, not just what meshes use), plus the CPU
+    // copy of the indirect commands kept for the GL 3.3 path
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        usage.gpuBytes = vertexCapacity * sizeof(Vertex) + indexCapacity * sizeof(unsigned int);
+        usage.cpuBytes = uploadedCommands.capacity() * sizeof(DrawElementsIndirectCommand);
+        return usage;
+    }
+
+    // bytes of the buffers actually holding mesh data
+    size_t UsedBytes() const { return vertexCount_ * sizeof(Vertex) + indexCount_ * sizeof(unsigned int); }
+
+    // enables attributes 0..6 and points them at Vertex data in the bound GL_ARRAY_BUFFER; also used
+    // for VAOs over other Vertex buffers (see PlanetTerrain). The VAO must be bound.
+    static void PointVertexAttributes()
+    {
+        // set the vertex attribute pointers
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // ids
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+        // weights
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+    }
+
+    void ResetStats() { stats = Stats(); }
+    const Stats& GetStats() const { return stats; }
+    size_t VertexCount() const { return vertexCount_; }
+    size_t IndexCount() const { return indexCount_; }
+
+    // frees the buffers; call while the context is still current
+    void Shutdown()
+    {
+        if (!VAO)
+            return;
+        glDeleteVertexArrays(1, &VAO);
+        GLState::Get().VertexArrayDeleted(VAO);
+        unsigned int buffers[4] = { vertexBuffer, indexBuffer, instanceBuffer, indirectBuffer };
+        glDeleteBuffers(4, buffers);
+        for (unsigned int buffer : buffers)
+            GLState::Get().BufferDeleted(buffer);
+        VAO = vertexBuffer = indexBuffer = instanceBuffer = indirectBuffer = 0;
+    }
+
+private:
+    unsigned int vertexBuffer = 0, indexBuffer = 0, instanceBuffer = 0, indirectBuffer = 0;
+    size_t vertexCapacity = 0, indexCapacity = 0;
+    size_t vertexCount_ = 0, indexCount_ = 0;
+    std::vector<DrawElementsIndirectCommand> uploadedCommands; // CPU copy for the GL 3.3 path
+    Stats stats;
+
+    GeometryPool() {}
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    void create()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        glGenBuffers(1, &instanceBuffer);
+        glGenBuffers(1, &indirectBuffer);
+
+        vertexCapacity = 64 * 1024;
+        indexCapacity = 256 * 1024;
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+
+        setupAttributes();
+    }
+
+    // doubles a buffer until it holds 'needed' elements, keeping its contents
+    void reserve(unsigned int& buffer, size_t& capacity, size_t needed, size_t elementSize, GLenum target)
+    {
+        if (needed <= capacity)
+            return;
+        size_t newCapacity = capacity;
+        while (newCapacity < needed)
+            newCapacity *= 2;
+
+        unsigned int newBuffer;
+        glGenBuffers(1, &newBuffer);
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * elementSize, NULL, GL_STATIC_DRAW);
+        GLState::Get().BindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (target == GL_ARRAY_BUFFER ? vertexCount_ : indexCount_) * elementSize);
+        glDeleteBuffers(1, &buffer);
+        GLState::Get().BufferDeleted(buffer);
+        buffer = newBuffer;
+        capacity = newCapacity;
+
+        setupAttributes(); // the VAO still points at the old buffer
+    }
+
+    void setupAttributes()
+    {
+        GLState::Get().BindVertexArray(VAO);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+        PointVertexAttributes();
+
+        // per-draw data: model matrix (4 vec4s), atlas rect, params, lighting
+        for (unsigned int i = 7; i <= 13; i++)
+        {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
+        }
+        pointInstanceAttributes(0);
+    }
+
+    // points attributes 7..13 at InstanceData[baseInstance] of 'buffer' (the pool's own instance
+    // buffer when 0); the VAO must be bound
+    void pointInstanceAttributes(GLuint baseInstance, unsigned int buffer = 0)
+    {
+        size_t base = baseInstance * sizeof(InstanceData);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, buffer ? buffer : instanceBuffer);
+        for (unsigned int column = 0; column < 4; column++)
+            glVertexAttribPointer(7 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+        glVertexAttribPointer(11, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, atlasRect)));
+        glVertexAttribPointer(12, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, params)));
+        glVertexAttribPointer(13, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, lighting)));
+    }
+};
+#endif
@@ -0,0 +1,134 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <cstring>
+
+// The vendored GLAD loader was generated for GL 3.3, so entry points from later versions are
+// loaded here, after gladLoadGLLoader. Each one stays null unless the context version or the
+// matching ARB extension provides it; callers check the Has* flag and keep a GL 3.3 path.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER_BINDING
+#define GL_DRAW_INDIRECT_BUFFER_BINDING 0x8F43
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_NEGATIVE_ONE_TO_ONE
+#define GL_NEGATIVE_ONE_TO_ONE 0x935E
+#endif
+#ifndef GL_ZERO_TO_ONE
+#define GL_ZERO_TO_ONE 0x935F
+#endif
+
+namespace GLExt
+{
+    typedef void (APIENTRYP PFNMULTIDRAWELEMENTSINDIRECT)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+    typedef void (APIENTRYP PFNGETPROGRAMBINARY)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (APIENTRYP PFNPROGRAMBINARY)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void (APIENTRYP PFNPROGRAMPARAMETERI)(GLuint program, GLenum pname, GLint value);
+    typedef void (APIENTRYP PFNDISPATCHCOMPUTE)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+    typedef void (APIENTRYP PFNMEMORYBARRIER)(GLbitfield barriers);
+    typedef void (APIENTRYP PFNCLIPCONTROL)(GLenum origin, GLenum depth);
+
+    inline int Major = 3, Minor = 3;
+
+    // GL 4.3 / ARB_multi_draw_indirect (base instance comes with it through GL 4.2 / ARB_base_instance)
+    inline bool HasMultiDrawIndirect = false;
+    inline PFNMULTIDRAWELEMENTSINDIRECT MultiDrawElementsIndirect = nullptr;
+
+    // GL 4.1 / ARB_get_program_binary, and the driver offers at least one binary format
+    inline bool HasProgramBinary = false;
+    inline PFNGETPROGRAMBINARY GetProgramBinary = nullptr;
+    inline PFNPROGRAMBINARY ProgramBinary = nullptr;
+    inline PFNPROGRAMPARAMETERI ProgramParameteri = nullptr;
+
+    // GL 4.3 / ARB_compute_shader together with ARB_shader_storage_buffer_object
+    inline bool HasCompute = false;
+    inline PFNDISPATCHCOMPUTE DispatchCompute = nullptr;
+    inline PFNMEMORYBARRIER MemoryBarrier = nullptr;
+
+    // GL 4.5 / ARB_clip_control
+    inline bool HasClipControl = false;
+    inline PFNCLIPCONTROL ClipControl = nullptr;
+
+    inline bool HasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    inline bool Supports(int major, int minor, const char* extension)
+    {
+        return Major > major || (Major == major && Minor >= minor) || HasExtension(extension);
+    }
+
+    // call once with the same loader given to GLAD
+    inline void Load(GLADloadproc loader)
+    {
+        glGetIntegerv(GL_MAJOR_VERSION, &Major);
+        glGetIntegerv(GL_MINOR_VERSION, &Minor);
+
+        if (Supports(4, 3, "GL_ARB_multi_draw_indirect") && Supports(4, 2, "GL_ARB_base_instance"))
+            MultiDrawElementsIndirect = reinterpret_cast<PFNMULTIDRAWELEMENTSINDIRECT>(loader("glMultiDrawElementsIndirect"));
+        HasMultiDrawIndirect = MultiDrawElementsIndirect != nullptr;
+
+        if (Supports(4, 1, "GL_ARB_get_program_binary"))
+        {
+            GetProgramBinary = reinterpret_cast<PFNGETPROGRAMBINARY>(loader("glGetProgramBinary"));
+            ProgramBinary = reinterpret_cast<PFNPROGRAMBINARY>(loader("glProgramBinary"));
+            ProgramParameteri = reinterpret_cast<PFNPROGRAMPARAMETERI>(loader("glProgramParameteri"));
+        }
+        GLint binaryFormats = 0;
+        if (GetProgramBinary && ProgramBinary && ProgramParameteri)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+        HasProgramBinary = binaryFormats > 0;
+
+        if (Supports(4, 3, "GL_ARB_compute_shader") && Supports(4, 3, "GL_ARB_shader_storage_buffer_object"))
+        {
+            DispatchCompute = reinterpret_cast<PFNDISPATCHCOMPUTE>(loader("glDispatchCompute"));
+            MemoryBarrier = reinterpret_cast<PFNMEMORYBARRIER>(loader("glMemoryBarrier"));
+        }
+        HasCompute = DispatchCompute && MemoryBarrier;
+
+        if (Supports(4, 5, "GL_ARB_clip_control"))
+            ClipControl = reinterpret_cast<PFNCLIPCONTROL>(loader("glClipControl"));
+        HasClipControl = ClipControl != nullptr;
+    }
+}
+#endif
@@ -0,0 +1,427 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <gl_extensions.h>
+
+#include <iostream>
+
+// Shadow copy of the GL bind and fixed-function state so redundant calls never reach the driver.
+// Renderer code binds programs, VAOs, buffers and textures and sets depth/blend state through here
+// instead of calling GL directly; a request for what is already set only bumps a counter. Code that
+// deletes an object must tell the cache (the *Deleted calls), because GL silently resets bindings of
+// deleted objects. In debug mode every filtered request is checked against glGet*, and Validate()
+// compares the whole shadow copy, so a stale cache shows up where it happens.
+class GLState
+{
+public:
+    struct Counter {
+        unsigned int requested = 0; // calls made to the cache
+        unsigned int issued = 0;    // calls that reached GL
+        unsigned int Filtered() const { return requested - issued; }
+    };
+
+    struct Counters {
+        Counter program, vao, buffer, texture, activeTexture, depth, blend;
+    };
+
+    static GLState& Get()
+    {
+        static GLState instance;
+        return instance;
+    }
+
+    // checks filtered requests against the real GL state; slow, for tracking down stale state
+    void SetDebug(bool enabled) { debug = enabled; }
+    bool Debug() const { return debug; }
+
+    void UseProgram(GLuint program)
+    {
+        counters.program.requested++;
+        if (program == currentProgram)
+        {
+            if (debug)
+                check("program", GL_CURRENT_PROGRAM, program);
+            return;
+        }
+        glUseProgram(program);
+        currentProgram = program;
+        counters.program.issued++;
+    }
+
+    void BindVertexArray(GLuint vao)
+    {
+        counters.vao.requested++;
+        if (vao == currentVAO)
+        {
+            if (debug)
+                check("vertex array", GL_VERTEX_ARRAY_BINDING, vao);
+            return;
+        }
+        glBindVertexArray(vao);
+        currentVAO = vao;
+        counters.vao.issued++;
+    }
+
+    // GL_ELEMENT_ARRAY_BUFFER belongs to the bound VAO, so it is passed straight through
+    void BindBuffer(GLenum target, GLuint buffer)
+    {
+        counters.buffer.requested++;
+        int slot = bufferSlot(target);
+        if (slot >= 0 && buffers[slot] == buffer)
+        {
+            if (debug)
+                check("buffer", BUFFER_QUERIES[slot], buffer);
+            return;
+        }
+        glBindBuffer(target, buffer);
+        counters.buffer.issued++;
+        if (slot >= 0)
+            buffers[slot] = buffer;
+    }
+
+    // shader storage bindings are few and only change around compute passes, so they go straight through
+    void BindStorageBuffer(GLuint index, GLuint buffer)
+    {
+        counters.buffer.requested++;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, buffer);
+        counters.buffer.issued++;
+    }
+
+    // binds a range of 'buffer' to uniform block binding point 'index' (and, as GL does, to the generic target)
+    void BindUniformRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        counters.buffer.requested++;
+        if (index < MAX_UNIFORM_BINDINGS)
+        {
+            UniformRange& bound = uniformRanges[index];
+            if (bound.buffer == buffer && bound.offset == offset && bound.size == size)
+            {
+                if (debug)
+                    checkIndexed("uniform binding", GL_UNIFORM_BUFFER_BINDING, index, buffer);
+                return;
+            }
+            bound.buffer = buffer;
+            bound.offset = offset;
+            bound.size = size;
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+        buffers[bufferSlot(GL_UNIFORM_BUFFER)] = buffer;
+        counters.buffer.issued++;
+    }
+
+    // binds 'texture' to 'target' on texture unit 'unit'
+    void BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        counters.texture.requested++;
+        int slot = targetSlot(target);
+        if (unit < MAX_UNITS && slot >= 0 && textures[unit][slot] == texture)
+        {
+            if (debug)
+                checkTexture(unit, slot, texture);
+            return;
+        }
+        ActiveTexture(unit);
+        glBindTexture(target, texture);
+        counters.texture.issued++;
+        if (unit < MAX_UNITS && slot >= 0)
+            textures[unit][slot] = texture;
+    }
+
+    // selects the unit later glTexParameter/glTexImage calls act on
+    void ActiveTexture(GLuint unit)
+    {
+        counters.activeTexture.requested++;
+        if (unit == activeUnit)
+        {
+            if (debug)
+                check("active texture", GL_ACTIVE_TEXTURE, GL_TEXTURE0 + unit);
+            return;
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        counters.activeTexture.issued++;
+    }
+
+    void SetDepthTest(bool enabled)
+    {
+        setCapability(GL_DEPTH_TEST, enabled, depthTest, counters.depth, "depth test");
+    }
+
+    void SetDepthFunc(GLenum func)
+    {
+        counters.depth.requested++;
+        if (func == depthFunc)
+        {
+            if (debug)
+                check("depth func", GL_DEPTH_FUNC, func);
+            return;
+        }
+        glDepthFunc(func);
+        depthFunc = func;
+        counters.depth.issued++;
+    }
+
+    void SetDepthMask(bool write)
+    {
+        counters.depth.requested++;
+        int value = write ? 1 : 0;
+        if (value == depthMask)
+        {
+            if (debug)
+                check("depth mask", GL_DEPTH_WRITEMASK, static_cast<GLuint>(value));
+            return;
+        }
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        depthMask = value;
+        counters.depth.issued++;
+    }
+
+    void SetBlend(bool enabled)
+    {
+        setCapability(GL_BLEND, enabled, blend, counters.blend, "blend");
+    }
+
+    void SetBlendFunc(GLenum source, GLenum destination)
+    {
+        counters.blend.requested++;
+        if (source == blendSource && destination == blendDestination)
+        {
+            if (debug)
+            {
+                check("blend source", GL_BLEND_SRC_RGB, source);
+                check("blend destination", GL_BLEND_DST_RGB, destination);
+            }
+            return;
+        }
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+        counters.blend.issued++;
+    }
+
+    // reverse-Z: clip-space depth runs from 1 at the near plane to 0 at the far one (glClipControl
+    // with GL_ZERO_TO_ONE plus a projection with near and far swapped, see FrameUniforms::Projection),
+    // which spreads depth precision far more evenly over the distance. Needs GL 4.5 or
+    // ARB_clip_control; returns whether it is on. Depth is cleared to the far value either way.
+    bool SetReverseZ(bool enabled)
+    {
+        reverseZ = enabled && GLExt::HasClipControl;
+        if (GLExt::HasClipControl)
+            GLExt::ClipControl(GL_LOWER_LEFT, reverseZ ? GL_ZERO_TO_ONE : GL_NEGATIVE_ONE_TO_ONE);
+        glClearDepth(FarDepth());
+        return reverseZ;
+    }
+    bool ReverseZ() const { return reverseZ; }
+    // the depth of the far plane, and the test that lets nearer or equal depths through
+    double FarDepth() const { return reverseZ ? 0.0 : 1.0; }
+    GLenum DepthTestFunc() const { return reverseZ ? GL_GEQUAL : GL_LEQUAL; }
+
+    GLuint Program() const { return currentProgram; }
+
+    void ProgramDeleted(GLuint program)
+    {
+        if (currentProgram == program)
+            currentProgram = 0;
+    }
+
+    void VertexArrayDeleted(GLuint vao)
+    {
+        if (currentVAO == vao)
+            currentVAO = 0;
+    }
+
+    void BufferDeleted(GLuint buffer)
+    {
+        for (GLuint& bound : buffers)
+            if (bound == buffer)
+                bound = 0;
+        for (UniformRange& range : uniformRanges)
+            if (range.buffer == buffer)
+                range = UniformRange{ 0, 0, 0 };
+    }
+
+    void TextureDeleted(GLuint texture)
+    {
+        for (GLuint unit = 0; unit < MAX_UNITS; unit++)
+            for (int slot = 0; slot < TARGET_COUNT; slot++)
+                if (textures[unit][slot] == texture)
+                    textures[unit][slot] = 0;
+    }
+
+    // forgets everything, e.g. after code that talked to GL directly
+    void Invalidate()
+    {
+        currentProgram = INVALID;
+        currentVAO = INVALID;
+        activeUnit = INVALID;
+        for (GLuint& bound : buffers)
+            bound = INVALID;
+        for (UniformRange& range : uniformRanges)
+            range = UniformRange();
+        for (GLuint unit = 0; unit < MAX_UNITS; unit++)
+            for (int slot = 0; slot < TARGET_COUNT; slot++)
+                textures[unit][slot] = INVALID;
+        depthTest = depthMask = blend = -1;
+        depthFunc = blendSource = blendDestination = INVALID;
+    }
+
+    // compares every known piece of shadow state with glGet*; prints and returns the mismatches
+    unsigned int Validate()
+    {
+        unsigned int mismatches = 0;
+        if (currentProgram != INVALID)
+            mismatches += check("program", GL_CURRENT_PROGRAM, currentProgram);
+        if (currentVAO != INVALID)
+            mismatches += check("vertex array", GL_VERTEX_ARRAY_BINDING, currentVAO);
+        for (int slot = 0; slot < BUFFER_COUNT; slot++)
+            if (buffers[slot] != INVALID && (BUFFER_TARGETS[slot] != GL_DRAW_INDIRECT_BUFFER || GLExt::HasMultiDrawIndirect))
+                mismatches += check("buffer", BUFFER_QUERIES[slot], buffers[slot]);
+        for (GLuint index = 0; index < MAX_UNIFORM_BINDINGS; index++)
+            if (uniformRanges[index].buffer != INVALID)
+                mismatches += checkIndexed("uniform binding", GL_UNIFORM_BUFFER_BINDING, index, uniformRanges[index].buffer);
+        for (GLuint unit = 0; unit < MAX_UNITS; unit++)
+            for (int slot = 0; slot < TARGET_COUNT; slot++)
+                if (textures[unit][slot] != INVALID)
+                    mismatches += checkTexture(unit, slot, textures[unit][slot]);
+        if (activeUnit != INVALID)
+            mismatches += check("active texture", GL_ACTIVE_TEXTURE, GL_TEXTURE0 + activeUnit);
+        if (depthTest >= 0)
+            mismatches += checkEnabled("depth test", GL_DEPTH_TEST, depthTest);
+        if (depthFunc != INVALID)
+            mismatches += check("depth func", GL_DEPTH_FUNC, depthFunc);
+        if (depthMask >= 0)
+            mismatches += check("depth mask", GL_DEPTH_WRITEMASK, static_cast<GLuint>(depthMask));
+        if (blend >= 0)
+            mismatches += checkEnabled("blend", GL_BLEND, blend);
+        if (blendSource != INVALID)
+        {
+            mismatches += check("blend source", GL_BLEND_SRC_RGB, blendSource);
+            mismatches += check("blend destination", GL_BLEND_DST_RGB, blendDestination);
+        }
+        return mismatches;
+    }
+
+    void ResetCounters() { counters = Counters(); }
+    const Counters& GetCounters() const { return counters; }
+
+private:
+    static const GLuint INVALID = 0xFFFFFFFFu;
+    static const GLuint MAX_UNITS = 16;
+    static const int TARGET_COUNT = 3;
+    static const int BUFFER_COUNT = 7;
+    static const GLuint MAX_UNIFORM_BINDINGS = 16;
+    static constexpr GLenum TEXTURE_QUERIES[TARGET_COUNT] = { GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_2D_ARRAY, GL_TEXTURE_BINDING_CUBE_MAP };
+    static constexpr GLenum BUFFER_TARGETS[BUFFER_COUNT] = {
+        GL_ARRAY_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER,
+        GL_PIXEL_UNPACK_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER
+    };
+    static constexpr GLenum BUFFER_QUERIES[BUFFER_COUNT] = {
+        GL_ARRAY_BUFFER_BINDING, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER_BINDING,
+        GL_PIXEL_UNPACK_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING, GL_DRAW_INDIRECT_BUFFER_BINDING
+    };
+
+    GLuint currentProgram = INVALID;
+    GLuint currentVAO = INVALID;
+    GLuint activeUnit = INVALID;
+    GLuint buffers[BUFFER_COUNT];
+    struct UniformRange {
+        GLuint buffer = INVALID;
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+    UniformRange uniformRanges[MAX_UNIFORM_BINDINGS];
+    GLuint textures[MAX_UNITS][TARGET_COUNT];
+    int depthTest = -1, depthMask = -1, blend = -1; // -1: unknown
+    GLenum depthFunc = INVALID, blendSource = INVALID, blendDestination = INVALID;
+    bool debug = false;
+    bool reverseZ = false;
+    Counters counters;
+
+    GLState() { Invalidate(); }
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    static int targetSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_2D_ARRAY: return 1;
+        case GL_TEXTURE_CUBE_MAP: return 2;
+        default: return -1;
+        }
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        for (int slot = 0; slot < BUFFER_COUNT; slot++)
+            if (BUFFER_TARGETS[slot] == target)
+                return slot;
+        return -1;
+    }
+
+    void setCapability(GLenum capability, bool enabled, int& shadow, Counter& counter, const char* name)
+    {
+        counter.requested++;
+        int value = enabled ? 1 : 0;
+        if (value == shadow)
+        {
+            if (debug)
+                checkEnabled(name, capability, value);
+            return;
+        }
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        shadow = value;
+        counter.issued++;
+    }
+
+    unsigned int check(const char* name, GLenum query, GLuint expected) const
+    {
+        GLint actual = 0;
+        glGetIntegerv(query, &actual);
+        if (static_cast<GLuint>(actual) == expected)
+            return 0;
+        std::cout << "ERROR::GL_STATE::STALE " << name << ": cached " << expected << ", GL has " << actual << std::endl;
+        return 1;
+    }
+
+    unsigned int checkIndexed(const char* name, GLenum query, GLuint index, GLuint expected) const
+    {
+        GLint actual = 0;
+        glGetIntegeri_v(query, index, &actual);
+        if (static_cast<GLuint>(actual) == expected)
+            return 0;
+        std::cout << "ERROR::GL_STATE::STALE " << name << " " << index << ": cached " << expected << ", GL has " << actual << std::endl;
+        return 1;
+    }
+
+    unsigned int checkEnabled(const char* name, GLenum capability, int expected) const
+    {
+        int actual = glIsEnabled(capability) ? 1 : 0;
+        if (actual == expected)
+            return 0;
+        std::cout << "ERROR::GL_STATE::STALE " << name << ": cached " << expected << ", GL has " << actual << std::endl;
+        return 1;
+    }
+
+    // reads a unit's binding by switching to it, then puts the active unit back
+    unsigned int checkTexture(GLuint unit, int slot, GLuint expected) const
+    {
+        GLint previous = 0;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &previous);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        GLint actual = 0;
+        glGetIntegerv(TEXTURE_QUERIES[slot], &actual);
+        glActiveTexture(previous);
+        if (static_cast<GLuint>(actual) == expected)
+            return 0;
+        std::cout << "ERROR::GL_STATE::STALE texture unit " << unit << ": cached " << expected << ", GL has " << actual << std::endl;
+        return 1;
+    }
+};
+#endif
@@ -0,0 +1,315 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+
+#include <geometry_pool.h>
+#include <gl_extensions.h>
+#include <gl_state.h>
+#include <model.h>
+#include <shader_c.h>
+#include <shader_m.h>
+#include <texture_atlas.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// GPU-driven drawing of one model instanced many times (the asteroid belt).
+// The transforms live in a shader storage buffer. Every frame a compute pass (src/cull.comp)
+// culls each instance's bounding sphere against the frustum, picks a LOD by distance and appends
+// the survivors to the instance ranges of that LOD's draw slots, counting them in the slots'
+// indirect commands; the CPU never sees the result and only issues one glMultiDrawElementsIndirect
+// per material. A slot is one mesh of one LOD model. Needs GL 4.3 (GLExt::HasCompute and
+// HasMultiDrawIndirect); callers check Supported() and keep the CPU path otherwise.
+//
+// Validate() reads the results back and checks them against the same test done on the CPU, which
+// makes the pass testable on a software rasterizer such as Mesa's llvmpipe.
+class GpuCulling
+{
+public:
+    static const unsigned int MAX_LODS = 4;
+    static const unsigned int MAX_SLOTS = 16; // matches src/cull.comp
+
+    GpuCulling(const char* computePath = "src/cull.comp")
+        : program(computePath)
+    {
+    }
+
+    bool Supported() const { return GLExt::HasCompute && GLExt::HasMultiDrawIndirect && program.Valid(); }
+
+    // adds the next LOD, from the most to the least detailed; instances farther away than the last
+    // LOD's 'maxDistance' are not drawn at all
+    void AddLod(const Model& model, float maxDistance)
+    {
+        if (lods.size() == MAX_LODS)
+        {
+            std::cout << "ERROR::GPU_CULLING::TOO_MANY_LODS" << std::endl;
+            return;
+        }
+        lods.push_back(Lod{ &model, maxDistance });
+        glm::vec4 sphere = model.Bounds();
+        if (sphere.w > bounds.w)
+            bounds = sphere;
+    }
+
+    // uploads the instance transforms (once, they don't move) and sizes the output buffers
+    void SetInstances(const glm::mat4* transforms, unsigned int count)
+    {
+        if (!Supported())
+            return;
+        instanceCount = count;
+        source.assign(transforms, transforms + count);
+        buildSlots();
+        if (!transformBuffer)
+        {
+            glGenBuffers(1, &transformBuffer);
+            glGenBuffers(1, &instanceBuffer);
+            glGenBuffers(1, &commandBuffer);
+        }
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, transformBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(glm::mat4), transforms, GL_STATIC_DRAW);
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(1, slots.size() * count) * sizeof(InstanceData), NULL, GL_DYNAMIC_COPY);
+        GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, std::max<size_t>(1, slots.size()) * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+    }
+
+    // runs the compute pass for this frame's camera
+    void Cull(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+    {
+        if (!Supported() || slots.empty())
+            return;
+        frustum = FrustumPlanes(viewProjection);
+        camera = cameraPosition;
+
+        // reset the instance counts; everything else in the commands is fixed
+        GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, templates.size() * sizeof(DrawElementsIndirectCommand), templates.data());
+
+        program.use();
+        program.setUint("instanceCount", instanceCount);
+        program.setVec4Array("frustum", frustum.data(), 6);
+        program.setVec3("cameraPosition", camera);
+        program.setVec4("bounds", bounds);
+        glm::vec4 distances(0.0f);
+        for (size_t i = 0; i < lods.size(); i++)
+            distances[static_cast<int>(i)] = lods[i].maxDistance;
+        program.setVec4("lodDistances", distances);
+        program.setUint("lodCount", static_cast<unsigned int>(lods.size()));
+        program.setUint("slotCount", static_cast<unsigned int>(slots.size()));
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            std::string index = "[" + std::to_string(i) + "]";
+            program.setUint("slotLod" + index, slots[i].lod);
+            program.setVec4("slotAtlasRect" + index, slots[i].mesh->atlasRect);
+            program.setFloat("slotAtlasLayer" + index, float(slots[i].mesh->atlasLayer));
+            program.setVec2("slotMaterial" + index, lods[slots[i].lod].model->Material());
+        }
+        GLState::Get().BindStorageBuffer(0, transformBuffer);
+        GLState::Get().BindStorageBuffer(1, instanceBuffer);
+        GLState::Get().BindStorageBuffer(2, commandBuffer);
+        program.dispatch((instanceCount + 63) / 64);
+        // the draws read the commands and the instance attributes the pass wrote
+        GLExt::MemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    }
+
+    // draws the survivors of the last Cull(); atlased meshes use 'atlasShader' and the atlas,
+    // the others 'shader' and their diffuse map. Slots sharing all state go out as one call.
+    void Draw(Shader& shader, Shader& atlasShader, const TextureAtlas& atlas)
+    {
+        if (!Supported() || slots.empty())
+            return;
+        GeometryPool& pool = GeometryPool::Get();
+        for (size_t first = 0; first < slots.size(); )
+        {
+            size_t last = first + 1;
+            while (last < slots.size() && slots[last].texture == slots[first].texture && slots[last].atlased == slots[first].atlased)
+                last++;
+            if (slots[first].atlased)
+            {
+                atlasShader.use();
+                GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, atlas.ID);
+            }
+            else
+            {
+                shader.use();
+                GLState::Get().BindTexture(0, GL_TEXTURE_2D, slots[first].texture);
+            }
+            pool.DrawIndirect(commandBuffer, instanceBuffer, first, last - first);
+            first = last;
+        }
+    }
+
+    // reads back the last Cull() and checks it against the CPU version of the same test. Instances
+    // within a hair of a plane or a LOD boundary may go either way and are not counted against it.
+    // Returns false (and prints what differs) on a mismatch. Stalls the pipeline: for testing only.
+    bool Validate()
+    {
+        if (!Supported() || slots.empty())
+            return true;
+        GLExt::MemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        std::vector<DrawElementsIndirectCommand> commands(slots.size());
+        GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        std::vector<InstanceData> instances(slots.size() * instanceCount);
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+
+        // what the CPU expects of every instance: a LOD, culled (-1), or either (-2)
+        std::vector<int> expected(instanceCount);
+        for (unsigned int i = 0; i < instanceCount; i++)
+            expected[i] = classify(source[i]);
+
+        bool ok = true;
+        for (size_t s = 0; s < slots.size(); s++)
+        {
+            const DrawElementsIndirectCommand& command = commands[s];
+            if (command.instanceCount > instanceCount || command.count != templates[s].count || command.baseInstance != templates[s].baseInstance)
+            {
+                std::cout << "ERROR::GPU_CULLING::BAD_COMMAND: slot " << s << std::endl;
+                ok = false;
+                continue;
+            }
+            std::vector<char> seen(instanceCount, 0);
+            for (unsigned int k = 0; k < command.instanceCount; k++)
+            {
+                const InstanceData& data = instances[command.baseInstance + k];
+                unsigned int id = static_cast<unsigned int>(data.params.y);
+                if (id >= instanceCount || seen[id] || data.model != source[id] || data.params.x != float(slots[s].mesh->atlasLayer))
+                {
+                    std::cout << "ERROR::GPU_CULLING::BAD_INSTANCE: slot " << s << " entry " << k << std::endl;
+                    ok = false;
+                    break;
+                }
+                seen[id] = 1;
+                if (expected[id] != -2 && expected[id] != static_cast<int>(slots[s].lod))
+                {
+                    std::cout << "ERROR::GPU_CULLING::MISMATCH: instance " << id << " drawn at LOD " << slots[s].lod << ", expected " << expected[id] << std::endl;
+                    ok = false;
+                }
+            }
+            for (unsigned int id = 0; id < instanceCount; id++)
+            {
+                if (!seen[id] && expected[id] == static_cast<int>(slots[s].lod))
+                {
+                    std::cout << "ERROR::GPU_CULLING::MISMATCH: instance " << id << " missing from LOD " << slots[s].lod << std::endl;
+                    ok = false;
+                }
+            }
+        }
+        return ok;
+    }
+
+    // frees the buffers and the program; call while the context is still current
+    void Delete()
+    {
+        for (unsigned int* buffer : { &transformBuffer, &instanceBuffer, &commandBuffer })
+        {
+            glDeleteBuffers(1, buffer);
+            GLState::Get().BufferDeleted(*buffer);
+            *buffer = 0;
+        }
+        program.Delete();
+    }
+
+    // the six planes of a view-projection matrix as (inward normal, distance), normalized
+    static std::vector<glm::vec4> FrustumPlanes(const glm::mat4& m)
+    {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        std::vector<glm::vec4> planes = { row[3] + row[0], row[3] - row[0], row[3] + row[1], row[3] - row[1], row[3] + row[2], row[3] - row[2] };
+        for (glm::vec4& plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+        return planes;
+    }
+
+private:
+    struct Lod {
+        const Model* model;
+        float maxDistance;
+    };
+    struct Slot {
+        unsigned int lod;
+        const Mesh* mesh;
+        bool atlased;
+        unsigned int texture; // diffuse map when not atlased
+    };
+
+    ComputeShader program;
+    std::vector<Lod> lods;
+    std::vector<Slot> slots;
+    std::vector<DrawElementsIndirectCommand> templates; // per slot, instanceCount 0
+    std::vector<glm::mat4> source;                      // CPU copy of the transforms, for Validate()
+    glm::vec4 bounds = glm::vec4(0.0f);
+    std::vector<glm::vec4> frustum;
+    glm::vec3 camera = glm::vec3(0.0f);
+    unsigned int instanceCount = 0;
+    unsigned int transformBuffer = 0, instanceBuffer = 0, commandBuffer = 0;
+
+    // one slot per mesh per LOD, grouped by material so Draw() merges them
+    void buildSlots()
+    {
+        slots.clear();
+        for (unsigned int lod = 0; lod < lods.size(); lod++)
+        {
+            for (const Mesh& mesh : lods[lod].model->meshes)
+            {
+                if (mesh.range.indexCount == 0)
+                    continue;
+                if (slots.size() == MAX_SLOTS)
+                {
+                    std::cout << "ERROR::GPU_CULLING::TOO_MANY_MESHES" << std::endl;
+                    break;
+                }
+                Slot slot{ lod, &mesh, mesh.atlasLayer >= 0, 0 };
+                for (const Texture& texture : mesh.textures)
+                    if (texture.type == "texture_diffuse")
+                        slot.texture = texture.id;
+                slots.push_back(slot);
+            }
+        }
+        std::stable_sort(slots.begin(), slots.end(), [](const Slot& a, const Slot& b) {
+            return a.atlased != b.atlased ? a.atlased : a.texture < b.texture;
+        });
+        templates.clear();
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            const MeshRange& range = slots[i].mesh->range;
+            templates.push_back(DrawElementsIndirectCommand{ range.indexCount, 0, range.firstIndex, range.baseVertex, static_cast<GLuint>(i * instanceCount) });
+        }
+    }
+
+    // the CPU version of src/cull.comp for one instance: its LOD, -1 if culled, -2 if too close to call
+    int classify(const glm::mat4& model) const
+    {
+        const float margin = 1e-3f;
+        glm::vec3 centre = glm::vec3(model * glm::vec4(glm::vec3(bounds), 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float radius = bounds.w * scale;
+        bool borderline = false;
+        for (const glm::vec4& plane : frustum)
+        {
+            float distance = glm::dot(glm::vec3(plane), centre) + plane.w + radius;
+            if (distance < -margin)
+                return -1;
+            borderline = borderline || distance < margin;
+        }
+        float distance = glm::length(centre - camera);
+        int lod = 0;
+        while (lod < static_cast<int>(lods.size()) && distance > lods[lod].maxDistance)
+        {
+            borderline = borderline || distance - lods[lod].maxDistance < margin;
+            lod++;
+        }
+        if (lod < static_cast<int>(lods.size()))
+            borderline = borderline || lods[lod].maxDistance - distance < margin;
+        if (borderline)
+            return -2;
+        return lod == static_cast<int>(lods.size()) ? -1 : lod;
+    }
+};
+#endif
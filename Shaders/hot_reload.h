@@ -0,0 +1,258 @@
+#ifndef HOT_RELOAD_H
+#define HOT_RELOAD_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <stb_image.h>
+#include <assimp/Importer.hpp>
+
+#include <file_watcher.h>
+#include <model.h>
+#include <shader_m.h>
+#include <shader_variants.h>
+#include <texture_atlas.h>
+#include <texture_manager.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Applies edits to shaders, textures and models while the program runs.
+// Changed files come from a FileWatcher. Everything that only needs the file system (reading and
+// preprocessing shader sources, decoding images, importing models) runs on a worker through
+// std::async; Update() picks up the finished jobs at the start of a frame and does the GL part
+// (compile and link, texture upload, mesh upload) on the render thread. Nothing is torn down before
+// its replacement is ready: a shader that fails to compile or a model that fails to import leaves
+// the old one in place, so a typo never costs more than an error message.
+class HotReload
+{
+public:
+    struct Stats {
+        unsigned int shaders = 0;  // programs rebuilt
+        unsigned int textures = 0; // images re-uploaded (model textures and atlas regions)
+        unsigned int models = 0;   // models reimported
+        unsigned int failed = 0;   // reloads that kept the old version
+    };
+
+    HotReload(FileWatcher& watcher) : watcher(watcher) {}
+
+    // all permutations of 'variants' are watched, including ones built later
+    void Watch(ShaderVariants& variants) { variantSets.push_back(&variants); }
+    void Watch(Shader& shader) { shaders.push_back(&shader); }
+    void Watch(Model& model) { models.push_back(&model); }
+    void Watch(TextureAtlas& atlas) { atlases.push_back(&atlas); }
+
+    // render thread, once per frame before drawing
+    void Update()
+    {
+        for (const std::string& changed : watcher.TakeChanges())
+            dispatch(TextureManager::CanonicalPath(changed));
+
+        for (size_t i = 0; i < jobs.size(); )
+        {
+            if (jobs[i].result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                i++;
+                continue;
+            }
+            Job job = std::move(jobs[i]);
+            jobs.erase(jobs.begin() + i);
+            auto start = std::chrono::steady_clock::now();
+            std::function<bool()> apply = job.result.get();
+            if (apply && apply())
+            {
+                std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+                std::cout << "Hot reload: " << job.file << " (" << took.count() << " ms)" << std::endl;
+            }
+            else
+            {
+                stats.failed++;
+                std::cout << "ERROR::HOT_RELOAD::KEPT_OLD_VERSION: " << job.file << std::endl;
+            }
+            // saved again while the job was running: start over with the latest version
+            if (again.erase(job.target))
+                dispatch(job.file);
+        }
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    struct Job {
+        const void* target;  // the object being reloaded; one job per target at a time
+        std::string file;    // the change that started it
+        std::future<std::function<bool()>> result; // worker output, applied on the render thread
+    };
+
+    FileWatcher& watcher;
+    std::vector<ShaderVariants*> variantSets;
+    std::vector<Shader*> shaders;
+    std::vector<Model*> models;
+    std::vector<TextureAtlas*> atlases;
+    std::vector<Job> jobs;
+    std::set<const void*> again;
+    std::set<std::string> textureFiles;
+    Stats stats;
+
+    // starts the reloads 'file' (canonical) calls for
+    void dispatch(const std::string& file)
+    {
+        std::vector<Shader*> all = shaders;
+        for (ShaderVariants* variants : variantSets)
+        {
+            std::vector<Shader*> built = variants->All();
+            all.insert(all.end(), built.begin(), built.end());
+        }
+        for (Shader* shader : all)
+        {
+            for (const std::string& source : shader->Files)
+            {
+                if (TextureManager::CanonicalPath(source) == file)
+                {
+                    reloadShader(*shader, file);
+                    break;
+                }
+            }
+        }
+
+        if (isImage(file))
+        {
+            std::vector<TextureAtlas*> holders;
+            AtlasRegion region;
+            for (TextureAtlas* atlas : atlases)
+                if (atlas->Find(file, region))
+                    holders.push_back(atlas);
+            if (TextureManager::Get().Has(file) || !holders.empty())
+                reloadTexture(file, holders);
+            return;
+        }
+
+        // the model file itself, or its .mtl and other companions next to it
+        std::string directory = std::filesystem::path(file).parent_path().generic_string();
+        for (Model* model : models)
+        {
+            if (model->path.empty())
+                continue; // built in code, e.g. a SphereLibrary body; its texture is handled above
+            std::string path = TextureManager::CanonicalPath(model->path);
+            if (path == file || std::filesystem::path(path).parent_path().generic_string() == directory)
+                reloadModel(*model, file);
+        }
+    }
+
+    void start(const void* target, const std::string& file, std::future<std::function<bool()>> result)
+    {
+        jobs.push_back(Job{ target, file, std::move(result) });
+    }
+
+    // true if 'target' is already being reloaded; it is then reloaded once more when that finishes
+    bool busy(const void* target)
+    {
+        for (const Job& job : jobs)
+        {
+            if (job.target == target)
+            {
+                again.insert(target);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void reloadShader(Shader& shader, const std::string& file)
+    {
+        if (busy(&shader))
+            return;
+        Shader* target = &shader;
+        start(target, file, std::async(std::launch::async, [this, target]() -> std::function<bool()> {
+            // the sources are read and preprocessed here; the GL compile has to wait for the render thread
+            std::shared_ptr<Shader::Sources> sources = std::make_shared<Shader::Sources>(target->LoadSources());
+            return [this, target, sources]() {
+                if (!target->Rebuild(*sources))
+                    return false;
+                stats.shaders++;
+                return true;
+            };
+        }));
+    }
+
+    void reloadTexture(const std::string& file, const std::vector<TextureAtlas*>& holders)
+    {
+        // jobs are keyed by object; for an image that is its entry in 'textureFiles'
+        const std::string* key = &*textureFiles.insert(file).first;
+        if (busy(key))
+            return;
+        start(key, file, std::async(std::launch::async, [this, key, holders]() -> std::function<bool()> {
+            const std::string& file = *key;
+            std::ifstream in(file, std::ios::binary);
+            std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            int width = 0, height = 0, components = 0;
+            std::shared_ptr<unsigned char> pixels(stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &components, 0), stbi_image_free);
+            std::shared_ptr<unsigned char> rgba;
+            if (pixels && !holders.empty())
+                rgba.reset(stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &components, 4), stbi_image_free);
+            if (!pixels)
+            {
+                std::cout << "ERROR::HOT_RELOAD::DECODE_FAILED: " << file << std::endl;
+                return nullptr; // e.g. caught halfway through being written; the next save retries
+            }
+            uint64_t hash = TextureManager::HashBytes(bytes);
+            size_t size = bytes.size();
+            return [this, key, holders, pixels, rgba, width, height, components, hash, size]() {
+                std::vector<std::pair<unsigned int, unsigned int>> split;
+                unsigned int replaced = TextureManager::Get().Replace(*key, hash, size, pixels.get(), width, height, components, split);
+                for (const std::pair<unsigned int, unsigned int>& moved : split)
+                {
+                    for (Model* model : models)
+                        model->RetargetTexture(*key, moved.first, moved.second);
+                    TextureManager::Get().Release(moved.second); // the models hold their own references now
+                }
+                for (TextureAtlas* atlas : holders)
+                    if (rgba)
+                        replaced += atlas->Replace(*key, rgba.get(), width, height) ? 1 : 0;
+                stats.textures += replaced;
+                return replaced > 0;
+            };
+        }));
+    }
+
+    void reloadModel(Model& model, const std::string& file)
+    {
+        if (busy(&model))
+            return;
+        Model* target = &model;
+        std::string path = model.path;
+        start(target, file, std::async(std::launch::async, [this, target, path]() -> std::function<bool()> {
+            // the scene belongs to the importer, so the importer travels with it to the render thread
+            std::shared_ptr<Assimp::Importer> importer = std::make_shared<Assimp::Importer>();
+            const aiScene* scene = Model::Import(*importer, path);
+            if (!scene)
+                return nullptr;
+            return [this, target, importer, scene]() {
+                target->Reload(scene);
+                stats.models++;
+                return true;
+            };
+        }));
+    }
+
+    static bool isImage(const std::string& file)
+    {
+        std::string extension = std::filesystem::path(file).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        for (const char* known : { ".jpg", ".jpeg", ".jfif", ".png", ".tga", ".bmp", ".gif", ".psd", ".hdr" })
+            if (extension == known)
+                return true;
+        return false;
+    }
+};
+#endif
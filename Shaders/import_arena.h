@@ -0,0 +1,92 @@
+#ifndef IMPORT_ARENA_H
+#define IMPORT_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for the scratch data of one model import.
+// Allocate() bumps a pointer through large blocks; nothing is freed individually. Reset() rewinds to
+// the start and keeps the memory, so every mesh of a model reuses the block the first one grew,
+// and the arena's destructor gives it all back in one go. Only for trivially destructible types:
+// no destructor is ever run.
+class ImportArena
+{
+public:
+    struct Stats {
+        size_t blocks = 0;    // blocks taken from the heap
+        size_t reserved = 0;  // bytes in those blocks
+        size_t peak = 0;      // most bytes in use between two Reset()s
+    };
+
+    ImportArena(size_t blockSize = 1024 * 1024) : blockSize(blockSize) {}
+
+    ImportArena(const ImportArena&) = delete;
+    ImportArena& operator=(const ImportArena&) = delete;
+
+    // 'count' value-initialized T
+    template <typename T>
+    T* Allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "ImportArena never runs destructors");
+        T* items = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < count; i++)
+            new (items + i) T();
+        return items;
+    }
+
+    // makes all memory available again without returning it to the heap
+    void Reset()
+    {
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size;
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t current = 0; // block being filled
+    size_t offset = 0;  // first free byte in it
+    size_t used = 0;    // bytes handed out since the last Reset(), for the peak
+    Stats stats;
+
+    void* allocate(size_t bytes, size_t alignment)
+    {
+        for (; current < blocks.size(); current++, offset = 0)
+        {
+            Block& block = blocks[current];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.memory.get());
+            size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+            if (aligned + bytes <= block.size)
+            {
+                offset = aligned + bytes;
+                used += bytes;
+                stats.peak = std::max(stats.peak, used);
+                return block.memory.get() + aligned;
+            }
+        }
+        // nothing left fits: a new block, large enough for oversized requests
+        Block block;
+        block.size = std::max(blockSize, bytes + alignment);
+        block.memory.reset(new unsigned char[block.size]);
+        stats.blocks++;
+        stats.reserved += block.size;
+        blocks.push_back(std::move(block));
+        current = blocks.size() - 1;
+        offset = 0;
+        return allocate(bytes, alignment);
+    }
+};
+#endif
@@ -0,0 +1,21 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <cstddef>
+
+// Bytes held by a resource in system memory and in GL objects. GPU sizes are what was asked of GL
+// (storage size, mip chain included) rather than what the driver really allocated, which GL can't report.
+struct MemoryUsage {
+    size_t cpuBytes = 0;
+    size_t gpuBytes = 0;
+
+    MemoryUsage& operator+=(const MemoryUsage& other)
+    {
+        cpuBytes += other.cpuBytes;
+        gpuBytes += other.gpuBytes;
+        return *this;
+    }
+
+    static double Megabytes(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+};
+#endif
@@ -6,31 +6,16 @@
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
 
-#include <shader_s.h>
+#include <geometry_pool.h>
+#include <gl_state.h>
+#include <memory_usage.h>
+#include <shader_m.h>
 
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-    //bone indexes which will influence this vertex
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-    //weights from each bone
-    float m_Weights[MAX_BONE_INFLUENCE];
-};
-
 struct Texture {
     unsigned int id;
     string type;
@@ -43,17 +28,89 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    unsigned int VAO;   // the shared GeometryPool VAO
+    MeshRange range;    // where the vertices and indices live inside the pool
+    // set when the diffuse map was moved into a TextureAtlas (see Model::UseAtlas)
+    int atlasLayer = -1;
+    glm::vec4 atlasRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    // model-space bounds, kept when the vertices themselves are released
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+    glm::vec4 bounds = glm::vec4(0.0f); // bounding sphere: xyz centre (of the box), w radius
+    // coarser versions of 'range', also in the pool: lods[i] takes over from 'lodDistances[i]' bounding radii away
+    vector<MeshRange> lods;
+    vector<float> lodDistances;
+    bool sharedGeometry = false; // the ranges belong to another mesh (see the sharing constructor)
+
+    // constructor; takes over the data instead of copying it. Once the geometry is in the GeometryPool
+    // the CPU copies of vertices and indices are freed, unless 'keepCpuData' is set because something
+    // on the CPU (picking, physics) still reads them.
+    Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, bool keepCpuData = false)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
+    {
+        // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        if (!keepCpuData)
+            ReleaseCpuData();
+    }
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor for geometry in scratch memory (see ImportArena): it is uploaded straight from there
+    // and only copied into the mesh when 'keepCpuData' is set
+    Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount, vector<Texture>&& textures, bool keepCpuData = false)
+        : textures(std::move(textures))
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        setupMesh(vertices, vertexCount, indices, indexCount);
+        if (keepCpuData)
+        {
+            this->vertices.assign(vertices, vertices + vertexCount);
+            this->indices.assign(indices, indices + indexCount);
+        }
+    }
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+    // constructor for a mesh that draws the geometry of 'geometry' (e.g. a SphereLibrary sphere) with
+    // its own textures; nothing is uploaded, and the ranges are not counted again in Memory()
+    Mesh(const Mesh& geometry, vector<Texture>&& textures)
+        : textures(std::move(textures)), VAO(geometry.VAO), range(geometry.range), boundsMin(geometry.boundsMin), boundsMax(geometry.boundsMax),
+          bounds(geometry.bounds), lods(geometry.lods), lodDistances(geometry.lodDistances), sharedGeometry(true)
+    {
+    }
+
+    // a mesh is moved around, never copied: copies would duplicate the geometry for nothing
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    // frees the CPU copies of the geometry; the GPU copy in the GeometryPool stays
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    bool HasCpuData() const { return !vertices.empty(); }
+
+    // geometry held by this mesh; textures are counted by the TextureManager, as they are shared
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        usage.cpuBytes = sizeof(Mesh) + vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int)
+                       + textures.capacity() * sizeof(Texture);
+        usage.cpuBytes += lods.capacity() * sizeof(MeshRange) + lodDistances.capacity() * sizeof(float);
+        if (sharedGeometry)
+            return usage;
+        usage.gpuBytes = range.vertexCount * sizeof(Vertex) + range.indexCount * sizeof(unsigned int);
+        for (const MeshRange& lod : lods)
+            usage.gpuBytes += lod.vertexCount * sizeof(Vertex) + lod.indexCount * sizeof(unsigned int);
+        return usage;
+    }
+
+    // the range to draw at 'distance' bounding radii from the camera
+    const MeshRange& LodRange(float distance) const
+    {
+        const MeshRange* chosen = &range;
+        for (size_t i = 0; i < lods.size() && distance >= lodDistances[i]; i++)
+            chosen = &lods[i];
+        return *chosen;
     }
 
     // render the mesh
@@ -66,7 +123,6 @@ public:
         unsigned int heightNr = 1;
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -81,66 +137,34 @@ public:
 
             // now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            // and finally bind the texture to unit i
+            GLState::Get().BindTexture(i, GL_TEXTURE_2D, textures[i].id);
         }
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        GeometryPool::Get().DrawSingle(range);
     }
 
 private:
-    // render data 
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // copies the mesh into the shared vertex/index buffers
+    void setupMesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        range = GeometryPool::Get().Allocate(vertices, vertexCount, indices, indexCount);
+        if (vertexCount > 0)
+        {
+            boundsMin = boundsMax = vertices[0].Position;
+            for (size_t i = 1; i < vertexCount; i++)
+            {
+                boundsMin = glm::min(boundsMin, vertices[i].Position);
+                boundsMax = glm::max(boundsMax, vertices[i].Position);
+            }
+            glm::vec3 centre = (boundsMin + boundsMax) * 0.5f;
+            float radius = 0.0f;
+            for (size_t i = 0; i < vertexCount; i++)
+                radius = glm::max(radius, glm::length(vertices[i].Position - centre));
+            bounds = glm::vec4(centre, radius);
+        }
+        VAO = GeometryPool::Get().VAO;
     }
 };
 #endif
@@ -10,14 +10,20 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <import_arena.h>
 #include <mesh.h>
-#include <shader_s.h>
+#include <shader_m.h>
+#include <sphere_mesh.h>
+#include <texture_atlas.h>
+#include <texture_manager.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -27,17 +33,50 @@ class Model
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// textures this model holds a reference on; the TextureManager makes sure they aren't loaded more than once.
     vector<Mesh>    meshes;
+    string path;
     string directory;
     bool gammaCorrection;
+    bool keepCpuData; // meshes keep their vertices and indices in system memory after upload
+    bool atlased = false; // every mesh samples its diffuse map from a TextureAtlas
+    // surface for the PBR scene shaders (VARIANT_PBR), the same for every mesh: metal/roughness in [0, 1];
+    // an emissive model (the sun) is drawn unlit, as its diffuse map
+    float metallic = 0.0f;
+    float roughness = 0.9f;
+    bool emissive = false;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. Pass keepCpuData when the geometry is needed on
+    // the CPU later (picking, physics); otherwise it only lives in the GeometryPool.
+    Model(string const& path, bool gamma = false, bool keepCpuData = false) : path(path), gammaCorrection(gamma), keepCpuData(keepCpuData)
     {
         loadModel(path);
     }
 
+    // constructor for a body drawn with a sphere from the SphereLibrary: nothing is imported, only the
+    // diffuse map at 'diffusePath' is loaded. Such a model has no 'path', so it can't be reloaded.
+    Model(SphereKind kind, string const& diffusePath, bool gamma = false) : gammaCorrection(gamma), keepCpuData(false)
+    {
+        directory = diffusePath.substr(0, diffusePath.find_last_of('/'));
+        Texture texture;
+        texture.path = diffusePath.substr(diffusePath.find_last_of('/') + 1);
+        texture.id = TextureFromFile(texture.path.c_str(), directory, gamma);
+        texture.type = "texture_diffuse";
+        loaded_by_path[texture.path] = textures_loaded.size();
+        textures_loaded.push_back(texture);
+        meshes.push_back(Mesh(SphereLibrary::Get().Sphere(kind), vector<Texture>{ texture }));
+    }
+
+    // the textures are shared through the TextureManager, so a model only drops its references
+    ~Model()
+    {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            TextureManager::Get().Release(textures_loaded[i].id);
+    }
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
     // draws the model, and thus all its meshes
     void Draw(Shader& shader)
     {
@@ -45,28 +84,194 @@ public:
             meshes[i].Draw(shader);
     }
 
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const& path)
+    // moves the diffuse map of every mesh that has one in 'atlas' over to the atlas and drops the
+    // standalone texture. Returns true if every mesh is atlased, i.e. the model can be drawn with the atlas shader.
+    bool UseAtlas(const TextureAtlas& atlas)
+    {
+        this->atlas = &atlas;
+        bool all = true;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Mesh& mesh = meshes[i];
+            auto diffuse = std::find_if(mesh.textures.begin(), mesh.textures.end(), [](const Texture& t) { return t.type == "texture_diffuse"; });
+            AtlasRegion region;
+            if (diffuse == mesh.textures.end() || !atlas.Find(directory + '/' + diffuse->path, region))
+            {
+                all = false;
+                continue;
+            }
+            mesh.atlasLayer = region.layer;
+            mesh.atlasRect = region.rect;
+            mesh.textures.erase(diffuse);
+        }
+        releaseUnused();
+        atlased = all && !meshes.empty();
+        return atlased;
+    }
+
+    // the material as the scene shaders read it from InstanceData.params.zw: x metallic, or -1 when
+    // emissive; y roughness
+    glm::vec2 Material() const
+    {
+        return glm::vec2(emissive ? -1.0f : metallic, roughness);
+    }
+
+    // radius of the planet itself in model space, for a body that is a sphere: half the size of its
+    // largest mesh with a roughly cubic box, so flat meshes like Saturn's rings don't count. 0 when
+    // no mesh is that round.
+    float BodyRadius() const
+    {
+        float radius = 0.0f;
+        for (const Mesh& mesh : meshes)
+        {
+            glm::vec3 size = mesh.boundsMax - mesh.boundsMin;
+            float largest = glm::max(size.x, glm::max(size.y, size.z)), smallest = glm::min(size.x, glm::min(size.y, size.z));
+            if (largest > 0.0f && smallest > 0.8f * largest)
+                radius = glm::max(radius, largest * 0.5f);
+        }
+        return radius;
+    }
+
+    // bounding sphere of all meshes (xyz centre, w radius) in model space
+    glm::vec4 Bounds() const
+    {
+        if (meshes.empty())
+            return glm::vec4(0.0f);
+        glm::vec3 low = meshes[0].boundsMin, high = meshes[0].boundsMax;
+        for (unsigned int i = 1; i < meshes.size(); i++)
+        {
+            low = glm::min(low, meshes[i].boundsMin);
+            high = glm::max(high, meshes[i].boundsMax);
+        }
+        glm::vec3 centre = (low + high) * 0.5f;
+        float radius = 0.0f;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            radius = glm::max(radius, glm::length(glm::vec3(meshes[i].bounds) - centre) + meshes[i].bounds.w);
+        return glm::vec4(centre, radius);
+    }
+
+    // geometry of all meshes plus the textures this model references. Textures shared with other
+    // models are counted in full for each of them; TextureManager::Memory() has the deduplicated total.
+    MemoryUsage Memory(bool includeTextures = true) const
+    {
+        MemoryUsage usage;
+        usage.cpuBytes = sizeof(Model) + textures_loaded.capacity() * sizeof(Texture);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            usage += meshes[i].Memory();
+        if (includeTextures)
+            for (unsigned int i = 0; i < textures_loaded.size(); i++)
+                usage += TextureManager::Get().Memory(textures_loaded[i].id);
+        return usage;
+    }
+
+    // the diffuse map file of every mesh, relative to the working directory (input for TextureAtlas::Build)
+    vector<string> DiffuseFiles() const
+    {
+        vector<string> files;
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            if (textures_loaded[i].type == "texture_diffuse")
+                files.push_back(directory + '/' + textures_loaded[i].path);
+        return files;
+    }
+
+    // reads a model file with the import flags every Model uses. Touches no GL state, so it can run
+    // on a worker thread; the scene lives as long as 'importer'. Returns null (and says why) on failure.
+    static const aiScene* Import(Assimp::Importer& importer, string const& path)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return nullptr;
+        }
+        return scene;
+    }
+
+    // hot reload: moves the meshes that use 'file' (a canonical path) from texture 'from' to 'to',
+    // after TextureManager::Replace split the edited file off a texture it shared with others
+    void RetargetTexture(const string& file, unsigned int from, unsigned int to)
+    {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+        {
+            Texture& texture = textures_loaded[i];
+            if (texture.id != from || TextureManager::CanonicalPath(directory + '/' + texture.path) != file)
+                continue;
+            for (unsigned int j = 0; j < meshes.size(); j++)
+                for (unsigned int k = 0; k < meshes[j].textures.size(); k++)
+                    if (meshes[j].textures[k].id == from && meshes[j].textures[k].path == texture.path)
+                        meshes[j].textures[k].id = to;
+            TextureManager::Get().AddRef(to);
+            TextureManager::Get().Release(from);
+            texture.id = to;
+        }
+    }
+
+    // hot reload: replaces the meshes with the ones in 'scene' (from Import). The new textures are
+    // acquired before the old ones are released, so maps that did not change are not loaded again,
+    // and an atlased model is moved back onto its atlas. The old meshes' ranges in the GeometryPool
+    // are not reclaimed, as the pool only ever grows.
+    void Reload(const aiScene* scene)
+    {
+        vector<Texture> old;
+        old.swap(textures_loaded);
+        loaded_by_path.clear();
+        meshes.clear();
+        meshes.reserve(scene->mNumMeshes);
+        ImportArena arena;
+        processNode(scene->mRootNode, scene, arena);
+        for (unsigned int i = 0; i < old.size(); i++)
+            TextureManager::Get().Release(old[i].id);
+        if (atlas)
+            UseAtlas(*atlas);
+    }
+
+private:
+    unordered_map<string, size_t> loaded_by_path; // path in the material -> index into textures_loaded
+    const TextureAtlas* atlas = nullptr; // set by UseAtlas, re-applied by Reload
+
+    // releases the references on textures that no mesh uses any more
+    void releaseUnused()
+    {
+        vector<Texture> kept;
+        loaded_by_path.clear();
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+        {
+            bool used = false;
+            for (unsigned int j = 0; j < meshes.size() && !used; j++)
+                for (unsigned int k = 0; k < meshes[j].textures.size() && !used; k++)
+                    used = meshes[j].textures[k].id == textures_loaded[i].id;
+            if (!used)
+            {
+                TextureManager::Get().Release(textures_loaded[i].id);
+                continue;
+            }
+            loaded_by_path[textures_loaded[i].path] = kept.size();
+            kept.push_back(textures_loaded[i]);
         }
+        textures_loaded.swap(kept);
+    }
+
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    void loadModel(string const& path)
+    {
+        // read file via ASSIMP
+        Assimp::Importer importer;
+        const aiScene* scene = Import(importer, path);
+        if (!scene)
+            return;
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // process ASSIMP's root node recursively; the vertices and indices are staged in one arena
+        // that every mesh reuses and that is freed as a whole once the last mesh is uploaded
+        meshes.reserve(scene->mNumMeshes);
+        ImportArena arena;
+        processNode(scene->mRootNode, scene, arena);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    void processNode(aiNode* node, const aiScene* scene, ImportArena& arena)
     {
         // process each mesh located at the current node
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -74,27 +279,31 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            meshes.push_back(processMesh(mesh, scene, arena));
+            arena.Reset(); // the mesh is in the GeometryPool now, so its staging memory is free again
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, arena);
         }
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    Mesh processMesh(aiMesh* mesh, const aiScene* scene, ImportArena& arena)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
+        // data to fill, sized exactly up front
+        unsigned int indexCount = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+        Vertex* vertices = arena.Allocate<Vertex>(mesh->mNumVertices);
+        unsigned int* indices = arena.Allocate<unsigned int>(indexCount);
         vector<Texture> textures;
 
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex& vertex = vertices[i];
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -131,16 +340,15 @@ private:
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        unsigned int* index = indices;
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
+            const aiFace& face = mesh->mFaces[i]; // a copy would allocate its own index array
+            // retrieve all indices of the face and store them in the indices array
             for (unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+                *index++ = face.mIndices[j];
         }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -151,95 +359,53 @@ private:
         // specular: texture_specularN
         // normal: texture_normalN
 
+        textures.reserve(material->GetTextureCount(aiTextureType_DIFFUSE) + material->GetTextureCount(aiTextureType_SPECULAR)
+                       + material->GetTextureCount(aiTextureType_HEIGHT) + material->GetTextureCount(aiTextureType_AMBIENT));
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return a mesh object created from the extracted mesh data; it uploads straight from the arena
+        return Mesh(vertices, mesh->mNumVertices, indices, indexCount, std::move(textures), keepCpuData);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // the required info is appended to 'textures' as Texture structs.
+    void loadMaterialTextures(aiMaterial* mat, aiTextureType type, const char* typeName, vector<Texture>& textures)
     {
-        vector<Texture> textures;
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
+            // check if this model already uses the texture; the TextureManager dedupes across models
+            auto loaded = loaded_by_path.find(str.C_Str());
+            if (loaded != loaded_by_path.end())
             {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                Texture texture = textures_loaded[loaded->second];
                 texture.type = typeName;
-                texture.path = str.C_Str();
                 textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                continue;
             }
+            Texture texture;
+            texture.id = TextureFromFile(str.C_Str(), this->directory);
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+            loaded_by_path[texture.path] = textures_loaded.size();
+            textures_loaded.push_back(texture);  // remember the reference so the destructor can release it
         }
-        return textures;
     }
 };
 
 
+// loads a texture through the shared TextureManager and takes a reference on it
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureManager::Get().Acquire(path, directory, gamma);
 }
 #endif
@@ -0,0 +1,341 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm.hpp>
+#include <gtc/constants.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define OCCLUSION_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_LANES 4
+#else
+#define OCCLUSION_LANES 1
+#endif
+
+// Software occlusion culling against a few big spheres (the sun and the gas giants).
+// Every frame the occluders are drawn as low-poly spheres into a small CPU depth buffer, split into
+// horizontal bands that worker threads fill in parallel, 4 (SSE2) or 8 (AVX) pixels at a time. A
+// max-depth (hierarchical Z) pyramid is built on top, and an occludee's bounding sphere is then
+// tested against the one pyramid level where its screen rectangle covers at most 3x3 texels.
+// The test errs towards "visible": the occluder polyhedra sit inside their spheres, which pulls their
+// silhouettes in, and an occludee is compared by the nearest depth of its bounding box over every
+// texel the box touches. Pixels are covered when their centre is, as in GL, so triangles sharing an
+// edge leave no cracks. Depth is window-space z in [0, 1], like the GL depth buffer.
+class OcclusionCuller
+{
+public:
+    struct Stats {
+        unsigned int occluders = 0;
+        unsigned int triangles = 0; // front-facing occluder triangles drawn
+        unsigned int tested = 0;
+        unsigned int culled = 0;
+        double rasterMs = 0.0, pyramidMs = 0.0;
+    };
+
+    // 'threads' 0 uses one band per hardware thread
+    OcclusionCuller(int width = 256, int height = 128, unsigned int threads = 0)
+        : width((width + OCCLUSION_LANES - 1) / OCCLUSION_LANES * OCCLUSION_LANES), height(height)
+    {
+        bandCount = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        bandCount = std::min<unsigned int>(bandCount, static_cast<unsigned int>(height));
+        int w = this->width, h = height;
+        levels.push_back(Level{ w, h, std::vector<float>(static_cast<size_t>(w) * h, 1.0f) });
+        while (w > 1 || h > 1)
+        {
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+            levels.push_back(Level{ w, h, std::vector<float>(static_cast<size_t>(w) * h, 1.0f) });
+        }
+        buildSphere();
+    }
+
+    // starts a frame: forgets last frame's occluders
+    void Begin(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        occluders.clear();
+        stats = Stats();
+    }
+
+    void AddOccluder(const glm::vec3& centre, float radius)
+    {
+        occluders.push_back(glm::vec4(centre, radius));
+    }
+
+    // draws the occluders and builds the pyramid; IsVisible() can be called afterwards
+    void Rasterize()
+    {
+        auto start = std::chrono::steady_clock::now();
+        setupTriangles();
+        std::fill(levels[0].depth.begin(), levels[0].depth.end(), 1.0f);
+        int bands = static_cast<int>(bandCount), rows = (height + bands - 1) / bands;
+        std::vector<std::future<void>> workers;
+        for (int band = 1; band < bands; band++)
+            workers.push_back(std::async(std::launch::async, &OcclusionCuller::rasterizeBand, this, band * rows, std::min(height, (band + 1) * rows)));
+        rasterizeBand(0, std::min(height, rows));
+        for (auto& worker : workers)
+            worker.get();
+        auto rastered = std::chrono::steady_clock::now();
+        buildPyramid();
+        stats.rasterMs = std::chrono::duration<double, std::milli>(rastered - start).count();
+        stats.pyramidMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rastered).count();
+        stats.occluders = static_cast<unsigned int>(occluders.size());
+        stats.triangles = static_cast<unsigned int>(triangles.size());
+    }
+
+    // false only if the sphere is certainly hidden behind the occluders (or entirely off screen)
+    bool IsVisible(const glm::vec3& centre, float radius)
+    {
+        stats.tested++;
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, minZ = 1.0f;
+        // the box corners in clip space are the centre plus or minus the matrix's scaled axis columns
+        glm::vec4 middle = viewProjection * glm::vec4(centre, 1.0f);
+        glm::vec4 axis[3] = { viewProjection[0] * radius, viewProjection[1] * radius, viewProjection[2] * radius };
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 clip = middle + ((corner & 1) ? axis[0] : -axis[0]) + ((corner & 2) ? axis[1] : -axis[1]) + ((corner & 4) ? axis[2] : -axis[2]);
+            if (clip.z < -clip.w || clip.w <= 0.0f)
+                return true; // reaches through the near plane
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            minX = std::min(minX, ndc.x);
+            maxX = std::max(maxX, ndc.x);
+            minY = std::min(minY, ndc.y);
+            maxY = std::max(maxY, ndc.y);
+            minZ = std::min(minZ, ndc.z * 0.5f + 0.5f);
+        }
+        if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f || minZ > 1.0f)
+        {
+            stats.culled++;
+            return false;
+        }
+        // screen rectangle in level 0 pixels, one pixel wider all round: an occluder pixel is covered
+        // when its centre is, so the silhouette can claim up to half a pixel too much
+        int x0 = std::max(0, static_cast<int>(std::floor((minX * 0.5f + 0.5f) * width)) - 1);
+        int x1 = std::min(width - 1, static_cast<int>((maxX * 0.5f + 0.5f) * width) + 1);
+        int y0 = std::max(0, static_cast<int>(std::floor((minY * 0.5f + 0.5f) * height)) - 1);
+        int y1 = std::min(height - 1, static_cast<int>((maxY * 0.5f + 0.5f) * height) + 1);
+        // coarsest detail where the rectangle spans at most 3 texels each way
+        size_t level = 0;
+        while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 2 || (y1 >> level) - (y0 >> level) > 2))
+            level++;
+        const Level& hiz = levels[level];
+        for (int y = y0 >> level; y <= (y1 >> level); y++)
+            for (int x = x0 >> level; x <= (x1 >> level); x++)
+                if (minZ <= hiz.depth[static_cast<size_t>(y) * hiz.width + x])
+                    return true;
+        stats.culled++;
+        return false;
+    }
+
+    // the depth buffer as 8-bit grey (near is bright, empty is black), bottom row first like GL
+    void DebugImage(std::vector<unsigned char>& pixels) const
+    {
+        const Level& base = levels[0];
+        pixels.resize(base.depth.size());
+        for (size_t i = 0; i < base.depth.size(); i++)
+        {
+            // window depth crowds towards 1, so spread the near end out
+            float linear = 1.0f - std::pow(base.depth[i], 64.0f);
+            pixels[i] = static_cast<unsigned char>(std::clamp(linear, 0.0f, 1.0f) * 255.0f);
+        }
+    }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    unsigned int Threads() const { return bandCount; }
+    const Stats& GetStats() const { return stats; }
+
+    static const char* SimdName()
+    {
+        return OCCLUSION_LANES == 8 ? "AVX" : OCCLUSION_LANES == 4 ? "SSE2" : "scalar";
+    }
+
+private:
+    struct Level {
+        int width, height;
+        std::vector<float> depth; // level 0: nearest occluder depth, above: farthest of the 2x2 below
+    };
+    // a screen-space triangle ready to scan: edge functions E(x, y) = a x + b y + c, >= 0 inside, and depth as a plane
+    struct Triangle {
+        float a[3], b[3], c[3];
+        float zx, zy, z0;
+        int minX, maxX, minY, maxY;
+    };
+
+    int width, height;
+    unsigned int bandCount;
+    std::vector<Level> levels;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec4> occluders;
+    std::vector<Triangle> triangles;
+    std::vector<glm::vec3> sphereVertices;
+    std::vector<unsigned int> sphereIndices;
+    Stats stats;
+
+    // unit UV sphere, vertices on the sphere so every face lies inside it; counter-clockwise from outside
+    void buildSphere()
+    {
+        const int stacks = 8, slices = 12;
+        for (int stack = 0; stack <= stacks; stack++)
+        {
+            float phi = glm::pi<float>() * stack / stacks;
+            for (int slice = 0; slice < slices; slice++)
+            {
+                float theta = 2.0f * glm::pi<float>() * slice / slices;
+                sphereVertices.push_back(glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)));
+            }
+        }
+        for (int stack = 0; stack < stacks; stack++)
+        {
+            for (int slice = 0; slice < slices; slice++)
+            {
+                unsigned int a = stack * slices + slice, b = stack * slices + (slice + 1) % slices;
+                unsigned int c = a + slices, d = b + slices;
+                if (stack > 0)
+                    sphereIndices.insert(sphereIndices.end(), { a, b, c });
+                if (stack < stacks - 1)
+                    sphereIndices.insert(sphereIndices.end(), { b, d, c });
+            }
+        }
+    }
+
+    void setupTriangles()
+    {
+        triangles.clear();
+        std::vector<glm::vec4> clip(sphereVertices.size());
+        for (const glm::vec4& occluder : occluders)
+        {
+            for (size_t i = 0; i < sphereVertices.size(); i++)
+                clip[i] = viewProjection * glm::vec4(glm::vec3(occluder) + sphereVertices[i] * occluder.w, 1.0f);
+            for (size_t i = 0; i < sphereIndices.size(); i += 3)
+                setupTriangle(clip[sphereIndices[i]], clip[sphereIndices[i + 1]], clip[sphereIndices[i + 2]]);
+        }
+    }
+
+    void setupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2)
+    {
+        // a triangle crossing the near plane is simply left out; dropping occluders is always safe
+        for (const glm::vec4* c : { &c0, &c1, &c2 })
+            if (c->z < -c->w || c->w <= 0.0f)
+                return;
+        glm::vec3 p[3];
+        const glm::vec4* c[3] = { &c0, &c1, &c2 };
+        for (int i = 0; i < 3; i++)
+            p[i] = glm::vec3(((c[i]->x / c[i]->w) * 0.5f + 0.5f) * width, ((c[i]->y / c[i]->w) * 0.5f + 0.5f) * height, (c[i]->z / c[i]->w) * 0.5f + 0.5f);
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (area <= 0.0f)
+            return; // back face, or degenerate
+        Triangle t;
+        t.minX = std::max(0, static_cast<int>(std::floor(std::min({ p[0].x, p[1].x, p[2].x }))));
+        t.maxX = std::min(width - 1, static_cast<int>(std::ceil(std::max({ p[0].x, p[1].x, p[2].x }))));
+        t.minY = std::max(0, static_cast<int>(std::floor(std::min({ p[0].y, p[1].y, p[2].y }))));
+        t.maxY = std::min(height - 1, static_cast<int>(std::ceil(std::max({ p[0].y, p[1].y, p[2].y }))));
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return;
+        t.minX -= t.minX % OCCLUSION_LANES; // whole SIMD groups
+        for (int i = 0; i < 3; i++)
+        {
+            const glm::vec3& from = p[i];
+            const glm::vec3& to = p[(i + 1) % 3];
+            // E(x, y) = (to - from) x ((x, y) - from), positive inside a counter-clockwise triangle
+            t.a[i] = -(to.y - from.y);
+            t.b[i] = to.x - from.x;
+            t.c[i] = -(t.a[i] * from.x + t.b[i] * from.y);
+        }
+        t.zx = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) / area;
+        t.zy = ((p[2].z - p[0].z) * (p[1].x - p[0].x) - (p[1].z - p[0].z) * (p[2].x - p[0].x)) / area;
+        t.z0 = p[0].z - t.zx * p[0].x - t.zy * p[0].y;
+        triangles.push_back(t);
+    }
+
+    // scans every triangle over rows [y0, y1); bands never share rows, so no locking
+    void rasterizeBand(int y0, int y1)
+    {
+        float* depth = levels[0].depth.data();
+        for (const Triangle& t : triangles)
+        {
+            int rowStart = std::max(y0, t.minY), rowEnd = std::min(y1 - 1, t.maxY);
+            for (int y = rowStart; y <= rowEnd; y++)
+            {
+                float py = y + 0.5f;
+                float* row = depth + static_cast<size_t>(y) * width;
+#if OCCLUSION_LANES == 8
+                const __m256 steps = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+                for (int x = t.minX; x <= t.maxX; x += 8)
+                {
+                    __m256 px = _mm256_add_ps(_mm256_set1_ps(float(x)), steps);
+                    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                    for (int e = 0; e < 3; e++)
+                    {
+                        __m256 edge = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.a[e]), px), _mm256_set1_ps(t.b[e] * py + t.c[e]));
+                        inside = _mm256_and_ps(inside, _mm256_cmp_ps(edge, _mm256_setzero_ps(), _CMP_GE_OQ));
+                    }
+                    if (_mm256_movemask_ps(inside) == 0)
+                        continue;
+                    __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.zx), px), _mm256_set1_ps(t.zy * py + t.z0));
+                    __m256 old = _mm256_loadu_ps(row + x);
+                    _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+                }
+#elif OCCLUSION_LANES == 4
+                const __m128 steps = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                for (int x = t.minX; x <= t.maxX; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), steps);
+                    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (int e = 0; e < 3; e++)
+                    {
+                        __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[e]), px), _mm_set1_ps(t.b[e] * py + t.c[e]));
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, _mm_setzero_ps()));
+                    }
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.zx), px), _mm_set1_ps(t.zy * py + t.z0));
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+#else
+                for (int x = t.minX; x <= t.maxX; x++)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++)
+                        inside = inside && t.a[e] * px + t.b[e] * py + t.c[e] >= 0.0f;
+                    if (inside)
+                        row[x] = std::min(row[x], t.zx * px + t.zy * py + t.z0);
+                }
+#endif
+            }
+        }
+    }
+
+    void buildPyramid()
+    {
+        for (size_t level = 1; level < levels.size(); level++)
+        {
+            const Level& below = levels[level - 1];
+            Level& above = levels[level];
+            for (int y = 0; y < above.height; y++)
+            {
+                int y0 = std::min(2 * y, below.height - 1), y1 = std::min(2 * y + 1, below.height - 1);
+                for (int x = 0; x < above.width; x++)
+                {
+                    int x0 = std::min(2 * x, below.width - 1), x1 = std::min(2 * x + 1, below.width - 1);
+                    above.depth[static_cast<size_t>(y) * above.width + x] = std::max(
+                        std::max(below.depth[static_cast<size_t>(y0) * below.width + x0], below.depth[static_cast<size_t>(y0) * below.width + x1]),
+                        std::max(below.depth[static_cast<size_t>(y1) * below.width + x0], below.depth[static_cast<size_t>(y1) * below.width + x1]));
+                }
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,275 @@
+#ifndef PERF_OVERLAY_H
+#define PERF_OVERLAY_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+
+#include <text_renderer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// In-app performance overlay: a frame time graph, the CPU time of each phase of the frame, GPU time
+// of each pass, and whatever counter lines the application adds.
+// Everything is read on the render thread from the renderer's own stats, so nothing is locked or
+// copied between threads. GPU passes are timed with GL_TIME_ELAPSED queries that are read back
+// QUERY_LATENCY frames later, and only if the result is already there, so the overlay never waits
+// on the GPU. The panel is queued into a TextRenderer as text and rectangles and goes out in the
+// same single draw as the HUD. Building it is timed and shown on its own line, so the overlay's
+// cost is never hidden inside the numbers it shows. While hidden it keeps the history (a few
+// clock reads per frame) and issues no queries.
+class PerfOverlay
+{
+public:
+    static const int HISTORY = 240;       // frames in the graph, a pixel each
+    static const int MAX_PHASES = 8;
+    static const int MAX_PASSES = 8;
+    static const int QUERY_LATENCY = 4;   // frames between a timer query and reading it back
+
+    bool Visible = false;
+
+    PerfOverlay()
+    {
+        lastFrame = mark = Clock::now();
+        lines.reserve(2048);
+    }
+
+    ~PerfOverlay()
+    {
+        // the queries are freed in Delete(), while the context still exists
+    }
+
+    PerfOverlay(const PerfOverlay&) = delete;
+    PerfOverlay& operator=(const PerfOverlay&) = delete;
+
+    // starts a frame: what passed since the previous call is that frame's time
+    void BeginFrame()
+    {
+        Clock::time_point now = Clock::now();
+        float frameMs = elapsed(lastFrame, now);
+        lastFrame = mark = now;
+        history[frame % HISTORY] = frameMs;
+        smoothedFrameMs = smooth(smoothedFrameMs, frameMs);
+        frame++;
+        if (Visible)
+            collectQueries();
+    }
+
+    // ends the CPU phase running since BeginFrame() or the previous Phase(), charging it to 'name'
+    // (a string literal, stored as the pointer)
+    void Phase(const char* name)
+    {
+        Clock::time_point now = Clock::now();
+        int index = slot(phases, phaseCount, MAX_PHASES, name);
+        if (index >= 0)
+            phases[index].ms = smooth(phases[index].ms, elapsed(mark, now));
+        mark = now;
+    }
+
+    // times the GL commands between BeginPass() and EndPass() on the GPU; passes can't nest
+    void BeginPass(const char* name)
+    {
+        if (!Visible)
+            return;
+        int index = slot(passes, passCount, MAX_PASSES, name);
+        if (index < 0)
+            return;
+        GLuint& query = queries[frame % QUERY_LATENCY][index];
+        if (!query)
+            glGenQueries(1, &query);
+        else if (issued[frame % QUERY_LATENCY][index])
+            return; // last use not read back yet (collectQueries found it unfinished); skip this frame
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        issued[frame % QUERY_LATENCY][index] = true;
+        openPass = true;
+    }
+
+    void EndPass()
+    {
+        if (!openPass)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        openPass = false;
+    }
+
+    // adds a line of counters under the timings, printf style; call between BeginFrame() and Draw().
+    // The overlay's own time starts at the first line.
+    void Counter(const char* format, ...)
+    {
+        if (!Visible)
+            return;
+        if (lines.empty())
+            countersStart = Clock::now();
+        char line[160];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        lines += line;
+        lines += '\n';
+    }
+
+    // queues the panel at 'origin' (pixels, top left) into 'text'; the caller draws 'text' as usual
+    void Draw(TextRenderer& text, glm::vec2 origin)
+    {
+        if (!Visible)
+            return;
+        Clock::time_point start = lines.empty() ? Clock::now() : countersStart;
+        const float width = static_cast<float>(HISTORY), graphHeight = 90.0f, msToPixels = graphHeight / 50.0f;
+        const glm::vec4 panel(0.0f, 0.0f, 0.0f, 0.6f), white(1.0f), grey(0.7f, 0.7f, 0.7f, 1.0f);
+        float line = text.LineHeight(0.8f);
+
+        // GPU passes, as of QUERY_LATENCY frames ago
+        char gpu[256] = "gpu";
+        size_t used = 3;
+        for (int i = 0; i < passCount && used < sizeof(gpu); i++)
+            used += snprintf(gpu + used, sizeof(gpu) - used, "  %s %.2f", passes[i].name, passes[i].ms);
+
+        // one dark panel under all of it, queued first so it is drawn first
+        int counterLines = static_cast<int>(std::count(lines.begin(), lines.end(), '\n'));
+        float panelWidth = glm::max(width, glm::max(text.Measure(gpu, 0.8f), text.Measure(lines, 0.8f)));
+        float panelHeight = line + graphHeight + 10.0f + ((phaseCount + 1) / 2 + 2 + counterLines) * line;
+        text.AddRect(origin - 6.0f, origin + glm::vec2(panelWidth, panelHeight) + 6.0f, panel);
+
+        // frame time graph, newest on the right, with the 60 and 30 fps lines
+        float maxMs = 0.0f;
+        glm::vec2 graph = origin + glm::vec2(0.0f, line);
+        for (int i = 0; i < HISTORY; i++)
+        {
+            float ms = history[(frame + i) % HISTORY];
+            maxMs = glm::max(maxMs, ms);
+            glm::vec4 color = ms < 17.0f ? glm::vec4(0.3f, 0.9f, 0.4f, 0.9f) : ms < 34.0f ? glm::vec4(1.0f, 0.8f, 0.2f, 0.9f) : glm::vec4(1.0f, 0.3f, 0.3f, 0.9f);
+            float height = glm::min(ms * msToPixels, graphHeight);
+            text.AddRect(graph + glm::vec2(i, graphHeight - height), graph + glm::vec2(i + 1.0f, graphHeight), color);
+        }
+        for (float target : { 1000.0f / 60.0f, 1000.0f / 30.0f })
+            text.AddRect(graph + glm::vec2(0.0f, graphHeight - target * msToPixels), graph + glm::vec2(width, graphHeight - target * msToPixels + 1.0f), grey);
+        char title[96];
+        snprintf(title, sizeof(title), "frame %.2f ms (%.0f fps), max %.1f", smoothedFrameMs, 1000.0f / glm::max(smoothedFrameMs, 0.001f), maxMs);
+        text.Add(title, origin, white, 0.8f);
+
+        // CPU phases as one bar the length of the frame, with a legend
+        glm::vec2 cursor = graph + glm::vec2(0.0f, graphHeight + 4.0f);
+        float x = cursor.x;
+        for (int i = 0; i < phaseCount; i++)
+        {
+            // the phases are averaged on their own, so their sum can run a little past the frame
+            float segment = glm::min(phases[i].ms / glm::max(smoothedFrameMs, 0.001f) * width, cursor.x + width - x);
+            text.AddRect(glm::vec2(x, cursor.y), glm::vec2(x + segment, cursor.y + 6.0f), phaseColor(i));
+            x += segment;
+        }
+        cursor.y += 10.0f;
+        char entry[64];
+        for (int i = 0; i < phaseCount; i++)
+        {
+            glm::vec2 at = cursor + glm::vec2((i % 2) * width * 0.5f, (i / 2) * line);
+            text.AddRect(at + glm::vec2(0.0f, line * 0.3f), at + glm::vec2(8.0f, line * 0.3f + 8.0f), phaseColor(i));
+            snprintf(entry, sizeof(entry), "%s %.2f", phases[i].name, phases[i].ms);
+            text.Add(entry, at + glm::vec2(12.0f, 0.0f), white, 0.8f);
+        }
+        cursor.y += ((phaseCount + 1) / 2) * line;
+
+        text.Add(gpu, cursor, white, 0.8f);
+        cursor.y += line;
+
+        snprintf(entry, sizeof(entry), "overlay %.3f ms cpu", overlayMs);
+        text.Add(entry, cursor, grey, 0.8f);
+        cursor.y += line;
+        text.Add(lines, cursor, white, 0.8f);
+        lines.clear();
+
+        overlayMs = smooth(overlayMs, elapsed(start, Clock::now()));
+    }
+
+    // CPU time of the counter lines and Draw(), smoothed
+    float OverlayMs() const { return overlayMs; }
+
+    // frees the timer queries; call while the context is still current
+    void Delete()
+    {
+        for (auto& frameQueries : queries)
+            for (GLuint& query : frameQueries)
+                if (query)
+                {
+                    glDeleteQueries(1, &query);
+                    query = 0;
+                }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timing {
+        const char* name = nullptr;
+        float ms = 0.0f;
+    };
+
+    float history[HISTORY] = {};
+    unsigned long long frame = 0;
+    Clock::time_point lastFrame, mark, countersStart;
+    float smoothedFrameMs = 0.0f, overlayMs = 0.0f;
+    Timing phases[MAX_PHASES], passes[MAX_PASSES];
+    int phaseCount = 0, passCount = 0;
+    GLuint queries[QUERY_LATENCY][MAX_PASSES] = {};
+    bool issued[QUERY_LATENCY][MAX_PASSES] = {};
+    bool openPass = false;
+    std::string lines;
+
+    static glm::vec4 phaseColor(int phase)
+    {
+        static const glm::vec4 palette[8] = {
+            glm::vec4(0.36f, 0.62f, 1.0f, 1.0f), glm::vec4(0.3f, 0.9f, 0.4f, 1.0f), glm::vec4(1.0f, 0.8f, 0.2f, 1.0f), glm::vec4(1.0f, 0.45f, 0.3f, 1.0f),
+            glm::vec4(0.8f, 0.45f, 1.0f, 1.0f), glm::vec4(0.3f, 0.9f, 0.9f, 1.0f), glm::vec4(1.0f, 0.5f, 0.75f, 1.0f), glm::vec4(0.75f, 0.75f, 0.75f, 1.0f)
+        };
+        return palette[phase % 8];
+    }
+
+    static float elapsed(Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<float, std::milli>(to - from).count();
+    }
+
+    // moving average over roughly the last 20 frames, so the digits can be read
+    static float smooth(float average, float value)
+    {
+        return average > 0.0f ? average + (value - average) * 0.05f : value;
+    }
+
+    // index of 'name' in 'timings', added at the end the first time it is seen; -1 when full
+    static int slot(Timing* timings, int& count, int capacity, const char* name)
+    {
+        for (int i = 0; i < count; i++)
+            if (timings[i].name == name || strcmp(timings[i].name, name) == 0)
+                return i;
+        if (count == capacity)
+            return -1;
+        timings[count].name = name;
+        return count++;
+    }
+
+    // reads the queries issued QUERY_LATENCY frames ago, in the slot this frame reuses; results not
+    // there yet stay issued and that pass goes untimed this frame instead of stalling
+    void collectQueries()
+    {
+        int ring = static_cast<int>(frame % QUERY_LATENCY);
+        for (int i = 0; i < passCount; i++)
+        {
+            if (!issued[ring][i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[ring][i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[ring][i], GL_QUERY_RESULT, &nanoseconds);
+            passes[i].ms = smooth(passes[i].ms, static_cast<float>(nanoseconds * 1e-6));
+            issued[ring][i] = false;
+        }
+    }
+};
+#endif
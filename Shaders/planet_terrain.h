@@ -0,0 +1,485 @@
+#ifndef PLANET_TERRAIN_H
+#define PLANET_TERRAIN_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+
+#include <geometry_pool.h>
+#include <gl_state.h>
+#include <gpu_culling.h>
+#include <memory_usage.h>
+#include <shader_m.h>
+#include <sphere_mesh.h>
+#include <texture_manager.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Close-up surface of a planet as a quadtree on the six faces of a cube-sphere.
+// Every node is a patch of GRID x GRID quads displaced by a height function (procedural noise by
+// default, or e.g. a heightmap lookup). Each frame Update() walks the tree from the six roots and
+// draws a node's four children instead of the node when its geometric error would cover more than
+// PIXEL_ERROR pixels, so detail follows the camera down and merges again when it leaves. Patches
+// outside the frustum or behind the horizon are skipped.
+// Patches are built on worker threads (std::async) and live in a fixed pool of GPU slots, all in one
+// vertex buffer; when the pool is full the least recently drawn patch gives up its slot. Until a
+// node's children are resident the node itself is drawn, so missing detail shows up as coarser
+// terrain and never as holes. Neighbours of different levels would leave cracks, so every patch has
+// a skirt hanging down from its edges. All patches share one index buffer and are drawn with a
+// single glMultiDrawElementsBaseVertex; the number of patches, jobs and uploads per frame is bounded,
+// so the frame cost stays about the same from orbit down to the surface.
+// Positions are in the planet's model space: the unit sphere plus the height.
+class PlanetTerrain
+{
+public:
+    // unit direction -> height in planet radii, within [-amplitude, amplitude]; called on worker threads
+    typedef std::function<float(const glm::vec3&)> HeightFunction;
+
+    static const int GRID = 16;        // quads along a patch edge
+    static const int MAX_LEVEL = 14;   // deepest split
+    static const int MAX_JOBS = 4;     // patches being built at once
+    static const int MAX_UPLOADS = 8;  // patches uploaded per frame
+    static constexpr float PIXEL_ERROR = 2.0f;
+    static constexpr float ROUGHNESS = 0.2f; // how far the surface strays from a grid cell, per unit of cell size
+
+    struct Stats {
+        unsigned int drawn = 0;     // patches drawn this frame
+        unsigned int resident = 0;  // patches in the pool
+        unsigned int built = 0;     // patches built since the start
+        unsigned int evicted = 0;   // patches that lost their slot since the start
+        unsigned int pending = 0;   // patches wanted this frame but not resident yet
+        size_t triangles = 0;       // in the patches drawn this frame
+        double updateMs = 0.0;      // last Update(), uploads included
+    };
+
+    // 'diffusePath' is the planet's equirectangular map, relative to the working directory; 'capacity' is the
+    // number of patch slots, about 31 KB of vertex buffer each
+    PlanetTerrain(const std::string& diffusePath, HeightFunction height = Noise, float amplitude = 0.02f, unsigned int capacity = 1024)
+        : height(height), amplitude(amplitude), capacity(capacity)
+    {
+        size_t slash = diffusePath.find_last_of('/');
+        texture = TextureManager::Get().Acquire(diffusePath.substr(slash + 1), diffusePath.substr(0, slash));
+        for (unsigned int slot = capacity; slot > 0; slot--)
+            freeSlots.push_back(slot - 1);
+    }
+
+    ~PlanetTerrain()
+    {
+        for (auto& job : jobs)
+            job.second.wait();
+    }
+
+    PlanetTerrain(const PlanetTerrain&) = delete;
+    PlanetTerrain& operator=(const PlanetTerrain&) = delete;
+
+    // true once the six root patches are resident, i.e. Draw() covers the whole planet
+    bool Ready() const
+    {
+        for (int face = 0; face < 6; face++)
+            if (!patches.count(makeKey(face, 0, 0, 0)))
+                return false;
+        return true;
+    }
+
+    // picks this frame's patches for the planet drawn with 'model', starts builds for missing ones and
+    // uploads finished ones. 'viewportHeight' in pixels, 'fovY' in radians.
+    void Update(const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float viewportHeight, float fovY)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!VAO)
+            create();
+        this->model = model;
+        frame++;
+        upload();
+
+        // the walk happens in model space, where the planet is the unit sphere
+        frustum = GpuCulling::FrustumPlanes(viewProjection * model);
+        camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+        // the model matrix scales evenly, so model-space distances compare directly with model-space errors
+        pixelsPerRadian = viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+        selected.clear();
+        requests.clear();
+        for (int face = 0; face < 6; face++)
+        {
+            uint64_t root = makeKey(face, 0, 0, 0);
+            if (patches.count(root))
+                select(root);
+            else
+                requests.push_back(root);
+        }
+        stats.pending = static_cast<unsigned int>(requests.size());
+        startJobs();
+        stats.drawn = static_cast<unsigned int>(selected.size());
+        stats.triangles = selected.size() * (indexCount / 3);
+        stats.resident = static_cast<unsigned int>(patches.size());
+        stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // draws the patches Update() picked with 'shader', the non-instanced scene program
+    void Draw(Shader& shader)
+    {
+        if (selected.empty())
+            return;
+        shader.use();
+        shader.setMat4("model", model);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, texture);
+        GLState::Get().BindVertexArray(VAO);
+        counts.assign(selected.size(), static_cast<GLsizei>(indexCount));
+        offsets.assign(selected.size(), nullptr);
+        baseVertices.clear();
+        for (unsigned int slot : selected)
+            baseVertices.push_back(static_cast<GLint>(slot * VERTICES));
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), static_cast<GLsizei>(selected.size()), baseVertices.data());
+    }
+
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        usage.gpuBytes = VAO ? capacity * VERTICES * sizeof(Vertex) + indexCount * sizeof(unsigned int) : 0;
+        usage.cpuBytes = sizeof(PlanetTerrain) + patches.size() * (sizeof(Patch) + sizeof(uint64_t)) + freeSlots.capacity() * sizeof(unsigned int);
+        return usage;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+    // frees the buffers and the map; call while the context is still current
+    void Delete()
+    {
+        for (auto& job : jobs)
+            job.second.wait();
+        jobs.clear();
+        if (VAO)
+        {
+            glDeleteVertexArrays(1, &VAO);
+            GLState::Get().VertexArrayDeleted(VAO);
+            unsigned int buffers[2] = { vertexBuffer, indexBuffer };
+            glDeleteBuffers(2, buffers);
+            for (unsigned int buffer : buffers)
+                GLState::Get().BufferDeleted(buffer);
+            VAO = vertexBuffer = indexBuffer = 0;
+        }
+        if (texture)
+            TextureManager::Get().Release(texture);
+        texture = 0;
+        patches.clear();
+    }
+
+    // default height: a few octaves of value noise, within [-0.02, 0.02] radii
+    static float Noise(const glm::vec3& direction)
+    {
+        float height = 0.0f, scale = 0.01f, frequency = 4.0f;
+        for (int octave = 0; octave < 7; octave++)
+        {
+            height += valueNoise(direction * frequency + float(octave) * 17.0f) * scale;
+            scale *= 0.5f;
+            frequency *= 2.0f;
+        }
+        return height;
+    }
+
+private:
+    static const unsigned int VERTICES = (GRID + 1) * (GRID + 1) + 4 * (GRID + 1); // grid, then the four skirts
+
+    struct Patch {
+        unsigned int slot;
+        unsigned int lastUsed;  // frame it was last drawn or walked through
+        glm::vec3 centre;       // bounding sphere, model space
+        float radius;
+        glm::vec3 direction;    // towards the patch centre from the planet centre
+        float angle;            // angular radius around 'direction'
+    };
+    struct Built {
+        std::vector<Vertex> vertices;
+        glm::vec3 centre, direction;
+        float radius, angle;
+    };
+
+    HeightFunction height;
+    float amplitude;
+    unsigned int capacity;
+    unsigned int VAO = 0, vertexBuffer = 0, indexBuffer = 0, texture = 0;
+    unsigned int indexCount = 0;
+    unsigned int frame = 0;
+    glm::mat4 model = glm::mat4(1.0f);
+    std::vector<glm::vec4> frustum;
+    glm::vec3 camera = glm::vec3(0.0f);
+    float pixelsPerRadian = 1.0f;
+    std::unordered_map<uint64_t, Patch> patches;
+    std::unordered_map<uint64_t, std::future<Built>> jobs;
+    std::vector<unsigned int> freeSlots;
+    std::vector<unsigned int> selected;
+    std::vector<uint64_t> requests;
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+    Stats stats;
+
+    // face in bits 60..62, level in 55..59, x and y (each < 2^level) below
+    static uint64_t makeKey(int face, int level, unsigned int x, unsigned int y)
+    {
+        return (uint64_t(face) << 60) | (uint64_t(level) << 55) | (uint64_t(x) << 24) | uint64_t(y);
+    }
+    static int keyFace(uint64_t key) { return int(key >> 60) & 7; }
+    static int keyLevel(uint64_t key) { return int(key >> 55) & 31; }
+    static unsigned int keyX(uint64_t key) { return unsigned(key >> 24) & 0xFFFFFF; }
+    static unsigned int keyY(uint64_t key) { return unsigned(key) & 0xFFFFFF; }
+
+    // model-space size of one grid step at 'level'
+    static float spacing(int level)
+    {
+        return glm::half_pi<float>() / (float(1 << level) * GRID);
+    }
+
+    void select(uint64_t key)
+    {
+        Patch& patch = patches.at(key);
+        patch.lastUsed = frame;
+        if (!visible(patch))
+            return;
+        int level = keyLevel(key);
+        float distance = std::max(glm::length(camera - patch.centre) - patch.radius, 1e-4f);
+        // the detail a patch misses is taken to be proportional to its grid step
+        if (level < MAX_LEVEL && spacing(level) * ROUGHNESS / distance * pixelsPerRadian > PIXEL_ERROR)
+        {
+            uint64_t children[4];
+            bool ready = true;
+            for (unsigned int child = 0; child < 4; child++)
+            {
+                children[child] = makeKey(keyFace(key), level + 1, keyX(key) * 2 + (child & 1), keyY(key) * 2 + (child >> 1));
+                auto it = patches.find(children[child]);
+                if (it == patches.end())
+                {
+                    requests.push_back(children[child]);
+                    ready = false;
+                }
+                else
+                    it->second.lastUsed = frame; // keep the siblings that are there while the rest are built
+            }
+            if (ready)
+            {
+                for (uint64_t child : children)
+                    select(child);
+                return;
+            }
+        }
+        selected.push_back(patch.slot);
+    }
+
+    bool visible(const Patch& patch) const
+    {
+        for (const glm::vec4& plane : frustum)
+            if (glm::dot(glm::vec3(plane), patch.centre) + plane.w < -patch.radius)
+                return false;
+        // behind the horizon: the ball under the lowest terrain hides everything further round than
+        // the camera's horizon plus how far past it the highest peaks still show
+        float cameraDistance = glm::length(camera);
+        float ground = 1.0f - amplitude;
+        if (cameraDistance <= ground)
+            return true;
+        float horizon = std::acos(ground / cameraDistance) + std::acos(ground / (1.0f + amplitude));
+        float around = std::acos(glm::clamp(glm::dot(camera / cameraDistance, patch.direction), -1.0f, 1.0f));
+        return around <= horizon + patch.angle;
+    }
+
+    // starts builds for the missing patches, coarsest first, as long as there are free workers
+    void startJobs()
+    {
+        std::stable_sort(requests.begin(), requests.end(), [](uint64_t a, uint64_t b) { return keyLevel(a) < keyLevel(b); });
+        for (uint64_t key : requests)
+        {
+            if (jobs.size() >= MAX_JOBS)
+                break;
+            if (jobs.count(key))
+                continue;
+            HeightFunction function = height;
+            float skirt = 2.0f * spacing(keyLevel(key)) + 0.25f * amplitude / float(1 << keyLevel(key));
+            jobs.emplace(key, std::async(std::launch::async, [key, function, skirt]() { return build(key, function, skirt); }));
+        }
+    }
+
+    // moves finished builds into the pool; needs a slot that wasn't used this frame or the last
+    void upload()
+    {
+        int uploads = 0;
+        for (auto it = jobs.begin(); it != jobs.end() && uploads < MAX_UPLOADS; )
+        {
+            if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++it;
+                continue;
+            }
+            uint64_t key = it->first;
+            Built built = it->second.get();
+            it = jobs.erase(it);
+            unsigned int slot;
+            if (!takeSlot(slot))
+                continue; // everything is in use; the patch is asked for again if it is still needed
+            GLState::Get().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            glBufferSubData(GL_ARRAY_BUFFER, size_t(slot) * VERTICES * sizeof(Vertex), VERTICES * sizeof(Vertex), built.vertices.data());
+            patches[key] = Patch{ slot, frame, built.centre, built.radius, built.direction, built.angle };
+            stats.built++;
+            uploads++;
+        }
+    }
+
+    bool takeSlot(unsigned int& slot)
+    {
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            return true;
+        }
+        // least recently used; the roots stay so there is always a whole planet to draw
+        auto oldest = patches.end();
+        for (auto it = patches.begin(); it != patches.end(); ++it)
+            if (keyLevel(it->first) > 0 && it->second.lastUsed + 1 < frame && (oldest == patches.end() || it->second.lastUsed < oldest->second.lastUsed))
+                oldest = it;
+        if (oldest == patches.end())
+            return false;
+        slot = oldest->second.slot;
+        patches.erase(oldest);
+        stats.evicted++;
+        return true;
+    }
+
+    // worker thread: the vertices of one patch, grid then skirts
+    static Built build(uint64_t key, const HeightFunction& height, float skirt)
+    {
+        int face = keyFace(key), level = keyLevel(key);
+        float size = 2.0f / float(1 << level);
+        float s0 = -1.0f + keyX(key) * size, t0 = -1.0f + keyY(key) * size;
+        // heights on the grid plus a one-sample border, so normals along the edges match the neighbours'
+        const int border = GRID + 3;
+        std::vector<glm::vec3> positions(border * border);
+        for (int j = 0; j < border; j++)
+        {
+            for (int i = 0; i < border; i++)
+            {
+                glm::vec3 direction = SphereMesh::CubeToSphere(SphereMesh::CubePoint(face, s0 + (i - 1) * size / GRID, t0 + (j - 1) * size / GRID));
+                positions[j * border + i] = direction * (1.0f + height(direction));
+            }
+        }
+
+        Built built;
+        built.direction = SphereMesh::CubeToSphere(SphereMesh::CubePoint(face, s0 + size * 0.5f, t0 + size * 0.5f));
+        float centreU = SphereMesh::SphereUV(built.direction).x;
+        built.vertices.resize(VERTICES);
+        Vertex* grid = built.vertices.data();
+        for (int j = 0; j <= GRID; j++)
+        {
+            for (int i = 0; i <= GRID; i++)
+            {
+                const glm::vec3* p = &positions[(j + 1) * border + i + 1];
+                Vertex vertex = {};
+                vertex.Position = *p;
+                glm::vec3 normal = glm::cross(p[1] - p[-1], p[border] - p[-border]);
+                vertex.Normal = glm::normalize(normal);
+                // u continues across the 0/1 seam inside a patch; the map repeats
+                glm::vec2 uv = SphereMesh::SphereUV(glm::normalize(*p));
+                uv.x = centreU + (uv.x - centreU - std::round(uv.x - centreU));
+                vertex.TexCoords = uv;
+                vertex.Tangent = SphereMesh::SphereTangent(uv.x - std::floor(uv.x));
+                vertex.Bitangent = glm::cross(vertex.Tangent, vertex.Normal);
+                grid[j * (GRID + 1) + i] = vertex;
+            }
+        }
+        // skirts: the edge vertices again, pulled down towards the centre
+        Vertex* skirts = grid + (GRID + 1) * (GRID + 1);
+        for (int k = 0; k <= GRID; k++)
+        {
+            int edges[4] = { k, k * (GRID + 1) + GRID, GRID * (GRID + 1) + k, k * (GRID + 1) };
+            for (int edge = 0; edge < 4; edge++)
+            {
+                Vertex vertex = grid[edges[edge]];
+                vertex.Position -= glm::normalize(vertex.Position) * skirt;
+                skirts[edge * (GRID + 1) + k] = vertex;
+            }
+        }
+
+        glm::vec3 low = grid[0].Position, high = low;
+        for (const Vertex& vertex : built.vertices)
+        {
+            low = glm::min(low, vertex.Position);
+            high = glm::max(high, vertex.Position);
+        }
+        built.centre = (low + high) * 0.5f;
+        built.radius = 0.0f;
+        built.angle = 0.0f;
+        for (const Vertex& vertex : built.vertices)
+        {
+            built.radius = std::max(built.radius, glm::length(vertex.Position - built.centre));
+            built.angle = std::max(built.angle, std::acos(glm::clamp(glm::dot(glm::normalize(vertex.Position), built.direction), -1.0f, 1.0f)));
+        }
+        return built;
+    }
+
+    void create()
+    {
+        // one index list for every patch: the grid, then a strip of two triangles per skirt segment
+        std::vector<unsigned int> indices;
+        for (unsigned int j = 0; j < GRID; j++)
+        {
+            for (unsigned int i = 0; i < GRID; i++)
+            {
+                unsigned int a = j * (GRID + 1) + i, b = a + 1, c = a + GRID + 1, d = c + 1;
+                indices.insert(indices.end(), { a, b, d, a, d, c });
+            }
+        }
+        unsigned int skirtBase = (GRID + 1) * (GRID + 1);
+        for (unsigned int edge = 0; edge < 4; edge++)
+        {
+            for (unsigned int k = 0; k < GRID; k++)
+            {
+                unsigned int edges[4][2] = { { k, k + 1 }, { k * (GRID + 1) + GRID, (k + 1) * (GRID + 1) + GRID },
+                                             { GRID * (GRID + 1) + k, GRID * (GRID + 1) + k + 1 }, { k * (GRID + 1), (k + 1) * (GRID + 1) } };
+                unsigned int top0 = edges[edge][0], top1 = edges[edge][1];
+                unsigned int bottom0 = skirtBase + edge * (GRID + 1) + k, bottom1 = bottom0 + 1;
+                indices.insert(indices.end(), { top0, bottom0, bottom1, top0, bottom1, top1 });
+            }
+        }
+        indexCount = static_cast<unsigned int>(indices.size());
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        GLState::Get().BindVertexArray(VAO);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, size_t(capacity) * VERTICES * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+        GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        GeometryPool::PointVertexAttributes();
+    }
+
+    static float hash(const glm::ivec3& cell)
+    {
+        uint32_t h = uint32_t(cell.x) * 73856093u ^ uint32_t(cell.y) * 19349663u ^ uint32_t(cell.z) * 83492791u;
+        h = (h ^ (h >> 13)) * 0x5bd1e995u;
+        h ^= h >> 15;
+        return float(h & 0xFFFFFF) / float(0xFFFFFF) * 2.0f - 1.0f;
+    }
+
+    // trilinear value noise in [-1, 1]
+    static float valueNoise(const glm::vec3& p)
+    {
+        glm::vec3 cell = glm::floor(p);
+        glm::vec3 f = p - cell;
+        f = f * f * (3.0f - 2.0f * f);
+        glm::ivec3 c(cell);
+        float corners[8];
+        for (int i = 0; i < 8; i++)
+            corners[i] = hash(c + glm::ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        float x00 = glm::mix(corners[0], corners[1], f.x), x10 = glm::mix(corners[2], corners[3], f.x);
+        float x01 = glm::mix(corners[4], corners[5], f.x), x11 = glm::mix(corners[6], corners[7], f.x);
+        return glm::mix(glm::mix(x00, x10, f.y), glm::mix(x01, x11, f.y), f.z);
+    }
+};
+#endif
@@ -0,0 +1,367 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+
+#include <gl_extensions.h>
+#include <gl_state.h>
+#include <memory_usage.h>
+#include <shader_c.h>
+#include <shader_m.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#ifndef GL_PIXEL_BUFFER_BARRIER_BIT
+#define GL_PIXEL_BUFFER_BARRIER_BIT 0x00000080
+#endif
+
+// HDR rendering and the passes that bring it to the screen. Between Begin() and End() the scene
+// is drawn into an R11G11B10F target (a third of the bandwidth of RGBA32F, half of RGBA16F) with a
+// 32-bit float depth buffer, which also gives reverse-Z its full precision. End() then runs:
+//  - bloom: the frame is halved down a chain of up to BLOOM_LEVELS targets with a 13-tap filter
+//    (src/bloom_downsample.fs), then added back up the chain with a 3x3 tent, each level blended
+//    into the next larger one (src/bloom_upsample.fs). No pass reads more than 13 taps, and all of
+//    them together cost about what one full-resolution pass does, however wide the glow gets; a
+//    Gaussian as wide would need hundreds of taps a pixel even split into two passes.
+//  - auto exposure: a compute pass bins the log luminance of the first bloom level (the frame at
+//    half resolution) into a HISTOGRAM_BINS histogram, and a second one meters the middle-to-bright
+//    part of it and eases the exposure towards it. Nothing is read back: the exposure goes from
+//    the storage buffer into a 1x1 texture through a pixel unpack copy on the GPU. Needs compute
+//    shaders (GL 4.3); without them, or with AutoExposure off, the exposure is FixedExposure.
+//  - tonemap: bloom, exposure, the ACES curve and gamma in one fullscreen pass into the window.
+// The targets follow the size Begin() is given. End() runs BloomDown(), Exposure(), BloomUp() and
+// Tonemap(); they can also be run one by one, which is how --post-benchmark times them.
+class PostProcess
+{
+public:
+    static const int BLOOM_LEVELS = 6;       // half, quarter ... down to 1/64 of the frame
+    static const int HISTOGRAM_BINS = 256;   // src/common/exposure_data.glsl has the same count
+    static constexpr float MIN_LOG_LUMINANCE = -10.0f; // log2 range the histogram covers; darker is black
+    static constexpr float LOG_LUMINANCE_RANGE = 14.0f;
+
+    bool AutoExposure = true;
+    float FixedExposure = 1.0f;        // without auto exposure
+    float ExposureKey = 0.18f;         // the metered luminance is shown as this (mid grey)
+    float MinExposure = 0.25f;         // the limits auto exposure stays within
+    float MaxExposure = 2.0f;
+    glm::vec2 MeteredPercentiles = glm::vec2(0.5f, 0.98f); // part of the lit pixels metered, darkest first
+    float AdaptationRate = 1.5f;       // per second; the eye takes a moment after looking into the sun
+    float BloomStrength = 0.04f;       // share of the blurred frame in the result
+    float BloomRadius = 1.0f;          // of the upsampling tent, in texels of the smaller level
+
+    Shader DownsampleShader;
+    Shader UpsampleShader;
+    Shader TonemapShader;
+    ComputeShader HistogramShader;
+    ComputeShader AverageShader;
+
+    PostProcess()
+        : DownsampleShader("src/ibl.vs", "src/bloom_downsample.fs"), UpsampleShader("src/ibl.vs", "src/bloom_upsample.fs"),
+          TonemapShader("src/ibl.vs", "src/tonemap.fs"), HistogramShader("src/exposure_histogram.comp"), AverageShader("src/exposure_average.comp")
+    {
+        DownsampleShader.Setup = [](Shader& shader) { shader.use(); shader.setInt("source", 0); }; // run again after a hot reload
+        UpsampleShader.Setup = DownsampleShader.Setup;
+        TonemapShader.Setup = [](Shader& shader) {
+            shader.use();
+            shader.setInt("scene", 0);
+            shader.setInt("bloom", 1);
+            shader.setInt("exposure", 2);
+        };
+        for (Shader* shader : { &DownsampleShader, &UpsampleShader, &TonemapShader })
+            shader->Setup(*shader);
+        glGenVertexArrays(1, &vao);
+
+        glGenTextures(1, &exposureTexture);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, exposureTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, &FixedExposure);
+        setFilter(GL_NEAREST);
+        uploadedExposure = FixedExposure;
+        if (GLExt::HasCompute && HistogramShader.Valid() && AverageShader.Valid())
+        {
+            ExposureBuffer initial;
+            glGenBuffers(1, &exposureBuffer);
+            GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, exposureBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ExposureBuffer), &initial, GL_DYNAMIC_COPY);
+        }
+    }
+
+    ~PostProcess()
+    {
+        // GL objects are freed in Delete(), while the context still exists
+    }
+
+    PostProcess(const PostProcess&) = delete;
+    PostProcess& operator=(const PostProcess&) = delete;
+
+    bool AutoExposureSupported() const { return exposureBuffer != 0; }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int BloomLevelCount() const { return static_cast<int>(bloomLevels.size()); }
+
+    // (re)creates the targets for a 'frameWidth' x 'frameHeight' frame; nothing happens at the same size
+    void Resize(int frameWidth, int frameHeight)
+    {
+        frameWidth = std::max(frameWidth, 1); // a minimized window has no pixels
+        frameHeight = std::max(frameHeight, 1);
+        if (frameWidth == width && frameHeight == height)
+            return;
+        deleteTargets();
+        width = frameWidth;
+        height = frameHeight;
+
+        glGenFramebuffers(1, &sceneFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+        sceneTexture = createColorTexture(width, height);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneTexture, 0);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        checkFramebuffer("SCENE");
+
+        for (int level = 0; level < BLOOM_LEVELS; level++)
+        {
+            int levelWidth = width >> (level + 1), levelHeight = height >> (level + 1);
+            if (levelWidth < 2 || levelHeight < 2)
+                break;
+            Level bloom;
+            bloom.width = levelWidth;
+            bloom.height = levelHeight;
+            glGenFramebuffers(1, &bloom.framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, bloom.framebuffer);
+            bloom.texture = createColorTexture(levelWidth, levelHeight);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bloom.texture, 0);
+            checkFramebuffer("BLOOM");
+            bloomLevels.push_back(bloom);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // makes the HDR target the one drawn to, at the frame's size, and clears it
+    void Begin(int frameWidth, int frameHeight)
+    {
+        Resize(frameWidth, frameHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // the rest of the frame: bloom, exposure and the tonemap into the window
+    void End(float deltaTime)
+    {
+        BloomDown();
+        Exposure(deltaTime);
+        BloomUp();
+        Tonemap(0);
+    }
+
+    // halves the frame down the chain
+    void BloomDown()
+    {
+        GLState::Get().SetDepthTest(false);
+        GLState::Get().BindVertexArray(vao);
+        DownsampleShader.use();
+        for (size_t level = 0; level < bloomLevels.size(); level++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, bloomLevels[level].framebuffer);
+            glViewport(0, 0, bloomLevels[level].width, bloomLevels[level].height);
+            GLState::Get().BindTexture(0, GL_TEXTURE_2D, level == 0 ? sceneTexture : bloomLevels[level - 1].texture);
+            DownsampleShader.setBool("firstLevel", level == 0);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        GLState::Get().SetDepthTest(true);
+    }
+
+    // adds each level into the next larger one, from the smallest up
+    void BloomUp()
+    {
+        GLState::Get().SetDepthTest(false);
+        GLState::Get().BindVertexArray(vao);
+        UpsampleShader.use();
+        UpsampleShader.setFloat("radius", BloomRadius);
+        GLState::Get().SetBlend(true);
+        GLState::Get().SetBlendFunc(GL_ONE, GL_ONE);
+        for (size_t level = bloomLevels.size(); level > 1; level--)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, bloomLevels[level - 2].framebuffer);
+            glViewport(0, 0, bloomLevels[level - 2].width, bloomLevels[level - 2].height);
+            GLState::Get().BindTexture(0, GL_TEXTURE_2D, bloomLevels[level - 1].texture);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        GLState::Get().SetBlend(false);
+        GLState::Get().SetDepthTest(true);
+    }
+
+    // meters the first bloom level, between BloomDown() and BloomUp() while it is still just the frame
+    // at half resolution, and moves the exposure the tonemap reads; 'deltaTime' (seconds) paces it
+    void Exposure(float deltaTime)
+    {
+        if (!AutoExposure || !AutoExposureSupported() || bloomLevels.empty())
+        {
+            if (uploadedExposure != FixedExposure)
+            {
+                GLState::Get().BindTexture(0, GL_TEXTURE_2D, exposureTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RED, GL_FLOAT, &FixedExposure);
+                uploadedExposure = FixedExposure;
+            }
+            return;
+        }
+        uploadedExposure = -1.0f; // the texture holds the metered exposure from now on
+        glm::vec2 logLuminance(MIN_LOG_LUMINANCE, LOG_LUMINANCE_RANGE);
+        GLState::Get().BindStorageBuffer(0, exposureBuffer);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, bloomLevels[0].texture);
+        HistogramShader.use();
+        HistogramShader.setInt("source", 0);
+        HistogramShader.setVec2("logLuminance", logLuminance);
+        HistogramShader.dispatch((bloomLevels[0].width + 15) / 16, (bloomLevels[0].height + 15) / 16);
+        GLExt::MemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        AverageShader.use();
+        AverageShader.setVec2("logLuminance", logLuminance);
+        AverageShader.setVec2("percentiles", MeteredPercentiles);
+        AverageShader.setVec3("exposureRange", glm::vec3(ExposureKey, MinExposure, MaxExposure));
+        AverageShader.setFloat("adaptation", AdaptationRate);
+        AverageShader.setFloat("deltaTime", deltaTime);
+        AverageShader.dispatch(1);
+        // the exposure goes from the buffer to the texture on the GPU, and next frame's histogram
+        // atomics must see the bins this pass cleared
+        GLExt::MemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+        GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, exposureBuffer);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, exposureTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RED, GL_FLOAT, reinterpret_cast<const void*>(offsetof(ExposureBuffer, exposure)));
+        GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // draws the result into 'framebuffer' (0 is the window) at the frame's size
+    void Tonemap(unsigned int framebuffer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        GLState::Get().SetDepthTest(false);
+        GLState::Get().BindVertexArray(vao);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, sceneTexture);
+        GLState::Get().BindTexture(1, GL_TEXTURE_2D, bloomLevels.empty() ? sceneTexture : bloomLevels[0].texture);
+        GLState::Get().BindTexture(2, GL_TEXTURE_2D, exposureTexture);
+        TonemapShader.use();
+        TonemapShader.setFloat("bloomStrength", bloomLevels.empty() ? 0.0f : BloomStrength);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        GLState::Get().SetDepthTest(true);
+    }
+
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        size_t texels = static_cast<size_t>(width) * height * 2; // colour and depth, 4 bytes each
+        for (const Level& level : bloomLevels)
+            texels += static_cast<size_t>(level.width) * level.height;
+        usage.gpuBytes = sceneFramebuffer ? texels * 4 : 0;
+        usage.gpuBytes += (exposureBuffer ? sizeof(ExposureBuffer) : 0) + (exposureTexture ? sizeof(float) : 0);
+        return usage;
+    }
+
+    // frees the targets, the programs and the exposure state; call while the context is still current
+    void Delete()
+    {
+        deleteTargets();
+        for (Shader* shader : { &DownsampleShader, &UpsampleShader, &TonemapShader })
+        {
+            glDeleteProgram(shader->ID);
+            GLState::Get().ProgramDeleted(shader->ID);
+            shader->ID = 0;
+        }
+        HistogramShader.Delete();
+        AverageShader.Delete();
+        if (vao)
+        {
+            glDeleteVertexArrays(1, &vao);
+            GLState::Get().VertexArrayDeleted(vao);
+            vao = 0;
+        }
+        if (exposureTexture)
+        {
+            glDeleteTextures(1, &exposureTexture);
+            GLState::Get().TextureDeleted(exposureTexture);
+            exposureTexture = 0;
+        }
+        if (exposureBuffer)
+        {
+            glDeleteBuffers(1, &exposureBuffer);
+            GLState::Get().BufferDeleted(exposureBuffer);
+            exposureBuffer = 0;
+        }
+    }
+
+private:
+    // std430 layout of ExposureData in src/common/exposure_data.glsl
+    struct ExposureBuffer {
+        unsigned int histogram[HISTOGRAM_BINS] = {};
+        float luminance = 0.0f; // none metered yet: the first frame is taken as it is
+        float exposure = 1.0f;
+    };
+    static_assert(sizeof(ExposureBuffer) == HISTOGRAM_BINS * 4 + 8, "ExposureBuffer must match the std430 block");
+
+    struct Level {
+        unsigned int framebuffer = 0;
+        unsigned int texture = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    int width = 0, height = 0;
+    unsigned int sceneFramebuffer = 0, sceneTexture = 0, depthBuffer = 0;
+    std::vector<Level> bloomLevels;
+    unsigned int vao = 0;
+    unsigned int exposureTexture = 0, exposureBuffer = 0; // no buffer without auto exposure support
+    float uploadedExposure = 0.0f; // the value in exposureTexture when it was set from the CPU
+
+    static void setFilter(GLint filter)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    static unsigned int createColorTexture(int textureWidth, int textureHeight)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, textureWidth, textureHeight, 0, GL_RGB, GL_FLOAT, NULL);
+        setFilter(GL_LINEAR);
+        return texture;
+    }
+
+    static void checkFramebuffer(const char* name)
+    {
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::POST_PROCESS::" << name << "_FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+
+    void deleteTargets()
+    {
+        for (const Level& level : bloomLevels)
+        {
+            glDeleteFramebuffers(1, &level.framebuffer);
+            glDeleteTextures(1, &level.texture);
+            GLState::Get().TextureDeleted(level.texture);
+        }
+        bloomLevels.clear();
+        if (sceneFramebuffer)
+        {
+            glDeleteFramebuffers(1, &sceneFramebuffer);
+            glDeleteTextures(1, &sceneTexture);
+            GLState::Get().TextureDeleted(sceneTexture);
+            glDeleteRenderbuffers(1, &depthBuffer);
+        }
+        sceneFramebuffer = sceneTexture = depthBuffer = 0;
+        width = height = 0;
+    }
+};
+#endif
@@ -0,0 +1,192 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <disk_cache.h>
+#include <gl_extensions.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// A program is keyed by a hash of its final shader sources together with the GL vendor, renderer
+// and version strings, so a driver update or a different GPU simply misses instead of loading a
+// binary it cannot use. Drivers may still reject a binary they wrote themselves; Load() then
+// deletes the file and returns false, and the caller compiles from source as if there were no cache.
+// Everything is a no-op without GL 4.1 / ARB_get_program_binary.
+class ProgramCache
+{
+public:
+    struct Stats {
+        unsigned int hits = 0;     // programs loaded from a binary
+        unsigned int misses = 0;   // no binary on disk
+        unsigned int rejected = 0; // binary on disk but the driver refused it
+        unsigned int stored = 0;   // binaries written
+    };
+
+    static ProgramCache& Get()
+    {
+        static ProgramCache instance;
+        return instance;
+    }
+
+    // where the binaries live, relative to the working directory by default
+    void SetDirectory(const std::string& path) { directory = path; }
+    bool Enabled() const { return GLExt::HasProgramBinary; }
+
+    // cache key for a program built from 'sources' (in attach order) on the current driver
+    uint64_t Key(const std::vector<std::string>& sources)
+    {
+        if (driver.empty())
+        {
+            for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+            {
+                const char* value = reinterpret_cast<const char*>(glGetString(name));
+                driver += value ? value : "";
+                driver += '\n';
+            }
+        }
+        uint64_t hash = hashBytes(FNV_OFFSET, driver.data(), driver.size());
+        for (const std::string& source : sources)
+        {
+            uint64_t size = source.size();
+            hash = hashBytes(hash, &size, sizeof(size)); // keeps "ab"+"c" apart from "a"+"bc"
+            hash = hashBytes(hash, source.data(), source.size());
+        }
+        return hash;
+    }
+
+    // tries to fill 'program' (created, nothing attached) from the cache; true if it linked
+    bool Load(uint64_t key, GLuint program)
+    {
+        if (!Enabled())
+        {
+            stats.misses++;
+            return false;
+        }
+        std::string binaryPath = path(key);
+        std::ifstream file(binaryPath, std::ios::binary);
+        if (!file)
+        {
+            stats.misses++;
+            return false;
+        }
+        Header header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        // the length is only trusted once the header is ours and the file really holds that many bytes,
+        // so a foreign or truncated file can't ask for a huge buffer
+        std::error_code error;
+        uintmax_t fileSize = std::filesystem::file_size(binaryPath, error);
+        bool valid = file && header.magic == MAGIC && !error && header.length > 0 && header.length <= fileSize - sizeof(header);
+        std::vector<char> binary;
+        if (valid)
+        {
+            binary.resize(header.length);
+            valid = static_cast<bool>(file.read(binary.data(), binary.size()));
+        }
+        if (!valid)
+        {
+            stats.rejected++;
+            file.close();
+            remove(key);
+            return false;
+        }
+
+        GLExt::ProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            stats.rejected++;
+            file.close();
+            remove(key);
+            return false;
+        }
+        stats.hits++;
+        return true;
+    }
+
+    // call before glLinkProgram on programs that should be stored afterwards
+    void PrepareLink(GLuint program) const
+    {
+        if (Enabled())
+            GLExt::ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes the binary of a successfully linked program
+    void Store(uint64_t key, GLuint program)
+    {
+        if (!Enabled())
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        Header header;
+        GLsizei written = 0;
+        GLExt::GetProgramBinary(program, length, &written, &header.format, binary.data());
+        if (written <= 0)
+            return;
+        header.length = static_cast<uint32_t>(written);
+
+        bool stored = DiskCache::Write(path(key), "PROGRAM_CACHE", [&](std::ofstream& file) {
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(binary.data(), written);
+        });
+        if (stored)
+            stats.stored++;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    static const uint32_t MAGIC = 0x4E494250; // "PBIN"
+    static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+    static const uint64_t FNV_PRIME = 1099511628211ull;
+
+    struct Header {
+        uint32_t magic = MAGIC;
+        GLenum format = 0;
+        uint32_t length = 0;
+    };
+
+    std::string directory = "shader_cache";
+    std::string driver;
+    Stats stats;
+
+    ProgramCache() {}
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    void remove(uint64_t key) const
+    {
+        std::error_code error;
+        std::filesystem::remove(path(key), error);
+    }
+};
+#endif
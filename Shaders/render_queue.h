@@ -0,0 +1,236 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <geometry_pool.h>
+#include <gl_state.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// 64-bit draw sort key, most significant field first:
+//   63..60 pass | 59..48 shader | 47..32 material | 31..16 texture set | 15..0 depth bucket
+// Sorting by the key groups draws by pass, then program, then material and textures, so each
+// state change happens once per group; inside a group draws go front to back by depth bucket.
+namespace SortKey
+{
+    inline uint64_t Make(unsigned int pass, unsigned int shader, unsigned int material, unsigned int textureSet, unsigned int depth)
+    {
+        return (uint64_t(pass & 0xF) << 60) | (uint64_t(shader & 0xFFF) << 48) | (uint64_t(material & 0xFFFF) << 32)
+             | (uint64_t(textureSet & 0xFFFF) << 16) | uint64_t(depth & 0xFFFF);
+    }
+
+    // maps a view distance in [0, maxDistance] to a 16-bit bucket
+    inline unsigned int DepthBucket(float distance, float maxDistance)
+    {
+        float t = distance / maxDistance;
+        t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+        return static_cast<unsigned int>(t * 65535.0f);
+    }
+}
+
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_SKY = 1,
+    PASS_TRANSPARENT = 2,
+    PASS_OVERLAY = 3
+};
+
+// one draw of a GeometryPool range with the state it needs
+struct RenderItem {
+    GLuint program = 0;
+    GLuint vao = 0;
+    GLenum textureTarget = GL_TEXTURE_2D;
+    GLuint texture = 0;
+    MeshRange range;
+    unsigned int firstInstance = 0; // into the queue's InstanceData
+    unsigned int instanceCount = 1;
+};
+
+// Collects a frame's draws as (key, item) pairs, radix sorts them by key and executes them through
+// the GLState cache. Consecutive items that need the same pass, program, VAO and texture are merged
+// into one GeometryPool multi-draw. The stats keep the state changes the frame would have needed in
+// submission order next to the ones it actually needed after sorting.
+class RenderQueue
+{
+public:
+    struct Stats {
+        unsigned int items = 0;
+        unsigned int drawCalls = 0;
+        // state changes walking the items in submission order ...
+        unsigned int unsortedProgramChanges = 0, unsortedTextureChanges = 0, unsortedVaoChanges = 0;
+        // ... and in sorted order, which is what Execute() issues
+        unsigned int programChanges = 0, textureChanges = 0, vaoChanges = 0;
+    };
+
+    void Clear()
+    {
+        keys.clear();
+        items.clear();
+        instances.clear();
+    }
+
+    // reserves 'count' per-draw records and returns the index of the first; fill them via Instances()
+    unsigned int AllocateInstances(unsigned int count)
+    {
+        unsigned int first = static_cast<unsigned int>(instances.size());
+        instances.resize(instances.size() + count);
+        return first;
+    }
+    InstanceData* Instances(unsigned int first) { return &instances[first]; }
+
+    void Submit(uint64_t key, const RenderItem& item)
+    {
+        keys.push_back(key);
+        items.push_back(item);
+    }
+
+    // sorts and draws everything submitted since Clear()
+    void Execute()
+    {
+        stats = Stats();
+        stats.items = static_cast<unsigned int>(items.size());
+        if (items.empty())
+            return;
+
+        countChanges(identityOrder(), stats.unsortedProgramChanges, stats.unsortedTextureChanges, stats.unsortedVaoChanges);
+        sortedKeys = keys;
+        RadixSort(sortedKeys, order);
+        countChanges(order, stats.programChanges, stats.textureChanges, stats.vaoChanges);
+
+        // commands in sorted order; each keeps pointing at its own per-draw records
+        commands.clear();
+        for (uint32_t index : order)
+        {
+            const RenderItem& item = items[index];
+            commands.push_back({ item.range.indexCount, item.instanceCount, item.range.firstIndex, item.range.baseVertex, item.firstInstance });
+        }
+        GeometryPool& pool = GeometryPool::Get();
+        pool.Upload(instances, commands);
+
+        GLState& state = GLState::Get();
+        unsigned int currentPass = ~0u;
+        size_t first = 0;
+        while (first < order.size())
+        {
+            const RenderItem& head = items[order[first]];
+            unsigned int pass = static_cast<unsigned int>(sortedKeys[first] >> 60);
+            size_t last = first + 1;
+            while (last < order.size() && (sortedKeys[last] >> 60) == pass && sameState(head, items[order[last]]))
+                last++;
+
+            if (pass != currentPass)
+            {
+                applyPass(pass);
+                currentPass = pass;
+            }
+            state.UseProgram(head.program);
+            state.BindTexture(0, head.textureTarget, head.texture);
+            pool.MultiDraw(first, last - first);
+            stats.drawCalls++;
+            first = last;
+        }
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+    // LSD radix sort, 8 bits per pass. Sorts 'keys' and writes the permutation into 'order'
+    // (order[i] = submission index of the i-th smallest key). Passes where every key has the
+    // same byte are skipped, which is most of them for a typical frame.
+    static void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order)
+    {
+        size_t n = keys.size();
+        order.resize(n);
+        for (size_t i = 0; i < n; i++)
+            order[i] = static_cast<uint32_t>(i);
+        std::vector<uint64_t> keyScratch(n);
+        std::vector<uint32_t> orderScratch(n);
+
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t counts[256];
+            std::memset(counts, 0, sizeof(counts));
+            for (size_t i = 0; i < n; i++)
+                counts[(keys[i] >> shift) & 0xFF]++;
+            if (counts[(keys[0] >> shift) & 0xFF] == n)
+                continue; // every key has the same byte here
+
+            size_t offset = 0;
+            for (size_t& count : counts)
+            {
+                size_t c = count;
+                count = offset;
+                offset += c;
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                size_t dst = counts[(keys[i] >> shift) & 0xFF]++;
+                keyScratch[dst] = keys[i];
+                orderScratch[dst] = order[i];
+            }
+            keys.swap(keyScratch);
+            order.swap(orderScratch);
+        }
+    }
+
+private:
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> sortedKeys;
+    std::vector<RenderItem> items;
+    std::vector<InstanceData> instances;
+    std::vector<uint32_t> order;
+    std::vector<DrawElementsIndirectCommand> commands;
+    Stats stats;
+
+    // fixed-function state of each pass. Opaque geometry uses the same less-or-equal test (greater-
+    // or-equal with reverse-Z) as the sky drawn at the far plane, so the depth function never changes
+    static void applyPass(unsigned int pass)
+    {
+        GLState& state = GLState::Get();
+        state.SetDepthTest(true);
+        state.SetDepthFunc(state.DepthTestFunc());
+        if (pass == PASS_TRANSPARENT || pass == PASS_OVERLAY)
+        {
+            state.SetDepthMask(false);
+            state.SetBlend(true);
+            state.SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        else
+        {
+            state.SetDepthMask(true);
+            state.SetBlend(false);
+        }
+    }
+
+    static bool sameState(const RenderItem& a, const RenderItem& b)
+    {
+        return a.program == b.program && a.vao == b.vao && a.textureTarget == b.textureTarget && a.texture == b.texture;
+    }
+
+    std::vector<uint32_t> identityOrder() const
+    {
+        std::vector<uint32_t> identity(items.size());
+        for (size_t i = 0; i < identity.size(); i++)
+            identity[i] = static_cast<uint32_t>(i);
+        return identity;
+    }
+
+    void countChanges(const std::vector<uint32_t>& sequence, unsigned int& programs, unsigned int& textures, unsigned int& vaos) const
+    {
+        const RenderItem* previous = nullptr;
+        for (uint32_t index : sequence)
+        {
+            const RenderItem& item = items[index];
+            if (!previous || previous->program != item.program)
+                programs++;
+            if (!previous || previous->texture != item.texture || previous->textureTarget != item.textureTarget)
+                textures++;
+            if (!previous || previous->vao != item.vao)
+                vaos++;
+            previous = &item;
+        }
+    }
+};
+#endif
@@ -0,0 +1,166 @@
+#ifndef COMPUTE_SHADER_H
+#define COMPUTE_SHADER_H
+
+#include <glad/glad.h>
+#include <glm.hpp>
+
+#include <gl_extensions.h>
+#include <gl_state.h>
+#include <program_cache.h>
+#include <shader_source.h>
+
+#include <string>
+#include <iostream>
+#include <vector>
+
+// A single-stage compute program, preprocessed and cached like Shader. Needs GLExt::HasCompute;
+// without it the constructor leaves ID at 0.
+class ComputeShader
+{
+public:
+    unsigned int ID = 0;
+    std::vector<std::string> Files; // every source file the program was built from, includes too
+
+    // constructor generates the shader on the fly; 'defines' ("NAME" or "NAME VALUE") select a permutation
+    // ------------------------------------------------------------------------
+    ComputeShader(const char* computePath, const std::vector<std::string>& defines = {})
+    {
+        if (!GLExt::HasCompute)
+            return;
+        // 1. retrieve the source code from filePath, with #includes expanded
+        ShaderSource source = ShaderSource::Load(computePath, defines);
+        Files = source.files;
+        if (!source.ok)
+            return;
+        // 2. reuse the cached binary of this exact program if the driver still accepts it
+        uint64_t cacheKey = ProgramCache::Get().Key({ source.code });
+        ID = glCreateProgram();
+        if (ProgramCache::Get().Load(cacheKey, ID))
+            return;
+        // 3. compile shader
+        const char* cShaderCode = source.code.c_str();
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE", &source);
+        // shader Program
+        glAttachShader(ID, compute);
+        ProgramCache::Get().PrepareLink(ID);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (success)
+            ProgramCache::Get().Store(cacheKey, ID);
+        // delete the shader as it's linked into our program now and no longer necessery
+        glDeleteShader(compute);
+    }
+    // true if the program linked and can be dispatched
+    // ------------------------------------------------------------------------
+    bool Valid() const
+    {
+        GLint success = 0;
+        if (ID)
+            glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        return success != 0;
+    }
+    // activate the shader
+    // ------------------------------------------------------------------------
+    void use()
+    {
+        GLState::Get().UseProgram(ID);
+    }
+    // runs the program over groupsX * groupsY * groupsZ work groups
+    // ------------------------------------------------------------------------
+    void dispatch(unsigned int groupsX, unsigned int groupsY = 1, unsigned int groupsZ = 1)
+    {
+        use();
+        GLExt::DispatchCompute(groupsX, groupsY, groupsZ);
+    }
+    // frees the program; call while the context is still current
+    // ------------------------------------------------------------------------
+    void Delete()
+    {
+        glDeleteProgram(ID);
+        GLState::Get().ProgramDeleted(ID);
+        ID = 0;
+    }
+    // utility uniform functions
+    // ------------------------------------------------------------------------
+    void setBlockBinding(const std::string& name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
+    // ------------------------------------------------------------------------
+    void setInt(const std::string& name, int value) const
+    {
+        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    }
+    // ------------------------------------------------------------------------
+    void setUint(const std::string& name, unsigned int value) const
+    {
+        glUniform1ui(glGetUniformLocation(ID, name.c_str()), value);
+    }
+    // ------------------------------------------------------------------------
+    void setFloat(const std::string& name, float value) const
+    {
+        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    }
+    // ------------------------------------------------------------------------
+    void setVec2(const std::string& name, const glm::vec2& value) const
+    {
+        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+    // ------------------------------------------------------------------------
+    void setVec3(const std::string& name, const glm::vec3& value) const
+    {
+        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+    // ------------------------------------------------------------------------
+    void setVec4(const std::string& name, const glm::vec4& value) const
+    {
+        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+    void setVec4Array(const std::string& name, const glm::vec4* values, int count) const
+    {
+        glUniform4fv(glGetUniformLocation(ID, name.c_str()), count, &values[0][0]);
+    }
+    // ------------------------------------------------------------------------
+    void setMat4(const std::string& name, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    }
+
+private:
+    // utility function for checking shader compilation/linking errors.
+    // ------------------------------------------------------------------------
+    void checkCompileErrors(GLuint shader, std::string type, const ShaderSource* source = nullptr)
+    {
+        GLint success;
+        GLchar infoLog[1024];
+        if (type != "PROGRAM")
+        {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog;
+                if (source)
+                    std::cout << "source numbers:\n" << source->FileTable();
+                std::cout << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+        else
+        {
+            glGetProgramiv(shader, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+    }
+};
+#endif
@@ -4,103 +4,88 @@
 #include <glad/glad.h>
 #include <glm.hpp>
 
+#include <gl_state.h>
+#include <program_cache.h>
+#include <shader_source.h>
+
+#include <algorithm>
+#include <functional>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
-    // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
-    {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-            // if geometry shader path is present, also load a geometry shader
-            if (geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if (geometryPath != nullptr)
+    std::vector<std::string> Files; // every source file the program was built from, includes too
+    // re-applied to the new program after Rebuild() (uniform block bindings, sampler units, ...)
+    std::function<void(Shader&)> Setup;
+
+    // preprocessed sources of every stage
+    struct Sources {
+        ShaderSource vertex, fragment, geometry;
+        bool hasGeometry = false;
+    };
+
+    // constructor generates the shader on the fly; 'defines' ("NAME" or "NAME VALUE") select a permutation
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::vector<std::string>& defines = {})
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath ? geometryPath : ""), defines(defines)
+    {
+        // 1. retrieve the vertex/fragment source code from filePath, with #includes expanded
+        Sources sources = LoadSources();
+        bool linked;
+        ID = build(sources, linked);
+        collectFiles(sources);
+    }
+    // reads and preprocesses the source files again; touches no GL state, so it may run on any thread
+    // ------------------------------------------------------------------------
+    Sources LoadSources() const
+    {
+        Sources sources;
+        sources.vertex = ShaderSource::Load(vertexPath, defines);
+        sources.fragment = ShaderSource::Load(fragmentPath, defines);
+        sources.hasGeometry = !geometryPath.empty();
+        if (sources.hasGeometry)
+            sources.geometry = ShaderSource::Load(geometryPath, defines);
+        return sources;
+    }
+    // compiles 'sources' into a new program and swaps it in. If anything fails to compile or link
+    // the current program stays in use and false is returned.
+    // ------------------------------------------------------------------------
+    bool Rebuild(const Sources& sources)
+    {
+        if (!sources.vertex.ok || !sources.fragment.ok || (sources.hasGeometry && !sources.geometry.ok))
+            return false;
+        bool linked;
+        unsigned int program = build(sources, linked);
+        if (!linked)
         {
-            const char* gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            glDeleteProgram(program);
+            return false;
         }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if (geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        glDeleteProgram(ID);
+        GLState::Get().ProgramDeleted(ID);
+        ID = program;
+        collectFiles(sources);
+        if (Setup)
+            Setup(*this);
+        return true;
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use()
     {
-        glUseProgram(ID);
+        GLState::Get().UseProgram(ID);
+    }
+    // points the named uniform block at a buffer binding point; ignored if the program has no such block
+    // ------------------------------------------------------------------------
+    void setBlockBinding(const std::string& name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -162,9 +147,82 @@ public:
     }
 
 private:
+    std::string vertexPath, fragmentPath, geometryPath;
+    std::vector<std::string> defines;
+
+    // creates and links a program from 'sources', from the binary cache when possible
+    // ------------------------------------------------------------------------
+    unsigned int build(const Sources& sources, bool& linked)
+    {
+        const std::string& vertexCode = sources.vertex.code;
+        const std::string& fragmentCode = sources.fragment.code;
+        const std::string& geometryCode = sources.geometry.code;
+        // 2. reuse the cached binary of this exact program if the driver still accepts it
+        std::vector<std::string> codes = { vertexCode, fragmentCode };
+        if (sources.hasGeometry)
+            codes.push_back(geometryCode);
+        uint64_t cacheKey = ProgramCache::Get().Key(codes);
+        unsigned int program = glCreateProgram();
+        linked = ProgramCache::Get().Load(cacheKey, program);
+        if (linked)
+            return program;
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+        // 3. compile shaders
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX", &sources.vertex);
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT", &sources.fragment);
+        // if geometry shader is given, compile geometry shader
+        unsigned int geometry;
+        if (sources.hasGeometry)
+        {
+            const char* gShaderCode = geometryCode.c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+            checkCompileErrors(geometry, "GEOMETRY", &sources.geometry);
+        }
+        // shader Program
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        if (sources.hasGeometry)
+            glAttachShader(program, geometry);
+        ProgramCache::Get().PrepareLink(program);
+        glLinkProgram(program);
+        checkCompileErrors(program, "PROGRAM");
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        linked = success != 0;
+        if (linked)
+            ProgramCache::Get().Store(cacheKey, program);
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if (sources.hasGeometry)
+            glDeleteShader(geometry);
+        return program;
+    }
+
+    void collectFiles(const Sources& sources)
+    {
+        Files.clear();
+        for (const ShaderSource* source : { &sources.vertex, &sources.fragment, &sources.geometry })
+            for (const std::string& file : source->files)
+                if (std::find(Files.begin(), Files.end(), file) == Files.end())
+                    Files.push_back(file);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    void checkCompileErrors(GLuint shader, std::string type, const ShaderSource* source = nullptr)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -174,7 +232,10 @@ private:
             if (!success)
             {
                 glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog;
+                if (source)
+                    std::cout << "source numbers:\n" << source->FileTable();
+                std::cout << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
         else
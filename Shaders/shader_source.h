@@ -0,0 +1,131 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A GLSL file after preprocessing: #include "file" directives are expanded (paths relative to the
+// including file, each file at most once) and the given defines are inserted right after #version.
+// Every switch between files is marked with "#line <line> <file index>", the only #line form GLSL
+// accepts, so compiler messages like "1:12" mean line 12 of files[1].
+struct ShaderSource {
+    std::string code;
+    std::vector<std::string> files; // every file read, index = source number used in #line
+    bool ok = true;
+
+    // 'defines' are "NAME" or "NAME VALUE"
+    static ShaderSource Load(const std::string& path, const std::vector<std::string>& defines = {})
+    {
+        ShaderSource source;
+        std::vector<std::string> stack;
+        source.append(normalize(path), defines, stack);
+        return source;
+    }
+
+    // "0:12" style error prefixes in a compile log refer to these files
+    std::string FileTable() const
+    {
+        std::string table;
+        for (size_t i = 0; i < files.size(); i++)
+            table += "  " + std::to_string(i) + ": " + files[i] + "\n";
+        return table;
+    }
+
+private:
+    static std::string normalize(const std::string& path)
+    {
+        return std::filesystem::path(path).lexically_normal().generic_string();
+    }
+
+    static bool startsWith(const std::string& line, const char* directive, size_t& rest)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, std::strlen(directive), directive) != 0)
+            return false;
+        rest = start + std::strlen(directive);
+        return true;
+    }
+
+    void append(const std::string& path, const std::vector<std::string>& defines, std::vector<std::string>& stack)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            ok = false;
+            return;
+        }
+        int index = static_cast<int>(files.size());
+        files.push_back(path);
+        stack.push_back(path);
+
+        bool root = stack.size() == 1;
+        bool definesWritten = false;
+        auto writeDefines = [&]() {
+            for (const std::string& define : defines)
+                code += "#define " + define + "\n";
+            definesWritten = true;
+        };
+        if (!root)
+            code += "#line 1 " + std::to_string(index) + "\n";
+
+        std::string line;
+        int number = 0;
+        while (std::getline(file, line))
+        {
+            number++;
+            size_t rest;
+            if (root && !definesWritten && startsWith(line, "#version", rest))
+            {
+                code += line + "\n";
+                writeDefines();
+                code += "#line " + std::to_string(number + 1) + " " + std::to_string(index) + "\n";
+            }
+            else if (startsWith(line, "#include", rest))
+            {
+                size_t open = line.find('"', rest), close = open == std::string::npos ? open : line.find('"', open + 1);
+                if (close == std::string::npos)
+                {
+                    std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << ":" << number << std::endl;
+                    ok = false;
+                    continue;
+                }
+                std::string included = normalize((std::filesystem::path(path).parent_path() / line.substr(open + 1, close - open - 1)).string());
+                bool seen = false;
+                for (const std::string& known : files)
+                    seen = seen || known == included;
+                for (const std::string& parent : stack)
+                {
+                    if (parent == included)
+                    {
+                        std::cout << "ERROR::SHADER::INCLUDE_CYCLE: " << path << " includes " << included << std::endl;
+                        ok = false;
+                    }
+                }
+                if (!seen)
+                {
+                    if (root && !definesWritten)
+                        writeDefines();
+                    append(included, defines, stack);
+                    code += "#line " + std::to_string(number + 1) + " " + std::to_string(index) + "\n";
+                }
+            }
+            else
+                code += line + "\n";
+        }
+        if (root && !definesWritten)
+        {
+            // no #version: the defines still have to come first
+            std::string body;
+            body.swap(code);
+            writeDefines();
+            code += "#line 1 0\n" + body;
+        }
+        stack.pop_back();
+    }
+};
+#endif
@@ -0,0 +1,78 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <shader_m.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// features a shader source can be compiled with; each bit becomes a #define of the same name
+enum ShaderVariant : unsigned int {
+    VARIANT_INSTANCED = 1 << 0, // per-draw data from instanced attributes 7..13 instead of uniforms
+    VARIANT_ATLAS     = 1 << 1, // diffuse comes from the atlas texture array
+    VARIANT_LOG_DEPTH = 1 << 2, // logarithmic depth, for view distances the 24-bit buffer can't cover
+    VARIANT_PBR       = 1 << 3  // metal/roughness shading lit by the sun and the sky (environment_lighting.h)
+};
+// how many VARIANT_ bits there are; kept out of the enum so it can't be mistaken for a flag
+static constexpr unsigned int VARIANT_BITS = 4;
+
+// One vertex/fragment source pair compiled into whichever permutations are asked for.
+// Get(mask) builds the permutation the first time it is needed and returns the same Shader after
+// that; the references stay valid for the lifetime of the ShaderVariants. 'setup' runs once per new
+// permutation, e.g. to attach uniform blocks and set sampler units, and again whenever it is rebuilt.
+class ShaderVariants
+{
+public:
+    typedef std::function<void(Shader&, unsigned int mask)> Setup;
+
+    ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath, Setup setup = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), setup(setup)
+    {
+    }
+
+    Shader& Get(unsigned int mask)
+    {
+        auto it = variants.find(mask);
+        if (it != variants.end())
+            return *it->second;
+        std::unique_ptr<Shader> shader(new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, Defines(mask)));
+        if (setup)
+        {
+            Setup variantSetup = setup;
+            shader->Setup = [variantSetup, mask](Shader& rebuilt) { variantSetup(rebuilt, mask); };
+            shader->Setup(*shader);
+        }
+        return *(variants[mask] = std::move(shader));
+    }
+
+    // the #defines a mask turns into
+    static std::vector<std::string> Defines(unsigned int mask)
+    {
+        static const char* names[VARIANT_BITS] = { "INSTANCED", "ATLAS", "LOG_DEPTH", "PBR" };
+        std::vector<std::string> defines;
+        for (unsigned int bit = 0; bit < VARIANT_BITS; bit++)
+            if (mask & (1u << bit))
+                defines.push_back(names[bit]);
+        return defines;
+    }
+
+    size_t Count() const { return variants.size(); }
+
+    // every permutation built so far
+    std::vector<Shader*> All() const
+    {
+        std::vector<Shader*> all;
+        for (auto& it : variants)
+            all.push_back(it.second.get());
+        return all;
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    Setup setup;
+    std::unordered_map<unsigned int, std::unique_ptr<Shader>> variants;
+};
+#endif
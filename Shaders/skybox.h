@@ -0,0 +1,353 @@
+#ifndef SKYBOX_H
+#define SKYBOX_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+#include <gtc/constants.hpp>
+#include <stb_image.h>
+
+#include <disk_cache.h>
+#include <gl_state.h>
+#include <memory_usage.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The sky cubemap, loaded either from six face images or from one equirectangular panorama.
+// Faces are read and decoded in parallel, one worker each. A panorama is resampled into six faces
+// on all cores and the result is cached on disk (texture_cache/ by default), keyed by the source's
+// size and modification time, so later starts only read the raw faces back. Every stage is
+// timed (GetTiming) so startup reports can show where the time went.
+class Skybox
+{
+public:
+    struct Timing {
+        double readMs = 0.0;      // reading the source files
+        double decodeMs = 0.0;    // JPEG/PNG decoding; for parallel faces the wall clock of the workers less the slowest read
+        double resampleMs = 0.0;  // panorama to faces
+        double cacheMs = 0.0;     // reading or writing the cached faces
+        double uploadMs = 0.0;    // glTexImage2D and the mipmaps
+        bool cacheHit = false;
+        int faceSize = 0;
+    };
+
+    unsigned int ID = 0;
+
+    Skybox() {}
+    Skybox(const Skybox&) = delete;
+    Skybox& operator=(const Skybox&) = delete;
+
+    // +X, -X, +Y, -Y, +Z, -Z, the GL face order; faces that don't load are left black, and with no
+    // face at all there is no cubemap
+    bool LoadFaces(const std::vector<std::string>& faces)
+    {
+        timing = Timing();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::future<Image>> workers;
+        for (const std::string& face : faces)
+            workers.push_back(std::async(std::launch::async, [face]() { return decode(face); }));
+        std::vector<Image> images;
+        for (auto& worker : workers)
+            images.push_back(worker.get());
+        for (const Image& image : images)
+            timing.readMs = std::max(timing.readMs, image.readMs);
+        timing.decodeMs = DiskCache::ElapsedMs(start) - timing.readMs;
+
+        bool complete = images.size() == 6;
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            if (images[i].pixels.empty())
+            {
+                std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+                complete = false;
+            }
+            else if (!timing.faceSize)
+                timing.faceSize = images[i].width;
+        }
+        if (!timing.faceSize)
+        {
+            std::cout << "ERROR::SKYBOX::NO_FACE_LOADED" << std::endl;
+            return false;
+        }
+        upload(images);
+        return complete;
+    }
+
+    // converts an equirectangular panorama (longitude along x, +y up at the top row) into faces of
+    // width / 4 texels, or reads them from 'cacheDirectory' if this panorama was converted before
+    bool LoadEquirect(const std::string& path, const std::string& cacheDirectory = "texture_cache")
+    {
+        timing = Timing();
+        CacheHeader expected;
+        if (!DiskCache::Describe(path, CACHE_MAGIC, CACHE_VERSION, expected.key))
+        {
+            std::cout << "ERROR::SKYBOX::FILE_NOT_FOUND: " << path << std::endl;
+            return false;
+        }
+        std::string cachePath = cacheDirectory + "/" + std::filesystem::path(path).stem().string() + ".cube";
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Image> faces;
+        if (readCache(cachePath, expected, faces))
+        {
+            timing.cacheMs = DiskCache::ElapsedMs(start);
+            timing.cacheHit = true;
+        }
+        else
+        {
+            Image panorama = decode(path);
+            timing.readMs = panorama.readMs;
+            timing.decodeMs = DiskCache::ElapsedMs(start) - panorama.readMs;
+            if (panorama.pixels.empty())
+            {
+                std::cout << "ERROR::SKYBOX::DECODE_FAILED: " << path << std::endl;
+                return false;
+            }
+            start = std::chrono::steady_clock::now();
+            faces = resample(panorama, std::max(panorama.width / 4, 1));
+            timing.resampleMs = DiskCache::ElapsedMs(start);
+            start = std::chrono::steady_clock::now();
+            expected.faceSize = faces[0].width;
+            expected.components = faces[0].components;
+            writeCache(cachePath, expected, faces);
+            timing.cacheMs = DiskCache::ElapsedMs(start);
+        }
+        timing.faceSize = faces[0].width;
+        upload(faces);
+        return true;
+    }
+
+    const Timing& GetTiming() const { return timing; }
+
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        usage.cpuBytes = sizeof(Skybox);
+        usage.gpuBytes = gpuBytes;
+        return usage;
+    }
+
+    // frees the texture; call while the context is still current
+    void Delete()
+    {
+        if (ID)
+        {
+            glDeleteTextures(1, &ID);
+            GLState::Get().TextureDeleted(ID);
+        }
+        ID = 0;
+        gpuBytes = 0;
+    }
+
+private:
+    static const uint32_t CACHE_MAGIC = 0x45425543; // "CUBE"
+    static const uint32_t CACHE_VERSION = 2;
+
+    struct Image {
+        int width = 0, height = 0, components = 0;
+        std::vector<unsigned char> pixels;
+        double readMs = 0.0;
+    };
+    struct CacheHeader {
+        DiskCache::Header key;     // keyed by the panorama the faces came from
+        int32_t faceSize = 0;
+        int32_t components = 0;
+    };
+
+    Timing timing;
+    size_t gpuBytes = 0;
+
+    // worker thread: file into memory, then stb_image; the image keeps the file's channel count
+    static Image decode(const std::string& path)
+    {
+        Image image;
+        auto start = std::chrono::steady_clock::now();
+        std::ifstream file(path, std::ios::binary);
+        std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        image.readMs = DiskCache::ElapsedMs(start);
+        if (bytes.empty())
+            return image;
+        unsigned char* data = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &image.width, &image.height, &image.components, 0);
+        if (data)
+        {
+            image.pixels.assign(data, data + static_cast<size_t>(image.width) * image.height * image.components);
+            stbi_image_free(data);
+        }
+        return image;
+    }
+
+    // direction through texel (x, y) of cube face 'face', in GL's cubemap orientation
+    static glm::vec3 faceDirection(int face, float u, float v)
+    {
+        switch (face)
+        {
+        case 0: return glm::vec3(1.0f, -v, -u);
+        case 1: return glm::vec3(-1.0f, -v, u);
+        case 2: return glm::vec3(u, 1.0f, v);
+        case 3: return glm::vec3(u, -1.0f, -v);
+        case 4: return glm::vec3(u, -v, 1.0f);
+        default: return glm::vec3(-u, -v, -1.0f);
+        }
+    }
+
+    // atan2 to within 2e-4 radians (about a tenth of a texel on panoramas a few thousand texels wide)
+    // at a fraction of the cost of std::atan2
+    static float fastAtan2(float y, float x)
+    {
+        float ax = std::abs(x), ay = std::abs(y);
+        float a = std::min(ax, ay) / std::max(std::max(ax, ay), 1e-30f);
+        float s = a * a;
+        float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+        if (ay > ax)
+            r = glm::half_pi<float>() - r;
+        if (x < 0.0f)
+            r = glm::pi<float>() - r;
+        return y < 0.0f ? -r : r;
+    }
+
+    // bilinear lookups into the panorama for every face texel; the 6 * size rows are split into
+    // bands, one per core. Longitude wraps, latitude clamps at the poles.
+    static std::vector<Image> resample(const Image& panorama, int size)
+    {
+        std::vector<Image> faces(6);
+        for (Image& face : faces)
+        {
+            face.width = face.height = size;
+            face.components = panorama.components;
+            face.pixels.resize(static_cast<size_t>(size) * size * panorama.components);
+        }
+        int rows = 6 * size;
+        int bands = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::future<void>> workers;
+        for (int band = 0; band < bands; band++)
+        {
+            int first = rows * band / bands, last = rows * (band + 1) / bands;
+            workers.push_back(std::async(std::launch::async, [&panorama, &faces, size, first, last]() {
+                const int channels = panorama.components;
+                const float width = float(panorama.width), height = float(panorama.height);
+                for (int row = first; row < last; row++)
+                {
+                    int face = row / size, y = row % size;
+                    unsigned char* out = faces[face].pixels.data() + static_cast<size_t>(y) * size * channels;
+                    float v = (y + 0.5f) / size * 2.0f - 1.0f;
+                    for (int x = 0; x < size; x++)
+                    {
+                        // both angles from atan2, which doesn't need the direction normalized
+                        glm::vec3 direction = faceDirection(face, (x + 0.5f) / size * 2.0f - 1.0f, v);
+                        float px = (0.5f + fastAtan2(direction.z, direction.x) / glm::two_pi<float>()) * width - 0.5f;
+                        float py = fastAtan2(std::sqrt(direction.x * direction.x + direction.z * direction.z), direction.y) / glm::pi<float>() * height - 0.5f;
+                        float fx = std::floor(px), fy = std::floor(py);
+                        float tx = px - fx, ty = py - fy;
+                        int x0 = int(fx), x1 = x0 + 1; // px is within [-0.5, width - 0.5], so one wrap at most
+                        if (x0 < 0)
+                            x0 += panorama.width;
+                        if (x1 >= panorama.width)
+                            x1 -= panorama.width;
+                        int y0 = glm::clamp(int(fy), 0, panorama.height - 1), y1 = glm::min(y0 + 1, panorama.height - 1);
+                        if (fy < 0.0f)
+                            y1 = y0;
+                        const unsigned char* a = panorama.pixels.data() + (static_cast<size_t>(y0) * panorama.width + x0) * channels;
+                        const unsigned char* b = panorama.pixels.data() + (static_cast<size_t>(y0) * panorama.width + x1) * channels;
+                        const unsigned char* c = panorama.pixels.data() + (static_cast<size_t>(y1) * panorama.width + x0) * channels;
+                        const unsigned char* d = panorama.pixels.data() + (static_cast<size_t>(y1) * panorama.width + x1) * channels;
+                        for (int k = 0; k < channels; k++)
+                        {
+                            float top = a[k] + (b[k] - a[k]) * tx, bottom = c[k] + (d[k] - c[k]) * tx;
+                            out[x * channels + k] = static_cast<unsigned char>(top + (bottom - top) * ty + 0.5f);
+                        }
+                    }
+                }
+            }));
+        }
+        for (auto& worker : workers)
+            worker.wait();
+        return faces;
+    }
+
+    static bool readCache(const std::string& path, const CacheHeader& expected, std::vector<Image>& faces)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        CacheHeader header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || !DiskCache::Matches(header.key, expected.key) || header.faceSize <= 0 || header.components <= 0 || header.components > 4)
+            return false;
+        faces.assign(6, Image());
+        for (Image& face : faces)
+        {
+            face.width = face.height = header.faceSize;
+            face.components = header.components;
+            face.pixels.resize(static_cast<size_t>(header.faceSize) * header.faceSize * header.components);
+            file.read(reinterpret_cast<char*>(face.pixels.data()), face.pixels.size());
+        }
+        if (!file)
+        {
+            faces.clear();
+            return false;
+        }
+        return true;
+    }
+
+    static void writeCache(const std::string& path, const CacheHeader& header, const std::vector<Image>& faces)
+    {
+        DiskCache::Write(path, "SKYBOX", [&](std::ofstream& file) {
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const Image& face : faces)
+                file.write(reinterpret_cast<const char*>(face.pixels.data()), face.pixels.size());
+        });
+    }
+
+    void upload(const std::vector<Image>& faces)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Delete();
+        glGenTextures(1, &ID);
+        GLState::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, ID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of 3-channel faces are not 4-byte aligned
+        int size = timing.faceSize;
+        // every face needs the same size and format for the cubemap to be complete; the first face
+        // that loaded sets both, and a face that failed (or doesn't match) is left black in that format
+        int components = 0;
+        for (const Image& face : faces)
+        {
+            if (!face.pixels.empty() && face.width == size && face.height == size)
+            {
+                components = face.components;
+                break;
+            }
+        }
+        GLenum format = components == 1 ? GL_RED : components == 2 ? GL_RG : components == 4 ? GL_RGBA : GL_RGB;
+        std::vector<unsigned char> black;
+        for (size_t i = 0; i < 6; i++)
+        {
+            const Image* face = i < faces.size() ? &faces[i] : nullptr;
+            bool usable = face && !face->pixels.empty() && face->width == size && face->height == size && face->components == components;
+            if (!usable && black.empty())
+                black.resize(static_cast<size_t>(size) * size * components);
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(i), 0, format, size, size, 0, format, GL_UNSIGNED_BYTE,
+                         usable ? face->pixels.data() : black.data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        gpuBytes = static_cast<size_t>(6) * size * size * components * 4 / 3; // the mip chain adds a third
+        timing.uploadMs = DiskCache::ElapsedMs(start);
+    }
+};
+#endif
@@ -0,0 +1,310 @@
+#ifndef SPHERE_MESH_H
+#define SPHERE_MESH_H
+
+#include <glm.hpp>
+#include <gtc/constants.hpp>
+
+#include <geometry_pool.h>
+#include <memory_usage.h>
+#include <mesh.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+enum SphereKind {
+    SPHERE_ICOSPHERE, // subdivided icosahedron: the most even triangles
+    SPHERE_QUAD,      // subdivided cube pushed out to the sphere: a regular grid per face
+    SPHERE_KIND_COUNT
+};
+
+// Unit spheres generated in code, for the bodies that used to load the same sphere .obj each.
+// Positions double as normals; texture coordinates are the equirectangular mapping of the planet
+// maps (u = longitude, v = 0 at the north pole, as the .obj spheres had after aiProcess_FlipUVs)
+// with the vertices along the u = 0/1 seam and at the poles split so that no triangle wraps around
+// the texture. Tangent and bitangent follow u and v. Vertices are stored in the order the indices
+// first use them, so neighbouring triangles fetch neighbouring vertices.
+class SphereMesh
+{
+public:
+    // 'subdivisions' halvings of the icosahedron's edges: 20 * 4^n triangles
+    static void Icosphere(int subdivisions, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+        std::vector<glm::vec3> positions = {
+            { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 }, { 0, -1, t }, { 0, 1, t },
+            { 0, -1, -t }, { 0, 1, -t }, { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+        };
+        for (glm::vec3& position : positions)
+            position = glm::normalize(position);
+        std::vector<unsigned int> faces = {
+            0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+            3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+        };
+        for (int level = 0; level < subdivisions; level++)
+        {
+            // each edge is split once, whichever of its two triangles gets there first
+            std::unordered_map<uint64_t, unsigned int> midpoints;
+            auto midpoint = [&](unsigned int a, unsigned int b) {
+                uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+                auto it = midpoints.find(key);
+                if (it != midpoints.end())
+                    return it->second;
+                positions.push_back(glm::normalize(positions[a] + positions[b]));
+                return midpoints[key] = static_cast<unsigned int>(positions.size() - 1);
+            };
+            std::vector<unsigned int> finer;
+            finer.reserve(faces.size() * 4);
+            for (size_t i = 0; i < faces.size(); i += 3)
+            {
+                unsigned int a = faces[i], b = faces[i + 1], c = faces[i + 2];
+                unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+                finer.insert(finer.end(), { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca });
+            }
+            faces.swap(finer);
+        }
+        finish(positions, faces, vertices, indices);
+    }
+
+    // a cube with 'segments' x 'segments' quads per face, each point moved onto the sphere so that the
+    // cells stay close to the same size: 12 * segments^2 triangles
+    static void QuadSphere(int segments, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> faces;
+        // grid points on shared cube edges are generated once per face; 'finish' only splits by UV,
+        // so edge points are merged here through their cube position
+        std::unordered_map<uint64_t, unsigned int> shared;
+        for (int face = 0; face < 6; face++)
+        {
+            std::vector<unsigned int> grid((segments + 1) * (segments + 1));
+            for (int j = 0; j <= segments; j++)
+            {
+                for (int i = 0; i <= segments; i++)
+                {
+                    glm::vec3 p = CubePoint(face, 2.0f * i / segments - 1.0f, 2.0f * j / segments - 1.0f);
+                    // integer cube coordinates identify the points along the edges that faces share
+                    glm::ivec3 cell = glm::ivec3(glm::round((p + 1.0f) * (segments * 0.5f)));
+                    uint64_t key = (uint64_t(cell.x) << 42) | (uint64_t(cell.y) << 21) | uint64_t(cell.z);
+                    auto it = shared.find(key);
+                    if (it != shared.end())
+                    {
+                        grid[j * (segments + 1) + i] = it->second;
+                        continue;
+                    }
+                    positions.push_back(CubeToSphere(p));
+                    grid[j * (segments + 1) + i] = shared[key] = static_cast<unsigned int>(positions.size() - 1);
+                }
+            }
+            for (int j = 0; j < segments; j++)
+            {
+                for (int i = 0; i < segments; i++)
+                {
+                    unsigned int a = grid[j * (segments + 1) + i], b = grid[j * (segments + 1) + i + 1];
+                    unsigned int c = grid[(j + 1) * (segments + 1) + i], d = grid[(j + 1) * (segments + 1) + i + 1];
+                    faces.insert(faces.end(), { a, b, d, a, d, c });
+                }
+            }
+        }
+        finish(positions, faces, vertices, indices);
+    }
+
+    // point (s, t) in [-1, 1]^2 on cube face 'face' (+x, -x, +y, -y, +z, -z); s and t run along two
+    // face axes chosen so that s x t points out of the cube
+    static glm::vec3 CubePoint(int face, float s, float t)
+    {
+        static const glm::vec3 normals[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+        static const glm::vec3 rights[6] = { { 0, 0, -1 }, { 0, 0, 1 }, { 1, 0, 0 }, { 1, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 } };
+        return normals[face] + rights[face] * s + glm::cross(normals[face], rights[face]) * t;
+    }
+
+    // moves a point of the [-1, 1] cube onto the unit sphere, spreading the cells more evenly than normalize()
+    static glm::vec3 CubeToSphere(const glm::vec3& p)
+    {
+        glm::vec3 p2 = p * p;
+        return glm::vec3(p.x * std::sqrt(1.0f - p2.y * 0.5f - p2.z * 0.5f + p2.y * p2.z / 3.0f),
+                         p.y * std::sqrt(1.0f - p2.z * 0.5f - p2.x * 0.5f + p2.z * p2.x / 3.0f),
+                         p.z * std::sqrt(1.0f - p2.x * 0.5f - p2.y * 0.5f + p2.x * p2.y / 3.0f));
+    }
+
+    // equirectangular texture coordinates of a point on the unit sphere (u wraps at the -x meridian)
+    static glm::vec2 SphereUV(const glm::vec3& p)
+    {
+        const float pi = glm::pi<float>();
+        float u = std::atan2(-p.z, p.x) / (2.0f * pi) + 0.5f;
+        return glm::vec2(u - std::floor(u), std::acos(glm::clamp(p.y, -1.0f, 1.0f)) / pi);
+    }
+
+    // unit vector towards growing u (east) at texture coordinate u; defined at the poles too
+    static glm::vec3 SphereTangent(float u)
+    {
+        float longitude = (u - 0.5f) * 2.0f * glm::pi<float>();
+        return glm::vec3(-std::sin(longitude), 0.0f, -std::cos(longitude));
+    }
+
+private:
+    // texture coordinates, seam and pole splits, tangents and vertex order for a unit sphere
+    static void finish(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& faces,
+                       std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        std::vector<glm::vec2> uvs(positions.size());
+        for (size_t i = 0; i < positions.size(); i++)
+            uvs[i] = SphereUV(positions[i]);
+        std::vector<glm::vec3> splitPositions(positions);
+        std::vector<unsigned int> split(faces);
+        std::unordered_map<unsigned int, unsigned int> wrapped; // vertex -> its copy at u + 1
+        auto isPole = [&](unsigned int v) { return std::fabs(splitPositions[v].y) > 0.99999f; };
+        for (size_t i = 0; i < split.size(); i += 3)
+        {
+            unsigned int* tri = &split[i];
+            // a triangle across the seam has u near 0 and near 1: lift the small ones past 1
+            float low = 1.0f, high = 0.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                if (isPole(tri[k]))
+                    continue;
+                low = std::min(low, uvs[tri[k]].x);
+                high = std::max(high, uvs[tri[k]].x);
+            }
+            if (high - low > 0.5f)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    if (isPole(tri[k]) || uvs[tri[k]].x >= 0.5f)
+                        continue;
+                    auto it = wrapped.find(tri[k]);
+                    if (it == wrapped.end())
+                    {
+                        splitPositions.push_back(positions[tri[k]]);
+                        uvs.push_back(uvs[tri[k]] + glm::vec2(1.0f, 0.0f));
+                        it = wrapped.emplace(tri[k], static_cast<unsigned int>(splitPositions.size() - 1)).first;
+                    }
+                    tri[k] = it->second;
+                }
+            }
+            // a pole has no longitude: each triangle gets its own copy, halfway between the other two
+            for (int k = 0; k < 3; k++)
+            {
+                if (!isPole(tri[k]))
+                    continue;
+                float u = 0.0f;
+                int others = 0;
+                for (int o = 0; o < 3; o++)
+                {
+                    if (o != k && !isPole(tri[o]))
+                    {
+                        u += uvs[tri[o]].x;
+                        others++;
+                    }
+                }
+                splitPositions.push_back(positions[tri[k]]);
+                uvs.push_back(glm::vec2(others ? u / others : 0.5f, uvs[tri[k]].y));
+                tri[k] = static_cast<unsigned int>(splitPositions.size() - 1);
+            }
+        }
+
+        // renumber the vertices in first-use order
+        std::vector<unsigned int> remap(splitPositions.size(), ~0u);
+        vertices.clear();
+        indices.clear();
+        vertices.reserve(splitPositions.size());
+        indices.reserve(split.size());
+        for (unsigned int v : split)
+        {
+            if (remap[v] == ~0u)
+            {
+                remap[v] = static_cast<unsigned int>(vertices.size());
+                Vertex vertex = {};
+                vertex.Position = splitPositions[v];
+                vertex.Normal = splitPositions[v];
+                vertex.TexCoords = uvs[v];
+                // u runs east and v south; the tangent comes from u so the poles get one too
+                vertex.Tangent = SphereTangent(uvs[v].x);
+                vertex.Bitangent = glm::cross(vertex.Tangent, vertex.Normal);
+                vertices.push_back(vertex);
+            }
+            indices.push_back(remap[v]);
+        }
+    }
+};
+
+// The sphere meshes every spherical body draws from: one LOD chain per SphereKind, built and put in
+// the GeometryPool the first time it is asked for (so a GL context must be current by then). Bodies
+// share the chain through Mesh's geometry-sharing constructor, so their pool ranges are the same and
+// only their textures differ.
+class SphereLibrary
+{
+public:
+    static const int LOD_COUNT = 4;
+
+    struct Stats {
+        unsigned int triangles = 0; // all levels of all kinds built
+        double milliseconds = 0.0;  // generation and upload
+    };
+
+    static SphereLibrary& Get()
+    {
+        static SphereLibrary instance;
+        return instance;
+    }
+
+    // level 0 of 'kind' with the coarser levels in Mesh::lods
+    const Mesh& Sphere(SphereKind kind)
+    {
+        if (!spheres[kind])
+            build(kind);
+        return *spheres[kind];
+    }
+
+    // geometry of every kind built so far
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        for (const std::unique_ptr<Mesh>& sphere : spheres)
+            if (sphere)
+                usage += sphere->Memory();
+        return usage;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    std::unique_ptr<Mesh> spheres[SPHERE_KIND_COUNT];
+    Stats stats;
+
+    SphereLibrary() {}
+
+    void build(SphereKind kind)
+    {
+        auto start = std::chrono::steady_clock::now();
+        // finest first. The switch distances, in bounding radii, keep the silhouette within about a
+        // quarter of a pixel of the true sphere on the 1000x800, 45 degree view
+        static const int icosphereLevels[LOD_COUNT] = { 5, 4, 3, 2 };
+        static const int quadSegments[LOD_COUNT] = { 32, 16, 8, 4 };
+        static const float switchDistances[LOD_COUNT - 1] = { 4.0f, 16.0f, 64.0f };
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        for (int level = 0; level < LOD_COUNT; level++)
+        {
+            if (kind == SPHERE_ICOSPHERE)
+                SphereMesh::Icosphere(icosphereLevels[level], vertices, indices);
+            else
+                SphereMesh::QuadSphere(quadSegments[level], vertices, indices);
+            stats.triangles += static_cast<unsigned int>(indices.size() / 3);
+            if (level == 0)
+            {
+                spheres[kind].reset(new Mesh(std::move(vertices), std::move(indices), vector<Texture>()));
+                vertices.clear();
+                indices.clear();
+                continue;
+            }
+            spheres[kind]->lods.push_back(GeometryPool::Get().Allocate(vertices.data(), vertices.size(), indices.data(), indices.size()));
+            spheres[kind]->lodDistances.push_back(switchDistances[level - 1]);
+        }
+        stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+#endif
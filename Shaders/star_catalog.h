@@ -0,0 +1,443 @@
+#ifndef STAR_CATALOG_H
+#define STAR_CATALOG_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+#include <gtc/constants.hpp>
+
+#include <gl_state.h>
+#include <gpu_culling.h>
+#include <memory_usage.h>
+#include <shader_m.h>
+#include <sphere_mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// One star as stored in a catalog file and, unchanged, in the vertex buffer (12 bytes).
+struct StarRecord {
+    int16_t direction[3]; // unit direction towards the star, times 32767
+    int16_t magnitude;    // apparent magnitude, times 1000
+    uint8_t color[4];     // colour of the star's temperature, brightest channel 255; alpha unused
+};
+static_assert(sizeof(StarRecord) == 12, "StarRecord is written to disk as is");
+
+// Background stars drawn as point sprites from a catalog, rather than baked into the skybox.
+// The stars are indexed by direction: each face of a cube around the viewer is cut into
+// FACE_CELLS x FACE_CELLS cells, and each cell's stars are stored together, brightest first, with a
+// count of how many are brighter than every whole magnitude. Drawing tests the cells against the
+// frustum and draws, for each visible cell, just the stars up to the limiting magnitude: one
+// glMultiDrawArrays over a single static buffer.
+// Sprite sizes are angles and faint sprites spread their light over at least a couple of pixels,
+// so a star looks the same at any resolution.
+//
+// Catalog files are built offline (Write, e.g. from a CSV through ReadCsv) and hold the index as well:
+//   header, cellStart[CELLS + 1], cellBright[CELLS][MAG_BINS], StarRecord[count]
+class StarCatalog
+{
+public:
+    static const int FACE_CELLS = 16;                  // cells along a cube face edge
+    static const int CELLS = 6 * FACE_CELLS * FACE_CELLS;
+    static const int MAG_BINS = 16;                    // cellBright[b]: stars brighter than MAG_MIN + b + 1
+    static constexpr float MAG_MIN = -2.0f;
+
+    struct Stats {
+        unsigned int stars = 0;        // in the catalog
+        unsigned int cells = 0;        // cells drawn last frame
+        unsigned int drawn = 0;        // stars submitted last frame
+    };
+
+    StarCatalog() {}
+    StarCatalog(const StarCatalog&) = delete;
+    StarCatalog& operator=(const StarCatalog&) = delete;
+
+    // reads a catalog file written by Write() and uploads it; false (nothing loaded) if it is unreadable
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::STAR_CATALOG::FILE_NOT_FOUND: " << path << std::endl;
+            return false;
+        }
+        Header header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.magic != MAGIC || header.version != VERSION || header.faceCells != FACE_CELLS || header.magBins != MAG_BINS)
+        {
+            std::cout << "ERROR::STAR_CATALOG::BAD_HEADER: " << path << std::endl;
+            return false;
+        }
+        std::vector<uint32_t> starts(CELLS + 1), bright(CELLS * MAG_BINS);
+        std::vector<StarRecord> stars(header.count);
+        file.read(reinterpret_cast<char*>(starts.data()), starts.size() * sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(bright.data()), bright.size() * sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(stars.data()), stars.size() * sizeof(StarRecord));
+        if (!file || starts[CELLS] != header.count)
+        {
+            std::cout << "ERROR::STAR_CATALOG::TRUNCATED: " << path << std::endl;
+            return false;
+        }
+        upload(stars, starts, bright);
+        return true;
+    }
+
+    // indexes and uploads stars held in memory, e.g. from Generate()
+    void Build(std::vector<StarRecord> stars)
+    {
+        std::vector<uint32_t> starts, bright;
+        index(stars, starts, bright);
+        upload(stars, starts, bright);
+    }
+
+    // draws the stars up to 'limitingMagnitude' with 'shader' (src/stars.vs); 'skyViewProjection' is
+    // the projection times the view without translation. Expects depth writes off and additive blending.
+    void Draw(Shader& shader, const glm::mat4& skyViewProjection, float viewportHeight, float fovY, float limitingMagnitude)
+    {
+        stats.cells = stats.drawn = 0;
+        if (!VAO)
+            return;
+        // the stars are at infinity, so only the side planes matter (far would reject them all), and
+        // a cell is in front of a plane through the viewer if some direction of its cone is
+        std::vector<glm::vec4> planes = GpuCulling::FrustumPlanes(skyViewProjection);
+        int bin = glm::clamp(int(std::ceil(limitingMagnitude - MAG_MIN)) - 1, 0, MAG_BINS - 1); // first bin reaching the limit
+        firsts.clear();
+        counts.clear();
+        for (int cell = 0; cell < CELLS; cell++)
+        {
+            GLsizei count = static_cast<GLsizei>(cellBright[cell * MAG_BINS + bin]);
+            if (count == 0)
+                continue;
+            bool inside = true;
+            for (int plane = 0; plane < 4 && inside; plane++)
+                inside = glm::dot(glm::vec3(planes[plane]), cones[cell].centre) >= -cones[cell].sine;
+            if (!inside)
+                continue;
+            firsts.push_back(static_cast<GLint>(cellStart[cell]));
+            counts.push_back(count);
+            stats.drawn += count;
+        }
+        stats.cells = static_cast<unsigned int>(firsts.size());
+        if (firsts.empty())
+            return;
+
+        shader.use();
+        shader.setFloat("limitingMagnitude", limitingMagnitude);
+        shader.setFloat("pixelsPerRadian", viewportHeight / (2.0f * std::tan(fovY * 0.5f)));
+        GLState::Get().BindVertexArray(VAO);
+        glMultiDrawArrays(GL_POINTS, firsts.data(), counts.data(), static_cast<GLsizei>(firsts.size()));
+    }
+
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        usage.gpuBytes = stats.stars * sizeof(StarRecord);
+        usage.cpuBytes = sizeof(StarCatalog) + (cellStart.capacity() + cellBright.capacity()) * sizeof(uint32_t) + cones.capacity() * sizeof(Cone)
+                       + (firsts.capacity() + counts.capacity()) * sizeof(GLint);
+        return usage;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+    // frees the buffer; call while the context is still current
+    void Delete()
+    {
+        if (VAO)
+        {
+            glDeleteVertexArrays(1, &VAO);
+            GLState::Get().VertexArrayDeleted(VAO);
+            glDeleteBuffers(1, &VBO);
+            GLState::Get().BufferDeleted(VBO);
+            VAO = VBO = 0;
+        }
+        stats.stars = 0;
+    }
+
+    // sorts 'stars' into the cell index and writes a catalog file
+    static bool Write(const std::string& path, std::vector<StarRecord> stars)
+    {
+        std::vector<uint32_t> starts, bright;
+        index(stars, starts, bright);
+        Header header;
+        header.count = static_cast<uint32_t>(stars.size());
+        std::error_code error;
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty())
+            std::filesystem::create_directories(parent, error);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(starts.data()), starts.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(bright.data()), bright.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(stars.data()), stars.size() * sizeof(StarRecord));
+        if (!file)
+        {
+            std::cout << "ERROR::STAR_CATALOG::WRITE_FAILED: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // reads a CSV with a header row naming at least the columns ra and dec (degrees) and mag; an
+    // optional ci column is the B-V colour index. Rows that don't parse are skipped.
+    static bool ReadCsv(const std::string& path, std::vector<StarRecord>& stars)
+    {
+        std::ifstream file(path);
+        std::string line;
+        if (!file || !std::getline(file, line))
+        {
+            std::cout << "ERROR::STAR_CATALOG::FILE_NOT_FOUND: " << path << std::endl;
+            return false;
+        }
+        std::vector<std::string> names = splitCsv(line);
+        auto column = [&names](const char* name) {
+            auto it = std::find(names.begin(), names.end(), name);
+            return it == names.end() ? -1 : int(it - names.begin());
+        };
+        int ra = column("ra"), dec = column("dec"), mag = column("mag"), ci = column("ci");
+        if (ra < 0 || dec < 0 || mag < 0)
+        {
+            std::cout << "ERROR::STAR_CATALOG::MISSING_COLUMNS: " << path << " needs ra, dec and mag" << std::endl;
+            return false;
+        }
+        int needed = std::max(ra, std::max(dec, mag));
+        while (std::getline(file, line))
+        {
+            std::vector<std::string> fields = splitCsv(line);
+            if (int(fields.size()) <= needed)
+                continue;
+            try
+            {
+                float colorIndex = ci >= 0 && ci < int(fields.size()) && !fields[ci].empty() ? std::stof(fields[ci]) : 0.65f;
+                stars.push_back(makeStar(equatorial(std::stof(fields[ra]), std::stof(fields[dec])), std::stof(fields[mag]), colorIndex));
+            }
+            catch (const std::exception&)
+            {
+                // an empty or non-numeric field; the star is left out
+            }
+        }
+        return true;
+    }
+
+    // a made-up sky of 'count' stars down to about magnitude 12.5: counts grow with magnitude roughly
+    // like the real sky's, part of the fainter stars belong to a thin disc around the galactic plane,
+    // colours follow B-V. Built in fixed chunks on worker threads, so the result only depends on 'seed'.
+    static std::vector<StarRecord> Generate(unsigned int count, unsigned int seed = 1)
+    {
+        const unsigned int CHUNK = 1 << 16;
+        std::vector<StarRecord> stars(count);
+        std::vector<std::future<void>> workers;
+        for (unsigned int first = 0; first < count; first += CHUNK)
+        {
+            workers.push_back(std::async(std::launch::async, [&stars, first, count, seed, CHUNK]() {
+                std::mt19937 random(seed * 7919u + first / CHUNK);
+                std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+                std::normal_distribution<float> colorIndex(0.65f, 0.35f);
+                const glm::vec3 pole = equatorial(192.86f, 27.13f);
+                const glm::vec3 axis = glm::normalize(glm::cross(pole, glm::vec3(0.0f, 1.0f, 0.0f)));
+                const glm::vec3 other = glm::cross(pole, axis);
+                for (unsigned int i = first; i < std::min(first + CHUNK, count); i++)
+                {
+                    // N(< m) grows by 10^0.45 per magnitude up to the faint end
+                    float magnitude = std::max(12.5f + std::log10(std::max(uniform(random), 1e-9f)) / 0.45f, -1.5f);
+                    float height, angle = uniform(random) * glm::two_pi<float>();
+                    if (uniform(random) < 0.6f * glm::clamp(magnitude / 12.5f, 0.0f, 1.0f))
+                    {
+                        // disc star: sine of the galactic latitude falls off exponentially
+                        height = std::min(-0.12f * std::log(std::max(uniform(random), 1e-9f)), 1.0f);
+                        height = uniform(random) < 0.5f ? -height : height;
+                    }
+                    else
+                        height = uniform(random) * 2.0f - 1.0f;
+                    float around = std::sqrt(1.0f - height * height);
+                    glm::vec3 direction = pole * height + (axis * std::cos(angle) + other * std::sin(angle)) * around;
+                    stars[i] = makeStar(direction, magnitude, colorIndex(random));
+                }
+            }));
+        }
+        for (auto& worker : workers)
+            worker.wait();
+        return stars;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x53525453; // "STRS"
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint32_t count = 0;
+        uint32_t faceCells = FACE_CELLS;
+        uint32_t magBins = MAG_BINS;
+    };
+    // a cell as a cone around its centre direction; 'sine' of its angular radius
+    struct Cone {
+        glm::vec3 centre;
+        float sine;
+    };
+
+    unsigned int VAO = 0, VBO = 0;
+    std::vector<uint32_t> cellStart, cellBright;
+    std::vector<Cone> cones;
+    std::vector<GLint> firsts;
+    std::vector<GLsizei> counts;
+    Stats stats;
+
+    void upload(const std::vector<StarRecord>& stars, std::vector<uint32_t>& starts, std::vector<uint32_t>& bright)
+    {
+        Delete();
+        cellStart.swap(starts);
+        cellBright.swap(bright);
+        buildCones();
+        stats.stars = static_cast<unsigned int>(stars.size());
+        if (stars.empty())
+            return;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        GLState::Get().BindVertexArray(VAO);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, stars.size() * sizeof(StarRecord), stars.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(StarRecord), (void*)offsetof(StarRecord, direction));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_SHORT, GL_FALSE, sizeof(StarRecord), (void*)offsetof(StarRecord, magnitude));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StarRecord), (void*)offsetof(StarRecord, color));
+        GLState::Get().BindVertexArray(0);
+    }
+
+    void buildCones()
+    {
+        cones.resize(CELLS);
+        float size = 2.0f / FACE_CELLS;
+        for (int cell = 0; cell < CELLS; cell++)
+        {
+            int face = cell / (FACE_CELLS * FACE_CELLS), x = cell % FACE_CELLS, y = cell / FACE_CELLS % FACE_CELLS;
+            float s = -1.0f + x * size, t = -1.0f + y * size;
+            glm::vec3 centre = glm::normalize(SphereMesh::CubePoint(face, s + size * 0.5f, t + size * 0.5f));
+            float cosine = 1.0f;
+            for (int corner = 0; corner < 4; corner++)
+                cosine = std::min(cosine, glm::dot(centre, glm::normalize(SphereMesh::CubePoint(face, s + (corner & 1) * size, t + (corner >> 1) * size))));
+            cones[cell] = Cone{ centre, std::sqrt(std::max(1.0f - cosine * cosine, 0.0f)) };
+        }
+    }
+
+    // cell of a direction: the cube face it points at, then the gnomonic grid on that face
+    static int cellOf(const glm::vec3& direction)
+    {
+        glm::vec3 a = glm::abs(direction);
+        int face = a.x >= a.y && a.x >= a.z ? (direction.x > 0.0f ? 0 : 1) : a.y >= a.z ? (direction.y > 0.0f ? 2 : 3) : (direction.z > 0.0f ? 4 : 5);
+        glm::vec3 normal = SphereMesh::CubePoint(face, 0.0f, 0.0f);
+        glm::vec3 right = SphereMesh::CubePoint(face, 1.0f, 0.0f) - normal, up = SphereMesh::CubePoint(face, 0.0f, 1.0f) - normal;
+        glm::vec3 p = direction / glm::dot(direction, normal);
+        int x = glm::clamp(int((glm::dot(p, right) + 1.0f) * 0.5f * FACE_CELLS), 0, FACE_CELLS - 1);
+        int y = glm::clamp(int((glm::dot(p, up) + 1.0f) * 0.5f * FACE_CELLS), 0, FACE_CELLS - 1);
+        return (face * FACE_CELLS + y) * FACE_CELLS + x;
+    }
+
+    // groups 'stars' by cell (counting sort), brightest first within a cell, and counts each cell's
+    // stars per magnitude bin
+    static void index(std::vector<StarRecord>& stars, std::vector<uint32_t>& starts, std::vector<uint32_t>& bright)
+    {
+        std::vector<uint32_t> cells(stars.size());
+        starts.assign(CELLS + 1, 0);
+        for (size_t i = 0; i < stars.size(); i++)
+        {
+            cells[i] = cellOf(glm::vec3(stars[i].direction[0], stars[i].direction[1], stars[i].direction[2]));
+            starts[cells[i] + 1]++;
+        }
+        for (int cell = 0; cell < CELLS; cell++)
+            starts[cell + 1] += starts[cell];
+        std::vector<uint32_t> next(starts.begin(), starts.end() - 1);
+        std::vector<StarRecord> sorted(stars.size());
+        for (size_t i = 0; i < stars.size(); i++)
+            sorted[next[cells[i]]++] = stars[i];
+        stars.swap(sorted);
+
+        bright.assign(CELLS * MAG_BINS, 0);
+        for (int cell = 0; cell < CELLS; cell++)
+        {
+            StarRecord* first = stars.data() + starts[cell];
+            StarRecord* last = stars.data() + starts[cell + 1];
+            std::sort(first, last, [](const StarRecord& a, const StarRecord& b) { return a.magnitude < b.magnitude; });
+            for (int bin = 0; bin < MAG_BINS; bin++)
+            {
+                int16_t limit = static_cast<int16_t>((MAG_MIN + bin + 1) * 1000.0f);
+                bright[cell * MAG_BINS + bin] = static_cast<uint32_t>(std::lower_bound(first, last, limit, [](const StarRecord& star, int16_t value) { return star.magnitude < value; }) - first);
+            }
+        }
+    }
+
+    static StarRecord makeStar(const glm::vec3& direction, float magnitude, float colorIndex)
+    {
+        StarRecord star;
+        glm::vec3 unit = glm::normalize(direction);
+        for (int i = 0; i < 3; i++)
+            star.direction[i] = static_cast<int16_t>(std::lround(unit[i] * 32767.0f));
+        star.magnitude = static_cast<int16_t>(std::lround(glm::clamp(magnitude, -30.0f, 30.0f) * 1000.0f));
+        // B-V from -0.4 to 2.0 in 256 steps is finer than the 8-bit colours can show
+        static const std::vector<glm::u8vec3> colors = [] {
+            std::vector<glm::u8vec3> table(256);
+            for (int i = 0; i < 256; i++)
+                table[i] = glm::u8vec3(glm::round(temperatureColor(colorTemperature(-0.4f + i * 2.4f / 255.0f)) * 255.0f));
+            return table;
+        }();
+        glm::u8vec3 color = colors[glm::clamp(int(std::lround((colorIndex + 0.4f) * 255.0f / 2.4f)), 0, 255)];
+        star.color[0] = color.r;
+        star.color[1] = color.g;
+        star.color[2] = color.b;
+        star.color[3] = 255;
+        return star;
+    }
+
+    // right ascension and declination (degrees) to a direction, with +y towards the celestial north pole
+    static glm::vec3 equatorial(float ra, float dec)
+    {
+        float a = glm::radians(ra), d = glm::radians(dec);
+        return glm::vec3(std::cos(d) * std::cos(a), std::sin(d), -std::cos(d) * std::sin(a));
+    }
+
+    // B-V colour index to effective temperature (Ballesteros 2012)
+    static float colorTemperature(float colorIndex)
+    {
+        return 4600.0f * (1.0f / (0.92f * colorIndex + 1.7f) + 1.0f / (0.92f * colorIndex + 0.62f));
+    }
+
+    // rough blackbody colour of 'kelvin' (fit to the CIE colour matching of Planck spectra), scaled so
+    // the brightest channel is 1; the magnitude carries the brightness
+    static glm::vec3 temperatureColor(float kelvin)
+    {
+        float t = glm::clamp(kelvin, 1000.0f, 40000.0f) / 100.0f;
+        glm::vec3 color;
+        color.r = t <= 66.0f ? 255.0f : 329.698727446f * std::pow(t - 60.0f, -0.1332047592f);
+        color.g = t <= 66.0f ? 99.4708025861f * std::log(t) - 161.1195681661f : 288.1221695283f * std::pow(t - 60.0f, -0.0755148492f);
+        color.b = t >= 66.0f ? 255.0f : t <= 19.0f ? 0.0f : 138.5177312231f * std::log(t - 10.0f) - 305.0447927307f;
+        color = glm::clamp(color, 0.0f, 255.0f);
+        return color / std::max(color.r, std::max(color.g, std::max(color.b, 1.0f)));
+    }
+
+    static std::vector<std::string> splitCsv(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ','))
+        {
+            field.erase(0, field.find_first_not_of(" \t\""));
+            field.erase(field.find_last_not_of(" \t\"\r") + 1);
+            fields.push_back(field);
+        }
+        return fields;
+    }
+};
+#endif
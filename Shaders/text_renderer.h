@@ -0,0 +1,452 @@
+#ifndef TEXT_RENDERER_H
+#define TEXT_RENDERER_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+#include <stb_rect_pack.h>
+#include <stb_truetype.h>
+
+#include <disk_cache.h>
+#include <gl_state.h>
+#include <memory_usage.h>
+#include <shader_m.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Screen-space text: the HUD and the body labels.
+// The font's printable ASCII glyphs are turned once into signed distance fields (stb_truetype,
+// glyphs spread over all cores) and packed into one single-channel atlas page, which is cached on
+// disk (texture_cache/ by default) keyed by the font file's size and time. The fragment shader
+// thresholds the distance with a screen-space derivative, so one atlas draws text crisply at any
+// size; labels of every size share the atlas and the upload. Strings added during a frame only
+// append quads to a CPU array; Draw() uploads that array into one dynamic vertex buffer and draws
+// every string of the frame with a single glDrawElements over a shared quad index buffer, so
+// thousands of labels cost one draw. Positions are in pixels from the top left corner of the viewport.
+class TextRenderer
+{
+public:
+    static const int FIRST_CHAR = 32, LAST_CHAR = 126;
+    static const int SDF_SIZE = 40;     // pixel height the distance fields are made at
+    static const int SDF_PADDING = 6;   // texels of distance around each glyph, the widest outline or blur
+    static const int SDF_ON_EDGE = 128; // texel value on the outline; the shader's threshold
+
+    struct Stats {
+        unsigned int quads = 0;       // glyphs drawn last frame
+        unsigned int drawCalls = 0;
+        size_t uploadBytes = 0;       // vertex data uploaded last frame
+    };
+    struct Timing {
+        double generateMs = 0.0;  // distance fields and packing, on a cache miss
+        double cacheMs = 0.0;     // reading or writing the cached atlas
+        bool cacheHit = false;
+        int atlasSize = 0;
+    };
+
+    // 'pixelHeight' is the size Add() draws at with scale 1
+    TextRenderer(const std::string& fontPath, float pixelHeight = 18.0f, const std::string& cacheDirectory = "texture_cache")
+        : pixelHeight(pixelHeight)
+    {
+        auto start = std::chrono::steady_clock::now();
+        CacheHeader expected;
+        if (!DiskCache::Describe(fontPath, CACHE_MAGIC, CACHE_VERSION, expected.key))
+        {
+            std::cout << "ERROR::TEXT::FONT_NOT_LOADED: " << fontPath << std::endl;
+            return;
+        }
+        std::string cachePath = cacheDirectory + "/" + std::filesystem::path(fontPath).stem().string() + ".sdf";
+
+        std::vector<unsigned char> pixels;
+        if (readCache(cachePath, expected, pixels))
+        {
+            timing.cacheMs = DiskCache::ElapsedMs(start);
+            timing.cacheHit = true;
+        }
+        else
+        {
+            if (!generate(fontPath, expected, pixels))
+                return;
+            timing.generateMs = DiskCache::ElapsedMs(start);
+            start = std::chrono::steady_clock::now();
+            writeCache(cachePath, pixels);
+            timing.cacheMs = DiskCache::ElapsedMs(start);
+        }
+        timing.atlasSize = header.atlasSize;
+
+        glGenTextures(1, &atlas);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, atlas);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, header.atlasSize, header.atlasSize, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // no mipmaps: averaging distances blurs the outline, and the padding covers the bilinear footprint
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        GLState::Get().BindVertexArray(VAO);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GlyphVertex), (void*)offsetof(GlyphVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(GlyphVertex), (void*)offsetof(GlyphVertex, uv));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GlyphVertex), (void*)offsetof(GlyphVertex, color));
+        GLState::Get().BindVertexArray(0);
+    }
+
+    ~TextRenderer()
+    {
+        // GL objects are freed in Delete(), while the context still exists
+    }
+
+    TextRenderer(const TextRenderer&) = delete;
+    TextRenderer& operator=(const TextRenderer&) = delete;
+
+    bool Loaded() const { return atlas != 0; }
+    float LineHeight(float scale = 1.0f) const { return header.lineHeight * pixelHeight / SDF_SIZE * scale; }
+    const Timing& GetTiming() const { return timing; }
+
+    // queues 'text' with its top left corner at 'position'; '\n' starts a new line
+    void Add(const std::string& text, glm::vec2 position, glm::vec4 color = glm::vec4(1.0f), float scale = 1.0f)
+    {
+        if (!atlas)
+            return;
+        glm::u8vec4 packed(glm::round(glm::clamp(color, 0.0f, 1.0f) * 255.0f));
+        // glyph metrics are in atlas texels, laid out with y down from the baseline
+        float toPixels = pixelHeight / SDF_SIZE * scale, texel = 1.0f / header.atlasSize;
+        float x = 0.0f, y = header.baseline;
+        for (char c : text)
+        {
+            if (c == '\n')
+            {
+                x = 0.0f;
+                y += header.lineHeight;
+                continue;
+            }
+            const Glyph& glyph = glyphs[glyphIndex(c)];
+            if (glyph.width)
+            {
+                glm::vec2 p0 = position + glm::vec2(x + glyph.xoff, y + glyph.yoff) * toPixels;
+                glm::vec2 p1 = p0 + glm::vec2(glyph.width, glyph.height) * toPixels;
+                glm::vec2 t0 = glm::vec2(glyph.x, glyph.y) * texel, t1 = glm::vec2(glyph.x + glyph.width, glyph.y + glyph.height) * texel;
+                vertices.push_back({ glm::vec2(p0.x, p0.y), glm::vec2(t0.x, t0.y), packed });
+                vertices.push_back({ glm::vec2(p1.x, p0.y), glm::vec2(t1.x, t0.y), packed });
+                vertices.push_back({ glm::vec2(p1.x, p1.y), glm::vec2(t1.x, t1.y), packed });
+                vertices.push_back({ glm::vec2(p0.x, p1.y), glm::vec2(t0.x, t1.y), packed });
+            }
+            x += glyph.advance;
+        }
+    }
+
+    // queues a filled rectangle from 'p0' to 'p1' (pixels); drawn in the same batch as the text
+    void AddRect(glm::vec2 p0, glm::vec2 p1, glm::vec4 color)
+    {
+        if (!atlas)
+            return;
+        glm::u8vec4 packed(glm::round(glm::clamp(color, 0.0f, 1.0f) * 255.0f));
+        glm::vec2 uv = (glm::vec2(header.solidX, header.solidY) + SOLID_SIZE * 0.5f) / static_cast<float>(header.atlasSize);
+        vertices.push_back({ glm::vec2(p0.x, p0.y), uv, packed });
+        vertices.push_back({ glm::vec2(p1.x, p0.y), uv, packed });
+        vertices.push_back({ glm::vec2(p1.x, p1.y), uv, packed });
+        vertices.push_back({ glm::vec2(p0.x, p1.y), uv, packed });
+    }
+
+    // width of the longest line of 'text' in pixels
+    float Measure(const std::string& text, float scale = 1.0f) const
+    {
+        float x = 0.0f, widest = 0.0f;
+        for (char c : text)
+        {
+            if (c == '\n')
+            {
+                widest = glm::max(widest, x);
+                x = 0.0f;
+                continue;
+            }
+            x += glyphs[glyphIndex(c)].advance;
+        }
+        return glm::max(widest, x) * pixelHeight / SDF_SIZE * scale;
+    }
+
+    // queues 'text' centred above the point 'world' projects to, unless it is behind the camera or off
+    // screen; 'viewport' in pixels
+    void AddLabel(const std::string& text, const glm::vec3& world, const glm::mat4& viewProjection, glm::vec2 viewport,
+                  glm::vec4 color = glm::vec4(1.0f), float scale = 1.0f)
+    {
+        glm::vec4 clip = viewProjection * glm::vec4(world, 1.0f);
+        if (clip.w <= 0.0f)
+            return;
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        if (glm::abs(ndc.x) > 1.1f || glm::abs(ndc.y) > 1.1f)
+            return;
+        glm::vec2 pixel((ndc.x * 0.5f + 0.5f) * viewport.x, (0.5f - ndc.y * 0.5f) * viewport.y);
+        // laid out once at the point, then shifted so its glyphs are centred on it (labels are one line)
+        size_t first = vertices.size();
+        Add(text, pixel - glm::vec2(0.0f, LineHeight(scale)), color, scale);
+        if (vertices.size() == first)
+            return;
+        float left = vertices[first].position.x, right = vertices[vertices.size() - 3].position.x; // the last quad's right edge
+        float shift = (left + right) * 0.5f - pixel.x;
+        for (size_t i = first; i < vertices.size(); i++)
+            vertices[i].position.x -= shift;
+    }
+
+    // draws everything queued since the last Draw() with 'shader' (src/text.vs) and empties the queue;
+    // expects the depth test off and alpha blending on
+    void Draw(Shader& shader, glm::vec2 viewport)
+    {
+        stats = Stats();
+        if (vertices.empty())
+            return;
+        size_t quads = vertices.size() / 4;
+        if (quads > indexQuads)
+            growIndices(quads);
+
+        GLState::Get().BindVertexArray(VAO);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, VBO);
+        size_t bytes = vertices.size() * sizeof(GlyphVertex);
+        if (bytes > vertexCapacity)
+            vertexCapacity = bytes * 2;
+        // orphaning: the driver hands out fresh storage instead of waiting for last frame's draw to finish
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, vertices.data());
+
+        shader.use();
+        shader.setVec2("viewport", viewport);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, atlas);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(quads * 6), GL_UNSIGNED_INT, 0);
+
+        stats.quads = static_cast<unsigned int>(quads);
+        stats.drawCalls = 1;
+        stats.uploadBytes = bytes;
+        vertices.clear();
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        usage.cpuBytes = sizeof(TextRenderer) + vertices.capacity() * sizeof(GlyphVertex);
+        usage.gpuBytes = static_cast<size_t>(header.atlasSize) * header.atlasSize * (atlas ? 1 : 0) + vertexCapacity + indexQuads * 6 * sizeof(unsigned int);
+        return usage;
+    }
+
+    // frees the atlas and buffers; call while the context is still current
+    void Delete()
+    {
+        if (atlas)
+        {
+            glDeleteTextures(1, &atlas);
+            GLState::Get().TextureDeleted(atlas);
+            glDeleteVertexArrays(1, &VAO);
+            GLState::Get().VertexArrayDeleted(VAO);
+            unsigned int buffers[2] = { VBO, EBO };
+            glDeleteBuffers(2, buffers);
+            for (unsigned int buffer : buffers)
+                GLState::Get().BufferDeleted(buffer);
+        }
+        atlas = VAO = VBO = EBO = 0;
+        vertexCapacity = indexQuads = 0;
+    }
+
+private:
+    static const uint32_t CACHE_MAGIC = 0x47464453; // "SDFG"
+    static const uint32_t CACHE_VERSION = 3;
+    static const int GLYPH_COUNT = LAST_CHAR - FIRST_CHAR + 1;
+    static const int SOLID_SIZE = 4; // texels of the fully inside block AddRect() samples
+
+    struct GlyphVertex {
+        glm::vec2 position; // pixels, y down
+        glm::vec2 uv;
+        glm::u8vec4 color;
+    };
+    // metrics in atlas texels at SDF_SIZE; written to the cache as they are
+    struct Glyph {
+        uint16_t x = 0, y = 0, width = 0, height = 0; // the distance field's rectangle in the atlas
+        float xoff = 0.0f, yoff = 0.0f;                 // its top left corner from the pen on the baseline
+        float advance = 0.0f;
+    };
+    struct CacheHeader {
+        DiskCache::Header key;     // keyed by the font file the atlas came from
+        int32_t sdfSize = SDF_SIZE;
+        int32_t padding = SDF_PADDING;
+        int32_t atlasSize = 0;
+        float baseline = 0.0f;
+        float lineHeight = 0.0f;
+        int32_t solidX = 0, solidY = 0;
+    };
+
+    float pixelHeight;
+    CacheHeader header;
+    Glyph glyphs[GLYPH_COUNT];
+    unsigned int atlas = 0, VAO = 0, VBO = 0, EBO = 0;
+    size_t vertexCapacity = 0, indexQuads = 0;
+    std::vector<GlyphVertex> vertices;
+    Stats stats;
+    Timing timing;
+
+    static int glyphIndex(char c)
+    {
+        return (c < FIRST_CHAR || c > LAST_CHAR ? '?' : c) - FIRST_CHAR;
+    }
+
+    // makes the distance fields, a run of glyphs per core, and packs them into the smallest square
+    // power-of-two atlas they fit
+    bool generate(const std::string& fontPath, const CacheHeader& source, std::vector<unsigned char>& pixels)
+    {
+        std::ifstream file(fontPath, std::ios::binary);
+        std::vector<unsigned char> font((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        stbtt_fontinfo info;
+        if (font.empty() || !stbtt_InitFont(&info, font.data(), stbtt_GetFontOffsetForIndex(font.data(), 0)))
+        {
+            std::cout << "ERROR::TEXT::FONT_NOT_LOADED: " << fontPath << std::endl;
+            return false;
+        }
+        float scale = stbtt_ScaleForPixelHeight(&info, static_cast<float>(SDF_SIZE));
+        int ascent, descent, gap;
+        stbtt_GetFontVMetrics(&info, &ascent, &descent, &gap);
+
+        // stb_truetype only reads 'info' and the font data here, so the glyphs can be made concurrently
+        std::vector<std::vector<unsigned char>> fields(GLYPH_COUNT);
+        int chunks = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::future<void>> workers;
+        for (int chunk = 0; chunk < chunks; chunk++)
+        {
+            workers.push_back(std::async(std::launch::async, [this, &info, &fields, scale, chunk, chunks]() {
+                // interleaved, so the heavy letters don't all land on one worker
+                for (int i = chunk; i < GLYPH_COUNT; i += chunks)
+                {
+                    int index = stbtt_FindGlyphIndex(&info, FIRST_CHAR + i);
+                    int advance, bearing, width = 0, height = 0, xoff = 0, yoff = 0;
+                    stbtt_GetGlyphHMetrics(&info, index, &advance, &bearing);
+                    glyphs[i] = Glyph();
+                    glyphs[i].advance = advance * scale;
+                    unsigned char* field = stbtt_GetGlyphSDF(&info, scale, index, SDF_PADDING, SDF_ON_EDGE, SDF_ON_EDGE / (float)SDF_PADDING,
+                                                             &width, &height, &xoff, &yoff);
+                    if (!field)
+                        continue; // blank, e.g. space
+                    fields[i].assign(field, field + static_cast<size_t>(width) * height);
+                    stbtt_FreeSDF(field, nullptr);
+                    glyphs[i].width = static_cast<uint16_t>(width);
+                    glyphs[i].height = static_cast<uint16_t>(height);
+                    glyphs[i].xoff = static_cast<float>(xoff);
+                    glyphs[i].yoff = static_cast<float>(yoff);
+                }
+            }));
+        }
+        for (auto& worker : workers)
+            worker.get();
+
+        // the glyphs, and a block for AddRect() last
+        std::vector<stbrp_rect> rects(GLYPH_COUNT + 1);
+        for (int i = 0; i < GLYPH_COUNT; i++)
+        {
+            rects[i].id = i;
+            rects[i].w = glyphs[i].width ? glyphs[i].width + 1 : 0; // a texel apart, so bilinear filtering stays inside each glyph
+            rects[i].h = glyphs[i].height ? glyphs[i].height + 1 : 0;
+        }
+        rects[GLYPH_COUNT].id = GLYPH_COUNT;
+        rects[GLYPH_COUNT].w = rects[GLYPH_COUNT].h = SOLID_SIZE + 1;
+        int size = 128;
+        std::vector<stbrp_node> nodes;
+        for (; size <= 4096; size *= 2)
+        {
+            nodes.resize(size);
+            stbrp_context context;
+            stbrp_init_target(&context, size, size, nodes.data(), static_cast<int>(nodes.size()));
+            if (stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size())))
+                break;
+        }
+        if (size > 4096)
+        {
+            std::cout << "ERROR::TEXT::ATLAS_TOO_SMALL: " << fontPath << std::endl;
+            return false;
+        }
+
+        pixels.assign(static_cast<size_t>(size) * size, 0);
+        header = source;
+        for (const stbrp_rect& rect : rects)
+        {
+            if (rect.id == GLYPH_COUNT)
+            {
+                header.solidX = rect.x;
+                header.solidY = rect.y;
+                for (int row = 0; row < SOLID_SIZE; row++)
+                    std::fill_n(pixels.data() + static_cast<size_t>(rect.y + row) * size + rect.x, SOLID_SIZE, 255);
+                continue;
+            }
+            Glyph& glyph = glyphs[rect.id];
+            glyph.x = static_cast<uint16_t>(rect.x);
+            glyph.y = static_cast<uint16_t>(rect.y);
+            for (int row = 0; row < glyph.height; row++)
+                std::copy_n(fields[rect.id].data() + static_cast<size_t>(row) * glyph.width, glyph.width,
+                            pixels.data() + static_cast<size_t>(glyph.y + row) * size + glyph.x);
+        }
+        header.atlasSize = size;
+        header.baseline = ascent * scale;
+        header.lineHeight = (ascent - descent + gap) * scale;
+        return true;
+    }
+
+    bool readCache(const std::string& path, const CacheHeader& expected, std::vector<unsigned char>& pixels)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        CacheHeader cached;
+        file.read(reinterpret_cast<char*>(&cached), sizeof(cached));
+        if (!file || !DiskCache::Matches(cached.key, expected.key) || cached.sdfSize != SDF_SIZE || cached.padding != SDF_PADDING
+            || cached.atlasSize <= 0 || cached.atlasSize > 4096)
+            return false;
+        file.read(reinterpret_cast<char*>(glyphs), sizeof(glyphs));
+        pixels.resize(static_cast<size_t>(cached.atlasSize) * cached.atlasSize);
+        file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+        if (!file)
+            return false;
+        header = cached;
+        return true;
+    }
+
+    void writeCache(const std::string& path, const std::vector<unsigned char>& pixels) const
+    {
+        DiskCache::Write(path, "TEXT", [&](std::ofstream& file) {
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(glyphs), sizeof(glyphs));
+            file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+        });
+    }
+
+    // the quad indices never change, so the buffer only grows (doubling) when a frame has more glyphs
+    void growIndices(size_t quads)
+    {
+        indexQuads = std::max<size_t>(quads, indexQuads * 2);
+        std::vector<unsigned int> indices(indexQuads * 6);
+        for (size_t quad = 0; quad < indexQuads; quad++)
+        {
+            unsigned int first = static_cast<unsigned int>(quad * 4);
+            unsigned int* index = &indices[quad * 6];
+            index[0] = first; index[1] = first + 1; index[2] = first + 2;
+            index[3] = first; index[4] = first + 2; index[5] = first + 3;
+        }
+        GLState::Get().BindVertexArray(VAO); // the element buffer binding is VAO state
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    }
+};
+#endif
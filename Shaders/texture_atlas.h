@@ -0,0 +1,249 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm.hpp>
+#include <stb_image.h>
+#include <stb_rect_pack.h>
+
+#include <gl_state.h>
+#include <memory_usage.h>
+#include <texture_manager.h>
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// where an image ended up inside the atlas
+struct AtlasRegion {
+    int layer = -1;
+    glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f); // xy: uv offset, zw: uv scale inside the layer
+};
+
+// Packs small textures into the layers of one GL_TEXTURE_2D_ARRAY with stb_rect_pack.
+// Meshes whose diffuse map lives in the atlas sample it through their AtlasRegion instead of binding
+// a texture of their own, so every atlased mesh can be drawn back to back with a single bind.
+// Images are expanded to RGBA8 and padded with their edge texels to keep mips from bleeding.
+class TextureAtlas
+{
+public:
+    unsigned int ID = 0;
+
+    TextureAtlas(int pageSize = 2048, int maxImageSize = 1024, int padding = 8)
+        : pageSize(pageSize), maxImageSize(maxImageSize), padding(padding)
+    {
+    }
+
+    // decodes 'files' in parallel, packs the ones no larger than maxImageSize and uploads the array.
+    // Files that are too big or fail to load are simply left out; Find() returns false for them.
+    void Build(const std::vector<std::string>& files)
+    {
+        std::vector<std::future<Image>> decodes;
+        for (const std::string& file : files)
+            decodes.push_back(std::async(std::launch::async, &TextureAtlas::decode, TextureManager::CanonicalPath(file)));
+
+        std::vector<Image> images;
+        for (auto& decode : decodes)
+        {
+            Image image = decode.get();
+            if (image.pixels.empty())
+                continue;
+            if (image.width > maxImageSize || image.height > maxImageSize || regions.count(image.file))
+                continue;
+            images.push_back(std::move(image));
+        }
+        if (images.empty())
+            return;
+
+        // pack page by page until everything has a place
+        std::vector<stbrp_rect> rects(images.size());
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            rects[i].id = static_cast<int>(i);
+            rects[i].w = images[i].width + 2 * padding;
+            rects[i].h = images[i].height + 2 * padding;
+            rects[i].was_packed = 0;
+        }
+        // the packer works on a page grown by 'padding' on every side, so padding that would only
+        // sit against the page border falls off it instead of wasting space
+        int packSize = pageSize + 2 * padding;
+        std::vector<stbrp_node> nodes(packSize);
+        std::vector<int> layerOf(images.size(), -1);
+        std::vector<stbrp_rect> remaining = rects;
+        int layers = 0;
+        while (!remaining.empty())
+        {
+            stbrp_context context;
+            stbrp_init_target(&context, packSize, packSize, nodes.data(), static_cast<int>(nodes.size()));
+            stbrp_pack_rects(&context, remaining.data(), static_cast<int>(remaining.size()));
+            std::vector<stbrp_rect> next;
+            for (const stbrp_rect& rect : remaining)
+            {
+                if (rect.was_packed)
+                {
+                    rects[rect.id] = rect;
+                    layerOf[rect.id] = layers;
+                }
+                else
+                    next.push_back(rect);
+            }
+            if (next.size() == remaining.size())
+                break; // nothing fits in an empty page
+            remaining.swap(next);
+            layers++;
+        }
+
+        glGenTextures(1, &ID);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, ID);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, pageSize, pageSize, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            if (layerOf[i] < 0)
+                continue;
+            // rects[i] is in packer space: the image itself starts 'padding' in, i.e. at (x, y) on the page
+            int x = rects[i].x, y = rects[i].y;
+            uploadPadded(images[i], x, y, layerOf[i]);
+
+            AtlasRegion region;
+            region.layer = layerOf[i];
+            region.rect = glm::vec4(float(x) / pageSize, float(y) / pageSize,
+                                    float(images[i].width) / pageSize, float(images[i].height) / pageSize);
+            regions[images[i].file] = region;
+        }
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        layerCount = layers;
+
+        std::cout << "Texture atlas: " << regions.size() << " images in " << layers << " layer(s) of " << pageSize << "x" << pageSize << std::endl;
+    }
+
+    // looks up the region of an image by file path
+    bool Find(const std::string& file, AtlasRegion& region) const
+    {
+        auto it = regions.find(TextureManager::CanonicalPath(file));
+        if (it == regions.end())
+            return false;
+        region = it->second;
+        return true;
+    }
+
+    // hot reload: writes new RGBA8 pixels for 'file' into the region it already has. The packing is
+    // fixed after Build(), so the image has to keep its size; returns false if it didn't.
+    bool Replace(const std::string& file, const unsigned char* rgba, int width, int height)
+    {
+        auto it = regions.find(TextureManager::CanonicalPath(file));
+        if (it == regions.end())
+            return false;
+        const AtlasRegion& region = it->second;
+        int x = static_cast<int>(region.rect.x * pageSize + 0.5f), y = static_cast<int>(region.rect.y * pageSize + 0.5f);
+        if (width != static_cast<int>(region.rect.z * pageSize + 0.5f) || height != static_cast<int>(region.rect.w * pageSize + 0.5f))
+        {
+            std::cout << "Texture atlas: " << file << " changed size, restart to repack it" << std::endl;
+            return false;
+        }
+        Image image;
+        image.file = it->first;
+        image.width = width;
+        image.height = height;
+        image.pixels.assign(rgba, rgba + static_cast<size_t>(width) * height * 4);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, ID);
+        uploadPadded(image, x, y, region.layer);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        return true;
+    }
+
+    void Bind(unsigned int unit) const
+    {
+        GLState::Get().BindTexture(unit, GL_TEXTURE_2D_ARRAY, ID);
+    }
+
+    int LayerCount() const { return layerCount; }
+
+    // the RGBA8 array with its mip chain; the decoded images are dropped after Build()
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        usage.gpuBytes = static_cast<size_t>(pageSize) * pageSize * 4 * layerCount * 4 / 3;
+        usage.cpuBytes = regions.size() * sizeof(AtlasRegion);
+        return usage;
+    }
+
+    // frees the texture array; call while the context is still current
+    void Delete()
+    {
+        glDeleteTextures(1, &ID);
+        GLState::Get().TextureDeleted(ID);
+        ID = 0;
+    }
+
+private:
+    struct Image {
+        std::string file;
+        int width = 0, height = 0;
+        std::vector<unsigned char> pixels; // RGBA8
+    };
+
+    int pageSize, maxImageSize, padding;
+    int layerCount = 0;
+    std::unordered_map<std::string, AtlasRegion> regions; // canonical path -> region
+
+    static Image decode(std::string file)
+    {
+        Image image;
+        image.file = file;
+        int nrComponents;
+        unsigned char* data = stbi_load(file.c_str(), &image.width, &image.height, &nrComponents, 4);
+        if (!data)
+        {
+            std::cout << "Texture failed to load at path: " << file << std::endl;
+            return image;
+        }
+        image.pixels.assign(data, data + static_cast<size_t>(image.width) * image.height * 4);
+        stbi_image_free(data);
+        return image;
+    }
+
+    // uploads the padded image so that the image itself lands at (x, y) of 'layer'; padding that
+    // would fall off the page is clipped. The atlas must be bound to GL_TEXTURE_2D_ARRAY.
+    void uploadPadded(const Image& image, int x, int y, int layer) const
+    {
+        int paddedWidth = image.width + 2 * padding, paddedHeight = image.height + 2 * padding;
+        int left = std::max(0, padding - x), top = std::max(0, padding - y);
+        int width = std::min(paddedWidth - left, pageSize - (x - padding + left));
+        int height = std::min(paddedHeight - top, pageSize - (y - padding + top));
+        std::vector<unsigned char> padded = pad(image);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, paddedWidth);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, left);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, top);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x - padding + left, y - padding + top, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, padded.data());
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    }
+
+    // surrounds the image with 'padding' texels copied from its nearest edge
+    std::vector<unsigned char> pad(const Image& image) const
+    {
+        int w = image.width + 2 * padding, h = image.height + 2 * padding;
+        std::vector<unsigned char> padded(static_cast<size_t>(w) * h * 4);
+        for (int y = 0; y < h; y++)
+        {
+            int sy = std::clamp(y - padding, 0, image.height - 1);
+            for (int x = 0; x < w; x++)
+            {
+                int sx = std::clamp(x - padding, 0, image.width - 1);
+                std::memcpy(&padded[(static_cast<size_t>(y) * w + x) * 4], &image.pixels[(static_cast<size_t>(sy) * image.width + sx) * 4], 4);
+            }
+        }
+        return padded;
+    }
+};
+#endif
@@ -0,0 +1,371 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <stb_image.h>
+
+#include <gl_state.h>
+#include <memory_usage.h>
+#include <texture_streamer.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Process-wide registry of 2D textures shared by every Model.
+// Textures are looked up first by canonical path and then by a hash of the file contents, so an
+// image that ships under several names (e.g. the Saturn/Uranus maps) is decoded and uploaded once.
+// Every Acquire() takes a reference; the GL texture is deleted when the last reference is released.
+class TextureManager
+{
+public:
+    struct Stats {
+        unsigned int decodes = 0;     // images actually decoded and uploaded
+        unsigned int pathHits = 0;    // requests satisfied by the canonical path lookup
+        unsigned int contentHits = 0; // requests satisfied by the content hash lookup
+        unsigned int deletes = 0;     // textures deleted after their last reference went away
+        unsigned int streamed = 0;    // decodes handed to the TextureStreamer instead of done inline
+    };
+
+    static TextureManager& Get()
+    {
+        static TextureManager instance;
+        return instance;
+    }
+
+    // returns the texture for 'path' (relative to 'directory') and takes a reference on it.
+    // Returns 0 if the image could not be read or decoded.
+    unsigned int Acquire(const std::string& path, const std::string& directory, bool gamma = false)
+    {
+        std::string file = CanonicalPath(directory.empty() ? path : directory + '/' + path);
+        std::string key = gamma ? file + "#srgb" : file; // sRGB and linear uploads are distinct textures
+
+        // 1. same file requested before
+        auto byPath = pathToId.find(key);
+        if (byPath != pathToId.end())
+        {
+            entries[byPath->second].refCount++;
+            stats.pathHits++;
+            return byPath->second;
+        }
+
+        // 2. different file, identical bytes
+        std::vector<unsigned char> bytes;
+        if (!readFile(file, bytes))
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return 0;
+        }
+        ContentKey content{ HashBytes(bytes), bytes.size(), gamma };
+        auto byContent = contentToId.find(content);
+        if (byContent != contentToId.end())
+        {
+            Entry& entry = entries[byContent->second];
+            entry.refCount++;
+            entry.paths.push_back(key);
+            pathToId[key] = byContent->second;
+            stats.contentHits++;
+            return byContent->second;
+        }
+
+        // 3. new image: hand it to the streamer, or decode and upload it right here
+        if (streamer)
+        {
+            unsigned int textureID = placeholder();
+            streamer->Request(textureID, file, std::move(bytes), gamma);
+            stats.streamed++;
+            registerEntry(textureID, key, content, 0, 0, 0);
+            return textureID;
+        }
+        int width, height, nrComponents;
+        unsigned char* data = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &nrComponents, 0);
+        if (!data)
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return 0;
+        }
+        unsigned int textureID = upload(data, width, height, nrComponents, gamma);
+        stbi_image_free(data);
+        stats.decodes++;
+
+        registerEntry(textureID, key, content, width, height, nrComponents);
+        return textureID;
+    }
+
+    // routes new textures through 'textureStreamer' (or loads synchronously again when null).
+    // Streamed textures show a 1x1 grey placeholder until their first mip level arrives.
+    void SetStreamer(TextureStreamer* textureStreamer)
+    {
+        streamer = textureStreamer;
+        if (streamer)
+        {
+            streamer->OnComplete = [this](unsigned int id, int width, int height, int components) {
+                auto it = entries.find(id);
+                if (it == entries.end())
+                    return; // released before it finished streaming
+                it->second.width = width;
+                it->second.height = height;
+                it->second.components = components;
+            };
+        }
+    }
+
+    // takes another reference on a texture that is already registered
+    void AddRef(unsigned int id)
+    {
+        auto it = entries.find(id);
+        if (it != entries.end())
+            it->second.refCount++;
+    }
+
+    // drops a reference and deletes the GL texture once nobody uses it any more
+    void Release(unsigned int id)
+    {
+        auto it = entries.find(id);
+        if (it == entries.end())
+            return;
+        if (--it->second.refCount > 0)
+            return;
+
+        for (const std::string& key : it->second.paths)
+            pathToId.erase(key);
+        forgetContent(it->second.content, id);
+        entries.erase(it);
+        if (streamer)
+            streamer->Cancel(id);
+        glDeleteTextures(1, &id);
+        GLState::Get().TextureDeleted(id);
+        stats.deletes++;
+    }
+
+    // deletes every texture still alive. Must be called while the GL context is current;
+    // references released afterwards (e.g. from Model destructors) are ignored.
+    void Shutdown()
+    {
+        for (auto& it : entries)
+        {
+            glDeleteTextures(1, &it.first);
+            GLState::Get().TextureDeleted(it.first);
+        }
+        entries.clear();
+        pathToId.clear();
+        contentToId.clear();
+    }
+
+    // hot reload: re-uploads the texture(s) loaded from 'file' (a canonical path) with freshly decoded
+    // pixels. The GL names stay the same, so every mesh using them picks the change up without being
+    // touched. A texture that other files share by content is copied on write instead: the edited file
+    // moves to a new texture and the others keep the old pixels. Each such move lands in 'split' as
+    // (old id, new id) with one reference on the new id, which the caller drops once the holders of
+    // 'file' have been moved over (Model::RetargetTexture). Returns the number of textures replaced.
+    unsigned int Replace(const std::string& file, uint64_t hash, size_t size, const unsigned char* pixels, int width, int height, int components,
+                         std::vector<std::pair<unsigned int, unsigned int>>& split)
+    {
+        unsigned int replaced = 0;
+        for (bool gamma : { false, true })
+        {
+            std::string key = gamma ? file + "#srgb" : file;
+            auto byPath = pathToId.find(key);
+            if (byPath == pathToId.end())
+                continue;
+            unsigned int id = byPath->second;
+            Entry& entry = entries[id];
+            ContentKey content{ hash, size, gamma };
+            if (entry.paths.size() > 1)
+            {
+                entry.paths.erase(std::find(entry.paths.begin(), entry.paths.end(), key));
+                unsigned int textureID = upload(pixels, width, height, components, gamma);
+                registerEntry(textureID, key, content, width, height, components);
+                split.push_back({ id, textureID });
+                replaced++;
+                continue;
+            }
+            if (streamer)
+                streamer->Cancel(id); // a stream still in flight would overwrite the new pixels
+            forgetContent(entry.content, id);
+            entry.content = content;
+            entry.width = width;
+            entry.height = height;
+            entry.components = components;
+            contentToId.emplace(content, id);
+            upload(pixels, width, height, components, gamma, id);
+            replaced++;
+        }
+        return replaced;
+    }
+
+    // true if a texture was loaded from 'file' (a canonical path)
+    bool Has(const std::string& file) const
+    {
+        return pathToId.count(file) || pathToId.count(file + "#srgb");
+    }
+
+    // resolves a path to the form used as registry key, so different spellings of one file compare equal
+    static std::string CanonicalPath(const std::string& path)
+    {
+        std::error_code ec;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, ec);
+        if (ec)
+            return std::filesystem::path(path).lexically_normal().generic_string();
+        return canonical.generic_string();
+    }
+
+    // 64-bit FNV-1a of a file's bytes, the content half of the registry key
+    static uint64_t HashBytes(const std::vector<unsigned char>& bytes)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char b : bytes)
+        {
+            hash ^= b;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // GPU bytes of one texture: its base level at the uploaded format plus a third for the mip chain.
+    // The pixels are freed after upload, so there is no CPU side beyond the registry itself.
+    MemoryUsage Memory(unsigned int id) const
+    {
+        MemoryUsage usage;
+        auto it = entries.find(id);
+        if (it == entries.end())
+            return usage;
+        const Entry& entry = it->second;
+        if (entry.width == 0)
+            usage.gpuBytes = 3; // still the 1x1 streaming placeholder
+        else
+            usage.gpuBytes = static_cast<size_t>(entry.width) * entry.height * entry.components * 4 / 3;
+        return usage;
+    }
+
+    // every live texture counted once, however many models share it
+    MemoryUsage Memory() const
+    {
+        MemoryUsage usage;
+        for (auto& it : entries)
+        {
+            usage += Memory(it.first);
+            usage.cpuBytes += sizeof(Entry) + it.second.paths.size() * sizeof(std::string);
+        }
+        return usage;
+    }
+
+    size_t TextureCount() const { return entries.size(); }
+    const Stats& GetStats() const { return stats; }
+
+private:
+    struct ContentKey {
+        uint64_t hash;
+        size_t size;
+        bool gamma;
+        bool operator==(const ContentKey& other) const { return hash == other.hash && size == other.size && gamma == other.gamma; }
+    };
+    struct ContentKeyHash {
+        size_t operator()(const ContentKey& key) const { return static_cast<size_t>(key.hash ^ (key.size * 0x9E3779B97F4A7C15ull) ^ key.gamma); }
+    };
+    struct Entry {
+        ContentKey content{ 0, 0, false };
+        int refCount = 0;
+        int width = 0, height = 0, components = 0;
+        std::vector<std::string> paths; // every canonical path that resolved to this texture
+    };
+
+    std::unordered_map<std::string, unsigned int> pathToId;
+    std::unordered_map<ContentKey, unsigned int, ContentKeyHash> contentToId;
+    std::unordered_map<unsigned int, Entry> entries;
+    Stats stats;
+    TextureStreamer* streamer = nullptr;
+
+    TextureManager() {}
+    TextureManager(const TextureManager&) = delete;
+    TextureManager& operator=(const TextureManager&) = delete;
+
+    void registerEntry(unsigned int id, const std::string& key, const ContentKey& content, int width, int height, int components)
+    {
+        Entry entry;
+        entry.content = content;
+        entry.refCount = 1;
+        entry.width = width;
+        entry.height = height;
+        entry.components = components;
+        entry.paths.push_back(key);
+        entries[id] = entry;
+        pathToId[key] = id;
+        contentToId.emplace(content, id); // an edited file may now match another texture; that one keeps the key
+    }
+
+    // drops the content key of texture 'id', unless the key leads to another texture
+    void forgetContent(const ContentKey& content, unsigned int id)
+    {
+        auto byContent = contentToId.find(content);
+        if (byContent != contentToId.end() && byContent->second == id)
+            contentToId.erase(byContent);
+    }
+
+    static unsigned int placeholder()
+    {
+        const unsigned char grey[3] = { 128, 128, 128 };
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, textureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
+
+    static bool readFile(const std::string& path, std::vector<unsigned char>& bytes)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return !bytes.empty();
+    }
+
+    // uploads into 'textureID', or into a new texture when it is 0
+    static unsigned int upload(const unsigned char* data, int width, int height, int nrComponents, bool gamma, unsigned int textureID = 0)
+    {
+        GLenum format = GL_RGB;
+        if (nrComponents == 1)
+            format = GL_RED;
+        else if (nrComponents == 3)
+            format = GL_RGB;
+        else if (nrComponents == 4)
+            format = GL_RGBA;
+        GLenum internalFormat = format;
+        if (gamma && format == GL_RGB)
+            internalFormat = GL_SRGB;
+        else if (gamma && format == GL_RGBA)
+            internalFormat = GL_SRGB_ALPHA;
+
+        if (!textureID)
+            glGenTextures(1, &textureID);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, textureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of 1- and 3-channel images are not 4-byte aligned
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0); // a streamed texture may have been left clamped
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+        return textureID;
+    }
+};
+#endif
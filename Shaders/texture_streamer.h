@@ -0,0 +1,422 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <stb_image.h>
+
+#include <gl_state.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Streams textures to the GPU without stalling the render thread.
+// Worker threads decode the image and build its mip chain on the CPU. The render thread
+// then copies the pixels, a few rows at a time, into a ring of pixel buffer objects and issues
+// glTexSubImage2D from there, so the driver can DMA the data while we keep drawing. Mips go up
+// coarse-to-fine and GL_TEXTURE_BASE_LEVEL follows them, so a blurry version shows up on the very
+// next frame and sharpens as the finer levels land. Update() never uploads more than its byte budget.
+class TextureStreamer
+{
+public:
+    struct Stats {
+        size_t bytesUploaded = 0;
+        unsigned int levelsUploaded = 0;
+        unsigned int texturesCompleted = 0;
+        unsigned int ringStalls = 0; // Update() stopped early because the next PBO segment was still in flight
+    };
+
+    // called on the render thread once every level of a texture is on the GPU
+    std::function<void(unsigned int texture, int width, int height, int components)> OnComplete;
+
+    TextureStreamer(unsigned int workerCount = 2, size_t segmentSize = 2 * 1024 * 1024, unsigned int segmentCount = 4)
+        : segmentSize(segmentSize), segments(segmentCount)
+    {
+        glGenBuffers(1, &PBO);
+        GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, segmentSize * segmentCount, NULL, GL_STREAM_DRAW);
+        GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        for (unsigned int i = 0; i < std::max(1u, workerCount); i++)
+            workers.emplace_back(&TextureStreamer::workerLoop, this);
+    }
+
+    ~TextureStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // queues the encoded image 'bytes' (read from 'file') to be decoded and streamed into the already
+    // generated texture name 'texture'. The texture keeps its placeholder until the first mip arrives.
+    void Request(unsigned int texture, const std::string& file, std::vector<unsigned char> bytes, bool gamma = false)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back({ texture, file, std::move(bytes), gamma });
+            inFlight.insert(texture);
+        }
+        wake.notify_one();
+    }
+
+    // forgets a texture that is about to be deleted so nothing is uploaded into a recycled name
+    void Cancel(unsigned int texture)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (inFlight.erase(texture) == 0)
+            return;
+        auto job = std::find_if(pending.begin(), pending.end(), [texture](const Job& j) { return j.texture == texture; });
+        if (job != pending.end())
+            pending.erase(job);
+        else
+            cancelled.insert(texture); // a worker has it or it is queued for upload; drop it in Update()
+    }
+
+    // render thread: uploads at most 'byteBudget' bytes of decoded pixels. Returns the bytes uploaded.
+    size_t Update(size_t byteBudget)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!decoded.empty())
+            {
+                uploads.push_back(std::move(decoded.front()));
+                decoded.pop_front();
+            }
+            for (unsigned int texture : cancelled)
+            {
+                auto image = std::find_if(uploads.begin(), uploads.end(), [texture](const Image& i) { return i.texture == texture; });
+                if (image != uploads.end())
+                {
+                    uploads.erase(image);
+                    cancelledNow.push_back(texture);
+                }
+            }
+            for (unsigned int texture : cancelledNow)
+                cancelled.erase(texture);
+            cancelledNow.clear();
+        }
+
+        size_t spent = 0;
+        GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while (!uploads.empty() && spent < byteBudget)
+        {
+            Image& image = uploads.front();
+            if (image.levels.empty())
+            {
+                std::cout << "Texture failed to load at path: " << image.file << std::endl;
+                finish(image, false);
+                continue;
+            }
+            if (!image.allocated)
+            {
+                GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // level data comes from client memory, not the PBO
+                spent += allocate(image);
+                GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+                completeLevel(image);
+                continue;
+            }
+
+            Level& level = image.levels[image.level];
+            size_t rowBytes = static_cast<size_t>(level.width) * image.components;
+            int rowsLeft = level.height - image.row;
+            int rows = static_cast<int>(std::min<size_t>(segmentSize, byteBudget - spent) / rowBytes);
+            rows = std::max(1, std::min(rows, rowsLeft));
+            size_t bytes = rows * rowBytes;
+            if (bytes > segmentSize) // a single row wider than a segment: upload straight from client memory
+            {
+                GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                uploadRows(image, level, rows, level.pixels.data() + image.row * rowBytes);
+                GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+            }
+            else
+            {
+                Segment& segment = segments[nextSegment];
+                if (segment.fence)
+                {
+                    GLenum status = glClientWaitSync(segment.fence, 0, 0);
+                    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                    {
+                        stats.ringStalls++;
+                        break; // the GPU still reads this segment; try again next frame instead of stalling
+                    }
+                    glDeleteSync(segment.fence);
+                    segment.fence = 0;
+                }
+                GLintptr offset = static_cast<GLintptr>(nextSegment * segmentSize);
+                void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+                if (!dst)
+                    break;
+                std::memcpy(dst, level.pixels.data() + image.row * rowBytes, bytes);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                uploadRows(image, level, rows, reinterpret_cast<const void*>(offset));
+                segment.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                nextSegment = (nextSegment + 1) % segments.size();
+            }
+            spent += bytes;
+
+            image.row += rows;
+            if (image.row == level.height)
+                completeLevel(image);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        GLState::Get().BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        stats.bytesUploaded += spent;
+        return spent;
+    }
+
+    // true once every requested texture is fully resident
+    bool Idle()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return inFlight.empty();
+    }
+
+    // frees the GL objects; call while the context is still current
+    void Shutdown()
+    {
+        for (Segment& segment : segments)
+        {
+            if (segment.fence)
+                glDeleteSync(segment.fence);
+            segment.fence = 0;
+        }
+        glDeleteBuffers(1, &PBO);
+        GLState::Get().BufferDeleted(PBO);
+        PBO = 0;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    struct Job {
+        unsigned int texture;
+        std::string file;
+        std::vector<unsigned char> bytes;
+        bool gamma;
+    };
+    struct Level {
+        int width, height;
+        std::vector<unsigned char> pixels;
+    };
+    struct Image {
+        unsigned int texture = 0;
+        std::string file;
+        bool gamma = false;
+        int components = 0;
+        std::vector<Level> levels; // levels[0] is the full resolution image
+        bool allocated = false;
+        int level = 0;             // level being uploaded, counts down to 0
+        int row = 0;               // next row of that level
+    };
+    struct Segment {
+        GLsync fence = 0;
+    };
+
+    unsigned int PBO = 0;
+    size_t segmentSize;
+    std::vector<Segment> segments;
+    size_t nextSegment = 0;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> pending;     // waiting for a worker
+    std::deque<Image> decoded;   // decoded, waiting for the render thread
+    std::deque<Image> uploads;   // render thread only
+    std::unordered_set<unsigned int> inFlight;  // requested and not finished or cancelled yet
+    std::unordered_set<unsigned int> cancelled; // cancelled after a worker picked them up
+    std::vector<unsigned int> cancelledNow;
+    bool quit = false;
+    Stats stats;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !pending.empty(); });
+                if (quit)
+                    return;
+                job = std::move(pending.front());
+                pending.pop_front();
+            }
+            Image image = decode(job);
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(image));
+        }
+    }
+
+    static Image decode(const Job& job)
+    {
+        Image image;
+        image.texture = job.texture;
+        image.file = job.file;
+        image.gamma = job.gamma;
+
+        int width, height, nrComponents;
+        unsigned char* data = stbi_load_from_memory(job.bytes.data(), static_cast<int>(job.bytes.size()), &width, &height, &nrComponents, 0);
+        if (!data)
+            return image;
+
+        image.components = nrComponents;
+        image.levels.push_back({ width, height, std::vector<unsigned char>(data, data + static_cast<size_t>(width) * height * nrComponents) });
+        stbi_image_free(data);
+
+        // 2x2 box filtered mip chain down to 1x1. The colour of an sRGB texture is averaged as light,
+        // in linear space; alpha, and the single and two channel images uploaded as linear, as they are
+        const SrgbTable& table = srgbTable();
+        int srgbChannels = job.gamma && nrComponents >= 3 ? 3 : 0;
+        while (image.levels.back().width > 1 || image.levels.back().height > 1)
+        {
+            const Level& src = image.levels.back();
+            Level dst{ std::max(1, src.width / 2), std::max(1, src.height / 2), {} };
+            dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * nrComponents);
+            for (int y = 0; y < dst.height; y++)
+            {
+                int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+                for (int x = 0; x < dst.width; x++)
+                {
+                    int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                    const unsigned char* a = &src.pixels[(static_cast<size_t>(y0) * src.width + x0) * nrComponents];
+                    const unsigned char* b = &src.pixels[(static_cast<size_t>(y0) * src.width + x1) * nrComponents];
+                    const unsigned char* c = &src.pixels[(static_cast<size_t>(y1) * src.width + x0) * nrComponents];
+                    const unsigned char* d = &src.pixels[(static_cast<size_t>(y1) * src.width + x1) * nrComponents];
+                    unsigned char* out = &dst.pixels[(static_cast<size_t>(y) * dst.width + x) * nrComponents];
+                    for (int k = 0; k < srgbChannels; k++)
+                        out[k] = table.Encode((table.linear[a[k]] + table.linear[b[k]] + table.linear[c[k]] + table.linear[d[k]]) * 0.25f);
+                    for (int k = srgbChannels; k < nrComponents; k++)
+                        out[k] = static_cast<unsigned char>((a[k] + b[k] + c[k] + d[k] + 2) / 4);
+                }
+            }
+            image.levels.push_back(std::move(dst));
+        }
+        image.level = static_cast<int>(image.levels.size()) - 1;
+        return image;
+    }
+
+    // sRGB bytes to linear light and back, for filtering the mips of gamma textures
+    struct SrgbTable {
+        float linear[256];     // byte -> linear
+        float thresholds[255]; // linear value at which the nearest byte goes from k to k + 1
+
+        SrgbTable()
+        {
+            for (int k = 0; k < 256; k++)
+                linear[k] = toLinear(k / 255.0f);
+            for (int k = 0; k < 255; k++)
+                thresholds[k] = toLinear((k + 0.5f) / 255.0f);
+        }
+
+        // the byte whose sRGB encoding rounds to 'value'
+        unsigned char Encode(float value) const
+        {
+            return static_cast<unsigned char>(std::upper_bound(thresholds, thresholds + 255, value) - thresholds);
+        }
+
+        static float toLinear(float encoded)
+        {
+            return encoded <= 0.04045f ? encoded / 12.92f : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+        }
+    };
+
+    static const SrgbTable& srgbTable()
+    {
+        static const SrgbTable table; // built once, on whichever worker gets there first
+        return table;
+    }
+
+    static void formats(const Image& image, GLenum& format, GLenum& internalFormat)
+    {
+        format = GL_RGB;
+        if (image.components == 1)
+            format = GL_RED;
+        else if (image.components == 3)
+            format = GL_RGB;
+        else if (image.components == 4)
+            format = GL_RGBA;
+        internalFormat = format;
+        if (image.gamma && format == GL_RGB)
+            internalFormat = GL_SRGB;
+        else if (image.gamma && format == GL_RGBA)
+            internalFormat = GL_SRGB_ALPHA;
+    }
+
+    // defines storage for every level up front so the texture stays complete while base level moves.
+    // The coarsest (1x1) level is filled right here rather than through the ring: the placeholder is
+    // gone from this point on, and a stalled ring must not leave draws sampling undefined texels.
+    // Returns the bytes uploaded.
+    size_t allocate(Image& image)
+    {
+        GLenum format, internalFormat;
+        formats(image, format, internalFormat);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, image.texture);
+        for (size_t i = 0; i < image.levels.size(); i++)
+        {
+            const Level& level = image.levels[i];
+            const void* pixels = static_cast<int>(i) == image.level ? level.pixels.data() : NULL;
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), internalFormat, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, image.level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        image.allocated = true;
+        return image.levels[image.level].pixels.size();
+    }
+
+    // every row of 'image.level' is up: let the sampler use it, free its CPU copy and move on
+    void completeLevel(Image& image)
+    {
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, image.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, image.level);
+        std::vector<unsigned char>().swap(image.levels[image.level].pixels);
+        stats.levelsUploaded++;
+        image.row = 0;
+        if (image.level == 0)
+            finish(image, true);
+        else
+            image.level--;
+    }
+
+    void uploadRows(const Image& image, const Level& level, int rows, const void* pixels)
+    {
+        GLenum format, internalFormat;
+        formats(image, format, internalFormat);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, image.texture);
+        glTexSubImage2D(GL_TEXTURE_2D, image.level, 0, image.row, level.width, rows, format, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    void finish(const Image& image, bool loaded)
+    {
+        if (loaded)
+        {
+            stats.texturesCompleted++;
+            if (OnComplete)
+                OnComplete(image.texture, image.levels[0].width, image.levels[0].height, image.components);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight.erase(image.texture);
+        uploads.pop_front();
+    }
+};
+#endif
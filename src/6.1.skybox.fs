@@ -5,7 +5,8 @@ in vec3 TexCoords;
 
 uniform samplerCube skybox;
 
+// the faces are sRGB, the frame linear
 void main()
 {    
-    FragColor = texture(skybox, TexCoords);
+    FragColor = vec4(pow(texture(skybox, TexCoords).rgb, vec3(2.2)), 1.0);
 }
\ No newline at end of file
@@ -1,14 +1,16 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "common/frame_data.glsl"
 
+// one triangle over the whole screen, corners (-1,-1), (3,-1), (-1,3) from gl_VertexID, so no vertex
+// buffer is bound. The view ray of a corner is the far-plane point the inverse view-projection gives
+// (skyView has no translation, so the camera is at the origin); on that plane it is linear in screen
+// space, so the interpolated rays are exact.
 void main()
 {
-    TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
-    gl_Position = pos.xyww;
-}  
\ No newline at end of file
+    vec2 ndc = vec2((gl_VertexID & 1) * 4.0 - 1.0, (gl_VertexID >> 1) * 4.0 - 1.0);
+    vec4 far = inverse(projection * skyView) * vec4(ndc, clipPlanes.z, 1.0);
+    TexCoords = far.xyz / far.w;
+    gl_Position = vec4(ndc, clipPlanes.z, 1.0); // on the far plane: only pixels no geometry covered pass the depth test
+}
@@ -18,6 +18,43 @@
 #include <camera.h>
 //class or functions for loading and rendering 3D models
 #include <model.h>
+//batches model draws into multi-draw calls over the shared geometry buffers
+#include <draw_list.h>
+//GL entry points newer than the 3.3 core GLAD provides
+#include <gl_extensions.h>
+//shadow copy of GL state that filters redundant binds
+#include <gl_state.h>
+//per-frame camera data shared by all shaders through one uniform buffer
+#include <frame_uniforms.h>
+//one shader source compiled into feature permutations on demand
+#include <shader_variants.h>
+//reports files saved under the asset directories
+#include <file_watcher.h>
+//reloads edited shaders, textures and models while the program runs
+#include <hot_reload.h>
+//culls and LODs the asteroid belt in a compute pass and draws it indirectly
+#include <gpu_culling.h>
+//CPU depth buffer of the big planets, to skip bodies and rocks hidden behind them
+#include <occlusion_culler.h>
+//quadtree terrain that replaces a sphere when the camera gets close to it
+#include <planet_terrain.h>
+//background stars from a binary catalog, drawn as point sprites
+#include <star_catalog.h>
+//sky cubemap from six faces or a panorama, decoded in parallel and cached
+#include <skybox.h>
+//ambient light from the sky for the PBR shading: irradiance harmonics, prefiltered specular and BRDF LUT, cached
+#include <environment_lighting.h>
+//sun shadows: planets and moons as analytic sphere occluders, the craft through small depth maps
+#include <eclipse_shadows.h>
+//HDR target, bloom down/up chain, histogram auto exposure and the tonemap into the window
+#include <post_process.h>
+//HUD and body labels from a glyph atlas, batched into one draw
+#include <text_renderer.h>
+//frame time graph, CPU phase and GPU pass times and renderer counters, drawn with the HUD
+#include <perf_overlay.h>
+//counts heap allocations, to measure the model import (this file defines the counting operator new)
+#define ALLOCATION_TRACKER_IMPLEMENTATION
+#include <allocation_tracker.h>
 //C++ header (input, output ect.)
 #include <iostream>
 
@@ -29,42 +66,40 @@ void processInput(GLFWwindow* window);
 
 
 ///////////////////////////////unsigned int loadTexture(const char* path);
-unsigned int loadCubemap(std::vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+// builds a body's model matrix: turn by 'angle' around 'axis', move out to 'position' and scale,
+// all relative to 'parent' (e.g. the planet a moon orbits)
+glm::mat4 orbitMatrix(float angle, glm::vec3 axis, glm::vec3 position, float scale, glm::mat4 parent = glm::mat4(1.0f))
+{
+    glm::mat4 model = glm::rotate(parent, angle, axis);
+    model = glm::translate(model, position);
+    return glm::scale(model, glm::vec3(scale));
 }
 
 // settings
 const unsigned int SCR_WIDTH = 1000;
 const unsigned int SCR_HEIGHT = 800;
+const size_t TEXTURE_UPLOAD_BUDGET = 4 * 1024 * 1024; // bytes of streamed texture data uploaded per frame
+const bool GL_STATE_DEBUG = false; // check the GL state cache against glGet* every frame (slow)
+const bool GPU_CULLING = true; // cull the asteroid belt on the GPU when compute shaders are available (GL 4.3)
+const bool GPU_CULLING_VALIDATE = false; // read the culling results back and check them on the CPU every frame (slow)
+const bool HOT_RELOAD = true; // watch src/, resources/ and Shaders/ and apply edits without restarting
+const SphereKind SPHERE_KIND = SPHERE_ICOSPHERE; // mesh the spherical bodies share (see sphere_mesh.h)
+const float SPHERE_RADIUS = 6.354f; // radius of the sphere .obj the body scales below were chosen for; the built-in sphere is 1
+const float TERRAIN_DISTANCE = 8.0f; // in body radii: closer than this, Mercury and the Moon are drawn as quadtree terrain
+const bool OCCLUSION_CULLING = true; // skip bodies (and the CPU-submitted belt) hidden behind the sun and the gas giants
+const char* STAR_CATALOG_PATH = "resources/stars/catalog.stars"; // built with --build-star-catalog; without it a sky is generated at startup
+const unsigned int STAR_COUNT = 1000000; // stars in the generated sky
+const float STAR_LIMITING_MAGNITUDE = 8.0f; // fainter stars are not drawn
+const bool REVERSE_Z = true; // depth from 1 at the near plane to 0 at the far one, when glClipControl is there (GL 4.5)
+const char* SKYBOX_PANORAMA = "resources/sol/StarsMap_2500x1250.jpg"; // equirectangular sky; empty to use the six skybox faces
+const char* HUD_FONT = "resources/fonts/Antonio-Regular.ttf";
+const bool PBR_SHADING = true; // metal/roughness lighting from the sun and the sky; false draws every texture as it is
+const float SUN_INTENSITY = 3.14159f; // radiance of the sun; pi makes a white surface facing it as bright as its texture
+const bool AUTO_EXPOSURE = true; // meter every frame on the GPU and adapt to it (needs compute shaders, GL 4.3); otherwise EXPOSURE
+const float EXPOSURE = 1.0f;
+const float BLOOM_STRENGTH = 0.04f; // share of the blurred frame in the image
+const float POST_BUDGET_MS = 1.0f; // GPU time --post-benchmark expects bloom, exposure and tonemap to fit in
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 70.0f));
@@ -81,16 +116,216 @@ float rotationAngle = 0.0f;
 float orbitSpeed = 1.0f;   // Adjust the orbit speed as needed
 float orbitRadius = 10.0f; // Adjust the orbit radius as needed
 
+// debug views
+bool showOcclusionBuffer = false; // O toggles the occlusion depth buffer in the lower left corner
+bool occlusionKeyDown = false;
+bool showLabels = true; // L toggles the body names
+bool labelsKeyDown = false;
+bool showPerfOverlay = false; // P toggles the performance overlay
+bool perfKeyDown = false;
+
+// world-space bounding sphere of a model drawn with 'transform'
+glm::vec4 worldBounds(const glm::vec4& bounds, const glm::mat4& transform)
+{
+    float scale = glm::max(glm::length(glm::vec3(transform[0])), glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    return glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(bounds), 1.0f)), bounds.w * scale);
+}
+
+// --occlusion-benchmark: a fixed scene of big occluders and a 3000 rock belt, seen from cameras
+// circling just above the belt plane, so most rocks behind the planets should go. Prints the cost
+// per frame for one thread and for all of them, how much was culled, and any rock culled although
+// the line of sight to its centre misses every occluder (that would be a wrong cull).
+int runOcclusionBenchmark()
+{
+    std::vector<glm::vec4> occluders = {
+        glm::vec4(0.0f, 0.0f, 0.0f, 8.0f), glm::vec4(50.0f, 0.0f, 70.0f, 5.0f), glm::vec4(-40.0f, 0.0f, 30.0f, 6.0f),
+        glm::vec4(30.0f, 0.0f, -40.0f, 4.0f), glm::vec4(-20.0f, 0.0f, -45.0f, 5.0f)
+    };
+    std::vector<glm::vec4> rocks;
+    srand(1);
+    for (unsigned int i = 0; i < 3000; i++)
+    {
+        float angle = (float)i / 3000.0f * 360.0f;
+        float displacement = (rand() % 500) / 100.0f - 2.5f;
+        glm::vec3 position(sin(angle) * 50.0f + displacement, ((rand() % 500) / 100.0f - 2.5f) * 0.4f, cos(angle) * 50.0f + (rand() % 500) / 100.0f - 2.5f);
+        rocks.push_back(glm::vec4(position, 0.2f));
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+
+    std::cout << "Occlusion benchmark: " << occluders.size() << " occluders, " << rocks.size() << " occludees, " << OcclusionCuller::SimdName() << std::endl;
+    for (unsigned int threads : { 1u, 0u })
+    {
+        OcclusionCuller culler(256, 128, threads);
+        const int frames = 360;
+        double rasterMs = 0.0, pyramidMs = 0.0, testMs = 0.0;
+        unsigned long long tested = 0, culled = 0, wrong = 0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            float angle = glm::radians(frame * 1.0f);
+            glm::vec3 eye(cos(angle) * 80.0f, 3.0f, sin(angle) * 80.0f);
+            glm::mat4 viewProjection = projection * glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            culler.Begin(viewProjection);
+            for (const glm::vec4& occluder : occluders)
+                culler.AddOccluder(glm::vec3(occluder), occluder.w);
+            culler.Rasterize();
+            auto start = std::chrono::steady_clock::now();
+            std::vector<bool> visible(rocks.size());
+            for (size_t i = 0; i < rocks.size(); i++)
+                visible[i] = culler.IsVisible(glm::vec3(rocks[i]), rocks[i].w);
+            testMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            rasterMs += culler.GetStats().rasterMs;
+            pyramidMs += culler.GetStats().pyramidMs;
+            tested += culler.GetStats().tested;
+            culled += culler.GetStats().culled;
+            for (size_t i = 0; i < rocks.size(); i++)
+            {
+                if (visible[i])
+                    continue;
+                glm::vec3 toRock = glm::vec3(rocks[i]) - eye;
+                float distance = glm::length(toRock);
+                glm::vec3 direction = toRock / distance;
+                glm::vec4 clip = viewProjection * glm::vec4(glm::vec3(rocks[i]), 1.0f);
+                bool behind = clip.w <= 0.0f || glm::abs(clip.x) > clip.w || glm::abs(clip.y) > clip.w; // off screen
+                for (const glm::vec4& occluder : occluders)
+                {
+                    // the ray towards the rock enters the occluder before reaching the rock
+                    float along = glm::dot(glm::vec3(occluder) - eye, direction);
+                    float miss = glm::length(eye + direction * along - glm::vec3(occluder));
+                    if (miss < occluder.w && along - glm::sqrt(occluder.w * occluder.w - miss * miss) < distance)
+                        behind = true;
+                }
+                if (!behind)
+                    wrong++;
+            }
+        }
+        std::cout << "  " << culler.Threads() << " thread(s), " << culler.Width() << "x" << culler.Height() << ": raster " << rasterMs / frames
+                  << " ms, pyramid " << pyramidMs / frames << " ms, " << rocks.size() << " tests " << testMs / frames << " ms per frame; culled "
+                  << 100.0 * culled / tested << "%, " << wrong << " suspicious" << std::endl;
+    }
+    return 0;
+}
+
 
 
-int main()
+// --build-star-catalog <catalog.csv | procedural> <output>: indexes a CSV star list (see
+// StarCatalog::ReadCsv) or a generated sky into the binary catalog the renderer loads
+int buildStarCatalog(const std::string& input, const std::string& output)
 {
+    std::vector<StarRecord> stars;
+    if (input == "procedural")
+        stars = StarCatalog::Generate(STAR_COUNT);
+    else if (!StarCatalog::ReadCsv(input, stars))
+        return -1;
+    if (!StarCatalog::Write(output, stars))
+        return -1;
+    std::cout << "Star catalog: " << stars.size() << " stars written to " << output << std::endl;
+    return 0;
+}
+
+// --post-benchmark: GPU time of each post-processing stage at common resolutions, over a synthetic
+// HDR frame: a dim sky on half of it and a square far brighter than 1 standing in for the sun, so
+// there is something to bloom and to meter. The stages are timed one by one with GL_TIME_ELAPSED
+// queries, averaged over 100 frames and held against POST_BUDGET_MS.
+int runPostBenchmark()
+{
+    PostProcess post;
+    post.AutoExposure = AUTO_EXPOSURE;
+    post.FixedExposure = EXPOSURE;
+    post.BloomStrength = BLOOM_STRENGTH;
+    unsigned int output = 0, outputTexture = 0; // the tonemap's target: the window may be smaller than the frame
+    struct Stage {
+        const char* name;
+        std::function<void()> run;
+    };
+    std::vector<Stage> stages = {
+        { "bloom down", [&post]() { post.BloomDown(); } },
+        { "exposure", [&post]() { post.Exposure(1.0f / 60.0f); } },
+        { "bloom up", [&post]() { post.BloomUp(); } },
+        { "tonemap", [&post, &output]() { post.Tonemap(output); } }
+    };
+    std::vector<GLuint> queries(stages.size());
+    glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+
+    std::cout << "Post-processing benchmark: " << (post.AutoExposureSupported() && AUTO_EXPOSURE ? "auto" : "fixed") << " exposure, budget "
+              << POST_BUDGET_MS << " ms" << std::endl;
+    for (glm::ivec2 size : { glm::ivec2(1280, 720), glm::ivec2(1920, 1080), glm::ivec2(2560, 1440), glm::ivec2(3840, 2160) })
+    {
+        glGenTextures(1, &outputTexture);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, outputTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glGenFramebuffers(1, &output);
+        glBindFramebuffer(GL_FRAMEBUFFER, output);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
+
+        const int warmup = 10, frames = 100;
+        std::vector<double> ms(stages.size(), 0.0);
+        for (int frame = 0; frame < warmup + frames; frame++)
+        {
+            post.Begin(size.x, size.y);
+            int sun = size.y / 8;
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(0, 0, size.x, size.y / 2);
+            glClearColor(0.02f, 0.02f, 0.03f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glScissor(size.x / 2 - sun / 2, size.y / 2 - sun / 2, sun, sun);
+            glClearColor(30.0f, 25.0f, 15.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDisable(GL_SCISSOR_TEST);
+            for (size_t i = 0; i < stages.size(); i++)
+            {
+                glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+                stages[i].run();
+                glEndQuery(GL_TIME_ELAPSED);
+            }
+            if (frame < warmup)
+                continue;
+            for (size_t i = 0; i < stages.size(); i++)
+            {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds); // waits for the GPU, fine here
+                ms[i] += nanoseconds * 1e-6 / frames;
+            }
+        }
+        double total = 0.0;
+        std::cout << "  " << size.x << "x" << size.y << ", " << post.BloomLevelCount() << " bloom levels:";
+        for (size_t i = 0; i < stages.size(); i++)
+        {
+            std::cout << (i ? ", " : " ") << stages[i].name << " " << ms[i] << " ms";
+            total += ms[i];
+        }
+        std::cout << "; total " << total << " ms" << (total <= POST_BUDGET_MS ? "" : ", OVER BUDGET") << std::endl;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &output);
+        glDeleteTextures(1, &outputTexture);
+        GLState::Get().TextureDeleted(outputTexture);
+    }
+    glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    post.Delete();
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    bool postBenchmark = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--occlusion-benchmark")
+            return runOcclusionBenchmark();
+        if (std::string(argv[i]) == "--build-star-catalog" && i + 2 < argc)
+            return buildStarCatalog(argv[i + 1], argv[i + 2]);
+        if (std::string(argv[i]) == "--post-benchmark")
+            postBenchmark = true; // needs the GL context, run below
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);//the application is requesting an OpenGL 3.x context
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);//ask for OpenGL 4.3 first for multi-draw indirect, fall back to 3.3 below
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE); // using OpenGL core version
+    glfwWindowHint(GLFW_VISIBLE, postBenchmark ? GLFW_FALSE : GLFW_TRUE); // the benchmark draws offscreen
+    glfwWindowHint(GLFW_DEPTH_BITS, 0); // everything depth tested goes to the HDR target (post_process.h), which has its own
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -100,6 +335,12 @@ int main()
     // --------------------
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL); // H W Title
     if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);//the application is requesting an OpenGL 3.x context
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    }
+    if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -120,77 +361,76 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    GLExt::Load((GLADloadproc)glfwGetProcAddress);
+    std::cout << "OpenGL " << GLExt::Major << "." << GLExt::Minor
+              << (GLExt::HasMultiDrawIndirect ? ", multi-draw indirect" : ", GL 3.3 draw fallback")
+              << (REVERSE_Z && GLExt::HasClipControl ? ", reverse-Z" : "") << std::endl;
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    GLState::Get().SetDebug(GL_STATE_DEBUG);
+    GLState::Get().SetDepthTest(true);
+    GLState::Get().SetReverseZ(REVERSE_Z);
+    GLState::Get().SetDepthFunc(GLState::Get().DepthTestFunc()); // the sky is drawn at the far plane, so LESS (GREATER) would reject it
+    glEnable(GL_PROGRAM_POINT_SIZE); // the star sprites size themselves in stars.vs
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); // filter across cubemap face edges, so the sky has no seams
+    if (postBenchmark)
+    {
+        int result = runPostBenchmark();
+        glfwTerminate();
+        return result;
+    }
+
+    // camera matrices live in one uniform buffer that every program reads through its FrameData block
+    FrameUniforms frameUniforms;
+    // the sun's occluders, rebuilt every frame into a second uniform block
+    EclipseShadows eclipseShadows;
 
     // build and compile shaders
     // -------------------------
-    Shader shader("src/10.2.instancing.vs", "src/10.2.instancing.fs"); //vs -> vertex shader, fs->fragment shader
+    // linked programs are cached on disk, so on a warm start this only loads binaries
+    double shaderStart = glfwGetTime();
+    // scene.vs/scene.fs are compiled per feature set (see shader_variants.h) as the renderer asks for them
+    ShaderVariants sceneShaders("src/scene.vs", "src/scene.fs", [&frameUniforms, &eclipseShadows](Shader& variant, unsigned int mask) {
+        frameUniforms.Attach(variant);
+        variant.use();
+        variant.setInt((mask & VARIANT_ATLAS) ? "texture_atlas" : "texture_diffuse1", 0);
+        if (mask & VARIANT_PBR)
+        {
+            variant.setInt("prefilterMap", 1);
+            variant.setInt("brdfLUT", 2);
+            eclipseShadows.Attach(variant);
+            variant.setInt("casterShadows", EclipseShadows::TEXTURE_UNIT);
+        }
+    });
+    unsigned int shading = PBR_SHADING ? unsigned(VARIANT_PBR) : 0u;
+    Shader& shader = sceneShaders.Get(VARIANT_INSTANCED | shading); //vs -> vertex shader, fs->fragment shader
+    Shader& atlasShader = sceneShaders.Get(VARIANT_INSTANCED | VARIANT_ATLAS | shading);
+    Shader& terrainShader = sceneShaders.Get(shading); // terrain patches come from their own buffers, one model matrix per planet
     Shader skyboxShader("src/6.1.skybox.vs", "src/6.1.skybox.fs");
-
-    // set up vertex data (and buffer(s)) and configure vertex attributes
-    // ------------------------------------------------------------------
-   
-    float skyboxVertices[] = {
-        // positions          
-        -1.0f,  1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-        -1.0f,  1.0f, -1.0f,
-         1.0f,  1.0f, -1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-         1.0f, -1.0f,  1.0f
-    };
-
-    //VAOs (Container for VBOs) are used to encapsulate vertex attribute configurations. Contain multiple VBOs.
-    //VBOs (vertex data, position, color) are used to store vertex data.
-    //EBOs (Element Buffer Object) or IBO (Index Buffer Object): An optional OpenGL object used for indexed rendering. In indexed rendering, instead of duplicating vertex data for shared vertices (e.g., in triangles), you use an EBO to specify a list of indices that reference vertices in the VBO.
-
-    unsigned int skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-
+    skyboxShader.Setup = [&frameUniforms](Shader& skybox) { frameUniforms.Attach(skybox); }; // runs again after a hot reload
+    skyboxShader.Setup(skyboxShader);
+    Shader starShader("src/stars.vs", "src/stars.fs");
+    starShader.Setup = [&frameUniforms](Shader& stars) { frameUniforms.Attach(stars); };
+    starShader.Setup(starShader);
+    Shader textShader("src/text.vs", "src/text.fs");
+    textShader.Setup = [](Shader& text) { text.use(); text.setInt("glyphAtlas", 0); };
+    textShader.Setup(textShader);
+    Shader shadowDepthShader("src/shadow_depth.vs", "src/shadow_depth.fs");
+    // the scene is drawn in HDR and brought to the window with bloom and exposure (see post_process.h)
+    PostProcess postProcess;
+    postProcess.AutoExposure = AUTO_EXPOSURE;
+    postProcess.FixedExposure = EXPOSURE;
+    postProcess.BloomStrength = BLOOM_STRENGTH;
+    const ProgramCache::Stats& programStats = ProgramCache::Get().GetStats();
+    std::cout << "Shaders ready in " << (glfwGetTime() - shaderStart) * 1000.0 << " ms (" << programStats.hits << " cached, "
+              << programStats.misses + programStats.rejected << " compiled, " << programStats.rejected << " rejected)" << std::endl;
+    std::cout << "Post-processing: HDR with " << PostProcess::BLOOM_LEVELS << " bloom levels, "
+              << (AUTO_EXPOSURE && postProcess.AutoExposureSupported() ? "auto exposure on the GPU" : "fixed exposure") << std::endl;
+
+    // the sky and the debug overlay make their vertices from gl_VertexID, but core profile draws still need a VAO
+    unsigned int emptyVAO;
+    glGenVertexArrays(1, &emptyVAO);
 
     vector<std::string> faces
     {
@@ -201,23 +441,102 @@ int main()
             "resources/textures/skybox/front.jpg",
             "resources/textures/skybox/back.jpg"
     };
-    unsigned int cubemapTexture = loadCubemap(faces);
+    double skyboxStart = glfwGetTime();
+    Skybox skybox;
+    bool panorama = *SKYBOX_PANORAMA && skybox.LoadEquirect(SKYBOX_PANORAMA);
+    if (!panorama)
+        skybox.LoadFaces(faces);
+    const Skybox::Timing& skyboxTiming = skybox.GetTiming();
+    std::cout << "Skybox: " << skyboxTiming.faceSize << "px faces in " << (glfwGetTime() - skyboxStart) * 1000.0 << " ms (read " << skyboxTiming.readMs
+              << ", decode " << skyboxTiming.decodeMs << ", resample " << skyboxTiming.resampleMs << ", cache " << skyboxTiming.cacheMs
+              << (skyboxTiming.cacheHit ? " hit" : "") << ", upload " << skyboxTiming.uploadMs << " ms)" << std::endl;
+
+    // the sky's light for the PBR shading, convolved once and then read from texture_cache/
+    EnvironmentLighting environment;
+    if (PBR_SHADING)
+    {
+        environment.Build(skybox.ID, panorama ? SKYBOX_PANORAMA : faces[0]);
+        frameUniforms.SetIrradiance(environment.Irradiance());
+        const EnvironmentLighting::Timing& environmentTiming = environment.GetTiming();
+        std::cout << "Environment lighting: harmonics " << environmentTiming.harmonicsMs << " ms (" << EnvironmentLighting::SimdName() << "), prefilter "
+                  << environmentTiming.prefilterMs << " ms, BRDF LUT " << environmentTiming.lutMs << " ms, cache " << environmentTiming.cacheMs << " ms"
+                  << (environmentTiming.cacheHit ? " hit" : "") << (environmentTiming.lutCacheHit ? " (LUT hit)" : "") << std::endl;
+    }
+
+    // the stars in front of the skybox; a prebuilt catalog only needs reading, otherwise a sky is generated
+    double starStart = glfwGetTime();
+    StarCatalog starCatalog;
+    bool starsLoaded = std::filesystem::exists(STAR_CATALOG_PATH) && starCatalog.Load(STAR_CATALOG_PATH);
+    if (!starsLoaded)
+        starCatalog.Build(StarCatalog::Generate(STAR_COUNT));
+    std::cout << "Stars: " << starCatalog.GetStats().stars << (starsLoaded ? " loaded" : " generated") << " in " << (glfwGetTime() - starStart) * 1000.0 << " ms (" << MemoryUsage::Megabytes(starCatalog.Memory().gpuBytes) << " MB GPU)" << std::endl;
 
     // load models
     // -----------
-    Model planet("resources/objects/sun/Neptune.obj");
-    Model planet1("resources/objects/mercury/Neptune.obj");
-    Model planet2("resources/objects/venus/Neptune.obj");
+    // model textures are decoded on worker threads and streamed in over the first frames
+    TextureStreamer textureStreamer;
+    TextureManager::Get().SetStreamer(&textureStreamer);
+    AllocationTracker::Scope importAllocations;
+    // the plain spheres are built in code and share one set of LOD meshes; only their maps are loaded
+    Model planet(SPHERE_KIND, "resources/objects/sun/euvi_aia304_2012_carrington_print.jpg");
+    Model planet1(SPHERE_KIND, "resources/objects/mercury/mer.jpg");
+    Model planet2(SPHERE_KIND, "resources/objects/venus/ezgif.com-webp-to-jpg.jpg");
     Model planet3("resources/objects/earth/Earth.obj");
     Model planet4("resources/objects/mars/planet.obj");
-    Model planet5("resources/objects/jupiter/jupiter.obj");
+    Model planet5(SPHERE_KIND, "resources/objects/jupiter/cassini_propagated_00.0100.jpg");
     Model planet6("resources/objects/Saturn/saturn1.obj");
     Model planet7("resources/objects/Uranus/saturn1.obj");
-    Model planet8("resources/objects/neptune/Neptune.obj");
-    Model planet9("resources/objects/moon/Neptune.obj");
+    Model planet8(SPHERE_KIND, "resources/objects/neptune/Neptune.jpg");
+    Model planet9(SPHERE_KIND, "resources/objects/moon/lroc_color_poles_1k.jpg");
     Model star("resources/objects/star/mc-stars1.obj"); ///removed
     Model satelite("resources/objects/satellite/source/SatelliteSubstancePainter.obj");
     Model ship("resources/objects/spaceship/source/Vigil/Vigil.obj");
+    // the sun gives the light rather than taking it; the craft are painted metal, the rocks are dull
+    planet.emissive = true;
+    for (Model* craft : { &satelite, &ship })
+    {
+        craft->metallic = 0.8f;
+        craft->roughness = 0.35f;
+    }
+    star.roughness = 0.95f;
+    std::cout << "Models imported in " << importAllocations.Milliseconds() << " ms, " << importAllocations.Allocations() << " heap allocations ("
+              << MemoryUsage::Megabytes(importAllocations.AllocatedBytes()) << " MB)" << std::endl;
+    std::cout << "Sphere LODs: " << SphereLibrary::Get().GetStats().triangles << " triangles built in "
+              << SphereLibrary::Get().GetStats().milliseconds << " ms" << std::endl;
+
+    // pack the small bodies' textures (sun, mercury, moon, the ship) into one texture array
+    TextureAtlas atlas;
+    {
+        std::vector<std::string> files;
+        for (Model* model : { &planet, &planet1, &planet9, &star, &ship })
+        {
+            std::vector<std::string> modelFiles = model->DiffuseFiles();
+            files.insert(files.end(), modelFiles.begin(), modelFiles.end());
+        }
+        atlas.Build(files);
+        for (Model* model : { &planet, &planet1, &planet9, &star, &ship })
+            model->UseAtlas(atlas);
+    }
+
+    const TextureManager::Stats& textureStats = TextureManager::Get().GetStats();
+    std::cout << "Textures: " << textureStats.decodes << " decoded, "
+              << textureStats.pathHits + textureStats.contentHits << " shared ("
+              << textureStats.contentHits << " by content), " << textureStats.streamed << " streaming" << std::endl;
+
+    // meshes drop their CPU copies once they are in the geometry pool; streamed textures count as
+    // their placeholder until they arrive
+    MemoryUsage meshMemory;
+    for (Model* model : { &planet, &planet1, &planet2, &planet3, &planet4, &planet5, &planet6, &planet7, &planet8, &planet9, &star, &satelite, &ship })
+        meshMemory += model->Memory(false);
+    meshMemory += SphereLibrary::Get().Memory();
+    MemoryUsage textureMemory = TextureManager::Get().Memory();
+    textureMemory += atlas.Memory();
+    textureMemory += skybox.Memory();
+    textureMemory += environment.Memory();
+    MemoryUsage poolMemory = GeometryPool::Get().Memory();
+    std::cout << "Memory: meshes " << MemoryUsage::Megabytes(meshMemory.cpuBytes) << " MB CPU / " << MemoryUsage::Megabytes(meshMemory.gpuBytes) << " MB GPU"
+              << " (pool " << MemoryUsage::Megabytes(poolMemory.gpuBytes) << " MB allocated), textures "
+              << MemoryUsage::Megabytes(textureMemory.gpuBytes) << " MB GPU" << std::endl;
 
 
 
@@ -256,6 +575,76 @@ int main()
         modelMatrices[i] = model;
     }
 
+    // edits to the watched files show up within a frame or two; see hot_reload.h
+    std::unique_ptr<FileWatcher> watcher;
+    std::unique_ptr<HotReload> hotReload;
+    if (HOT_RELOAD)
+    {
+        watcher.reset(new FileWatcher({ "src", "resources", "Shaders" }));
+        hotReload.reset(new HotReload(*watcher));
+        hotReload->Watch(sceneShaders);
+        hotReload->Watch(skyboxShader);
+        hotReload->Watch(starShader);
+        hotReload->Watch(textShader);
+        hotReload->Watch(shadowDepthShader);
+        for (Shader* post : { &postProcess.DownsampleShader, &postProcess.UpsampleShader, &postProcess.TonemapShader })
+            hotReload->Watch(*post);
+        for (Model* model : { &planet, &planet1, &planet2, &planet3, &planet4, &planet5, &planet6, &planet7, &planet8, &planet9, &star, &satelite, &ship })
+            hotReload->Watch(*model);
+        hotReload->Watch(atlas);
+    }
+
+    RenderQueue renderQueue;
+    DrawList drawList(renderQueue, shader, atlasShader, atlas);
+
+    // the belt is static, so its transforms go to the GPU once; only one rock model exists so far,
+    // so there is a single LOD that ends at the far plane (lower-detail rocks go in with AddLod)
+    GpuCulling beltCulling;
+    bool gpuBelt = GPU_CULLING && beltCulling.Supported();
+    if (gpuBelt)
+    {
+        beltCulling.AddLod(star, 1000.0f);
+        beltCulling.SetInstances(modelMatrices, amount);
+    }
+    std::cout << "Asteroid belt: " << (gpuBelt ? "GPU culling and indirect draws" : "CPU submission") << std::endl;
+
+    // close-up surfaces; the patches are built on workers while the camera approaches, the sphere is
+    // drawn until the whole planet is covered
+    PlanetTerrain mercuryTerrain("resources/objects/mercury/mer.jpg");
+    PlanetTerrain moonTerrain("resources/objects/moon/lroc_color_poles_1k.jpg");
+    std::vector<std::pair<Model*, PlanetTerrain*>> terrains = { { &planet1, &mercuryTerrain }, { &planet9, &moonTerrain } };
+    std::vector<PlanetTerrain*> terrainDraws;
+    std::vector<int> terrainReceivers; // EclipseShadows receiver of each of terrainDraws
+    std::vector<int> bodySpheres;      // EclipseShadows sphere of each body, -1 for the sun and the craft
+
+    // the sun and the gas giants hide whatever is behind them; the ringed planets are left out, their
+    // bounds take in the rings. The debug overlay shows the buffer in the lower left corner (key O).
+    OcclusionCuller occlusion;
+    std::vector<glm::mat4> visibleRocks;
+    visibleRocks.reserve(amount);
+    Shader occlusionDebugShader("src/occlusion_debug.vs", "src/occlusion_debug.fs");
+    occlusionDebugShader.use();
+    occlusionDebugShader.setInt("depth", 0);
+    std::vector<unsigned char> occlusionPixels;
+    unsigned int occlusionTexture;
+    glGenTextures(1, &occlusionTexture);
+    GLState::Get().BindTexture(0, GL_TEXTURE_2D, occlusionTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, occlusion.Width(), occlusion.Height(), 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    std::cout << "Occlusion culling: " << (OCCLUSION_CULLING ? "on" : "off") << ", " << occlusion.Width() << "x" << occlusion.Height()
+              << " " << OcclusionCuller::SimdName() << " on " << occlusion.Threads() << " thread(s)" << std::endl;
+    // frame time in the top left corner and the names of the visible bodies (key L)
+    TextRenderer text(HUD_FONT);
+    std::cout << "Text: " << text.GetTiming().atlasSize << "x" << text.GetTiming().atlasSize << " distance field atlas, "
+              << (text.GetTiming().cacheHit ? "cached, read in " : "generated in ") << text.GetTiming().generateMs + text.GetTiming().cacheMs << " ms" << std::endl;
+    const char* bodyNames[] = { "Sun", "Mercury", "Venus", "Earth", "Moon", "Satellite", "Mars", "Jupiter", "Ship", "Saturn", "Uranus", "Neptune" };
+    float smoothedFrameMs = 0.0f;
+    PerfOverlay perfOverlay;
+    bool firstFrame = true;
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
@@ -265,161 +654,322 @@ int main()
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        perfOverlay.BeginFrame();
 
         // input
         // -----
         processInput(window);
+        perfOverlay.Visible = showPerfOverlay;
+
+        // apply edited shaders and assets before anything is drawn with them
+        if (hotReload)
+            hotReload->Update();
+
+        // stream in pending textures, a bounded amount per frame
+        textureStreamer.Update(TEXTURE_UPLOAD_BUDGET);
+        perfOverlay.Phase("update");
 
         // render
         // ------
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
         // configure transformation matrices
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);///45 degree view, Screen ratio (H:W), near clipping, far clipping
+        // the culling below works with the usual GL projection; drawing may use its reverse-Z form
+        glm::mat4 renderProjection = FrameUniforms::Projection(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
         glm::mat4 view = camera.GetViewMatrix(); //This matrix represents the camera's position and orientation in the scene.
-        shader.use(); //using shader (Vertex shader, Fragment Shader)
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-
-        // draw planet
-        glm::mat4 model = glm::mat4(1.0f); //Taking identity matrix for the model
-        model = glm::rotate(model, float(glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));//model, current time, axis (x,y,z)
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));//Translates (moves) the model to a specific position 
-        model = glm::scale(model, glm::vec3(2.0f, 2.0f, 2.0f));//Scales the model by a factor of 2 in all three dimensions. (Resizing Model)
-        shader.setMat4("model", model);
-        planet.Draw(shader);
-
-
-        // mercury
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*1), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(25.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-        shader.setMat4("model", model);
-        planet1.Draw(shader);
-        //venus
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*0.73), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(30.0f, 0.0f, 13.0f));
-        model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-        shader.setMat4("model", model);
-        planet2.Draw(shader);
-
-        //earth
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*0.62), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(35.0f, 0.0f, 27.0f));
-        model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-        shader.setMat4("model", model);
-        planet3.Draw(shader);
-
-        //moon
-        // model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*2), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(10.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-        shader.setMat4("model", model);
-        planet9.Draw(shader);
-
-        //earth
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime() * 0.62), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(35.0f, 0.0f, 27.0f));
-        model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-        shader.setMat4("model", model);
-        planet3.Draw(shader);
-
-        //SATELITE
-        // model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime() * 2), glm::vec3(0.0f, 1.0f, 1.0f));
-        model = glm::translate(model, glm::vec3(5.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-        shader.setMat4("model", model);
-        satelite.Draw(shader);
-
-
-        //mars
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*0.50), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(40.0f, 0.0f, 40.0f));
-        model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
-        shader.setMat4("model", model);
-        planet4.Draw(shader);
-
-        //jupiter
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*0.27), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(50.0f, 0.0f, 70.0f));
-        model = glm::scale(model, glm::vec3(1.8f, 1.8f, 1.8f));
-        shader.setMat4("model", model);
-        planet5.Draw(shader);
-
-        //spaceship
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime() * 0.27), glm::vec3(0.0f, 1.0f, 1.0f));
-        model = glm::translate(model, glm::vec3(20.0f, 0.0f, 40.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        shader.setMat4("model", model);
-        ship.Draw(shader);
-
-        //saturn
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*0.20), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(64.0f, 0.0f, 120.0f));
-        model = glm::scale(model, glm::vec3(4.8f, 4.8f, 4.8f));
-        shader.setMat4("model", model);
-        planet6.Draw(shader);
-
-        //uranus
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*0.14), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(75.0f, 0.0f, 175.0f));
-        model = glm::scale(model, glm::vec3(2.0f, 2.0f, 2.0f));
-        shader.setMat4("model", model);
-        planet7.Draw(shader);
-
-        //neptune
-        model = glm::mat4(1.0f);
-        model = glm::rotate(model, float(glfwGetTime()*0.11), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(84.0f, 0.0f, 215.0f));
-        model = glm::scale(model, glm::vec3(3.0f, 3.0f, 3.0f));
-        shader.setMat4("model", model);
-        planet8.Draw(shader);
-
-        // draw meteorites
-        for (unsigned int i = 0; i < amount; i++)
+
+        // place the bodies: spin/orbit around an axis, move out to the orbit, resize (Model -> World)
+        float time = static_cast<float>(glfwGetTime());
+        glm::vec3 up(0.0f, 1.0f, 0.0f);
+        glm::mat4 sunModel = orbitMatrix(time, up, glm::vec3(0.0f, 0.0f, 0.0f), 2.0f * SPHERE_RADIUS);
+        glm::mat4 mercuryModel = orbitMatrix(time * 1.0f, up, glm::vec3(25.0f, 0.0f, 0.0f), 0.2f * SPHERE_RADIUS);
+        glm::mat4 venusModel = orbitMatrix(time * 0.73f, up, glm::vec3(30.0f, 0.0f, 13.0f), 0.5f * SPHERE_RADIUS);
+        glm::mat4 earthModel = orbitMatrix(time * 0.62f, up, glm::vec3(35.0f, 0.0f, 27.0f), 0.5f);
+        glm::mat4 moonModel = orbitMatrix(time * 2.0f, up, glm::vec3(10.0f, 0.0f, 0.0f), 0.2f * SPHERE_RADIUS, earthModel);                          // orbits the earth
+        glm::mat4 satelliteModel = orbitMatrix(time * 2.0f, glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(5.0f, 0.0f, 0.0f), 0.2f, earthModel); // orbits the earth
+        glm::mat4 marsModel = orbitMatrix(time * 0.50f, up, glm::vec3(40.0f, 0.0f, 40.0f), 0.25f);
+        glm::mat4 jupiterModel = orbitMatrix(time * 0.27f, up, glm::vec3(50.0f, 0.0f, 70.0f), 1.8f * SPHERE_RADIUS);
+        glm::mat4 shipModel = orbitMatrix(time * 0.27f, glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(20.0f, 0.0f, 40.0f), 0.1f);
+        glm::mat4 saturnModel = orbitMatrix(time * 0.20f, up, glm::vec3(64.0f, 0.0f, 120.0f), 4.8f);
+        glm::mat4 uranusModel = orbitMatrix(time * 0.14f, up, glm::vec3(75.0f, 0.0f, 175.0f), 2.0f);
+        glm::mat4 neptuneModel = orbitMatrix(time * 0.11f, up, glm::vec3(84.0f, 0.0f, 215.0f), 3.0f * SPHERE_RADIUS);
+
+        std::vector<std::pair<Model*, glm::mat4>> bodies = {
+            { &planet, sunModel }, { &planet1, mercuryModel }, { &planet2, venusModel }, { &planet3, earthModel },
+            { &planet9, moonModel }, { &satelite, satelliteModel }, { &planet4, marsModel }, { &planet5, jupiterModel },
+            { &ship, shipModel }, { &planet6, saturnModel }, { &planet7, uranusModel }, { &planet8, neptuneModel }
+        };
+
+        frameUniforms.SetSun(glm::vec3(sunModel[3]), SUN_INTENSITY);
+        frameUniforms.Update(view, renderProjection, camera.Position, time, 0.1f, 1000.0f);
+
+        // queue the bodies and the meteorites; the queue sorts them by program and texture and
+        // draws each run of identical state as one multi-draw
+        GeometryPool::Get().ResetStats();
+        GLState::Get().ResetCounters();
+        renderQueue.Clear();
+        drawList.SetCamera(camera.Position, 1000.0f);
+        if (OCCLUSION_CULLING)
+        {
+            occlusion.Begin(projection * view);
+            for (auto& occluder : { std::make_pair(&planet, sunModel), std::make_pair(&planet5, jupiterModel), std::make_pair(&planet8, neptuneModel) })
+            {
+                glm::vec4 bounds = worldBounds(occluder.first->Bounds(), occluder.second);
+                occlusion.AddOccluder(glm::vec3(bounds), bounds.w);
+            }
+            occlusion.Rasterize();
+        }
+        // every round body can eclipse the sun for the others, visible or not; the craft are not
+        // round, so they get caster maps
+        eclipseShadows.Begin(glm::vec3(sunModel[3]), planet.BodyRadius() * glm::length(glm::vec3(sunModel[0])));
+        bodySpheres.assign(bodies.size(), -1);
+        for (size_t i = 0; i < bodies.size(); i++)
         {
-            shader.setMat4("model", modelMatrices[i]);
-            star.Draw(shader);
+            const Model* model = bodies[i].first;
+            const glm::mat4& transform = bodies[i].second;
+            if (model == &ship || model == &satelite)
+                eclipseShadows.AddCaster(*model, transform);
+            else if (model != &planet && model->BodyRadius() > 0.0f)
+                bodySpheres[i] = eclipseShadows.AddSphere(glm::vec3(transform[3]), model->BodyRadius() * glm::length(glm::vec3(transform[0])));
         }
-        
-        // draw skybox as last
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
+
+        terrainDraws.clear();
+        terrainReceivers.clear();
+        for (size_t i = 0; i < bodies.size(); i++)
+        {
+            auto& body = bodies[i];
+            glm::vec4 bounds = worldBounds(body.first->Bounds(), body.second);
+            if (OCCLUSION_CULLING && !occlusion.IsVisible(glm::vec3(bounds), bounds.w))
+                continue;
+            if (showLabels)
+            {
+                // names grow with the body on screen, within limits; the distance field atlas keeps every size sharp
+                float pixelsPerRadian = (float)SCR_HEIGHT / glm::radians(45.0f);
+                float screenRadius = bounds.w / glm::max(glm::length(glm::vec3(bounds) - camera.Position), 0.001f) * pixelsPerRadian;
+                text.AddLabel(bodyNames[i], glm::vec3(bounds) + glm::vec3(camera.Up) * bounds.w, projection * view, glm::vec2(SCR_WIDTH, SCR_HEIGHT),
+                              glm::vec4(0.8f, 0.85f, 1.0f, 0.9f), glm::clamp(screenRadius / 40.0f, 0.8f, 3.0f));
+            }
+            int receiver = body.first == &planet ? -1 : eclipseShadows.AddReceiver(glm::vec3(bounds), bounds.w, bodySpheres[i]);
+            PlanetTerrain* terrain = nullptr;
+            for (auto& candidate : terrains)
+                if (candidate.first == body.first && glm::length(camera.Position - glm::vec3(bounds)) < TERRAIN_DISTANCE * bounds.w)
+                    terrain = candidate.second;
+            if (terrain)
+            {
+                terrain->Update(body.second, projection * view, camera.Position, (float)SCR_HEIGHT, glm::radians(45.0f));
+                if (terrain->Ready())
+                {
+                    terrainDraws.push_back(terrain);
+                    terrainReceivers.push_back(receiver);
+                    continue;
+                }
+            }
+            drawList.Add(*body.first, body.second, receiver);
+        }
+        if (gpuBelt)
+            beltCulling.Cull(projection * view, camera.Position); // frustum and distance only, the rocks stay on the GPU
+        else if (OCCLUSION_CULLING)
+        {
+            glm::vec4 rockBounds = star.Bounds();
+            visibleRocks.clear();
+            for (unsigned int i = 0; i < amount; i++)
+            {
+                glm::vec4 bounds = worldBounds(rockBounds, modelMatrices[i]);
+                if (occlusion.IsVisible(glm::vec3(bounds), bounds.w))
+                    visibleRocks.push_back(modelMatrices[i]);
+            }
+            drawList.AddInstances(star, visibleRocks.data(), static_cast<unsigned int>(visibleRocks.size()));
+        }
+        else
+            drawList.AddInstances(star, modelMatrices, amount);
+        if (PBR_SHADING)
+            eclipseShadows.Upload();
+        perfOverlay.Phase("cull");
+        if (PBR_SHADING)
+        {
+            perfOverlay.BeginPass("shadows");
+            eclipseShadows.RenderCasterMaps(shadowDepthShader);
+            perfOverlay.EndPass();
+        }
+        perfOverlay.BeginPass("scene");
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        postProcess.Begin(framebufferWidth, framebufferHeight); // clears the HDR target the scene and sky go to
+        if (PBR_SHADING)
+        {
+            // the batches only rebind unit 0, so the sky's lighting stays on units 1 and 2 for the whole pass
+            GLState::Get().BindTexture(1, GL_TEXTURE_CUBE_MAP, environment.PrefilterMap);
+            GLState::Get().BindTexture(2, GL_TEXTURE_2D, environment.BrdfLut);
+        }
+        renderQueue.Execute();
+        for (size_t i = 0; i < terrainDraws.size(); i++)
+        {
+            terrainShader.use();
+            terrainShader.setFloat("receiver", float(terrainReceivers[i]));
+            terrainDraws[i]->Draw(terrainShader);
+        }
+        if (gpuBelt)
+        {
+            beltCulling.Draw(shader, atlasShader, atlas);
+            if (GPU_CULLING_VALIDATE && !beltCulling.Validate())
+                std::cout << "ERROR::GPU_CULLING::VALIDATION_FAILED" << std::endl;
+        }
+        perfOverlay.EndPass();
+        perfOverlay.Phase("submit");
+        if (firstFrame)
+        {
+            const RenderQueue::Stats& queueStats = renderQueue.GetStats();
+            const GLState::Counters& stateCounters = GLState::Get().GetCounters();
+            std::cout << "Frame draw calls: " << GeometryPool::Get().GetStats().drawCalls << " for "
+                      << GeometryPool::Get().GetStats().commands << " commands (" << queueStats.items << " items)" << std::endl;
+            std::cout << "State changes unsorted/sorted: program " << queueStats.unsortedProgramChanges << "/" << queueStats.programChanges
+                      << ", texture " << queueStats.unsortedTextureChanges << "/" << queueStats.textureChanges
+                      << ", VAO " << queueStats.unsortedVaoChanges << "/" << queueStats.vaoChanges << std::endl;
+            if (OCCLUSION_CULLING)
+                std::cout << "Occlusion: " << occlusion.GetStats().triangles << " occluder triangles in " << occlusion.GetStats().rasterMs << " ms, pyramid "
+                          << occlusion.GetStats().pyramidMs << " ms, " << occlusion.GetStats().culled << " of " << occlusion.GetStats().tested << " culled" << std::endl;
+            std::cout << "GL state calls issued/requested: program " << stateCounters.program.issued << "/" << stateCounters.program.requested
+                      << ", VAO " << stateCounters.vao.issued << "/" << stateCounters.vao.requested
+                      << ", buffer " << stateCounters.buffer.issued << "/" << stateCounters.buffer.requested
+                      << ", texture " << stateCounters.texture.issued << "/" << stateCounters.texture.requested
+                      << ", depth " << stateCounters.depth.issued << "/" << stateCounters.depth.requested
+                      << ", blend " << stateCounters.blend.issued << "/" << stateCounters.blend.requested << std::endl;
+            firstFrame = false;
+        }
+
+        // draw skybox as last: one fullscreen triangle on the far plane, so the depth test (early, the
+        // shader writes no depth) leaves it only the pixels no geometry covered
+        perfOverlay.BeginPass("sky");
+        GLState::Get().SetDepthMask(false);
+        skyboxShader.use(); // reads FrameData.projection and skyView, the view matrix without its translation
+        GLState::Get().BindVertexArray(emptyVAO);
+        GLState::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, skybox.ID);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // catalog stars over the skybox, added to it
+        GLState::Get().SetBlend(true);
+        GLState::Get().SetBlendFunc(GL_ONE, GL_ONE);
+        starCatalog.Draw(starShader, projection * frameUniforms.Current().skyView, (float)SCR_HEIGHT, glm::radians(45.0f), STAR_LIMITING_MAGNITUDE);
+        GLState::Get().SetBlend(false);
+        GLState::Get().SetDepthMask(true);
+        perfOverlay.EndPass();
+        perfOverlay.Phase("sky");
+
+        // HDR to the window: bloom, exposure and the tonemap; the overlays below draw over the result
+        perfOverlay.BeginPass("post");
+        postProcess.End(deltaTime);
+        perfOverlay.EndPass();
+        perfOverlay.Phase("post");
+
+        // occlusion buffer overlay, drawn over everything
+        if (OCCLUSION_CULLING && showOcclusionBuffer)
+        {
+            occlusion.DebugImage(occlusionPixels);
+            GLState::Get().BindTexture(0, GL_TEXTURE_2D, occlusionTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, occlusion.Width(), occlusion.Height(), GL_RED, GL_UNSIGNED_BYTE, occlusionPixels.data());
+            GLState::Get().SetDepthTest(false);
+            occlusionDebugShader.use();
+            GLState::Get().BindVertexArray(emptyVAO);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            GLState::Get().SetDepthTest(true);
+        }
+
+        // text last, over everything: the frame time, or the performance overlay in its place
+        smoothedFrameMs = smoothedFrameMs > 0.0f ? glm::mix(smoothedFrameMs, deltaTime * 1000.0f, 0.05f) : deltaTime * 1000.0f;
+        if (perfOverlay.Visible)
+        {
+            const GLState::Counters& state = GLState::Get().GetCounters();
+            unsigned int stateRequested = 0, stateIssued = 0;
+            for (const GLState::Counter* counter : { &state.program, &state.vao, &state.buffer, &state.texture, &state.activeTexture, &state.depth, &state.blend })
+            {
+                stateRequested += counter->requested;
+                stateIssued += counter->issued;
+            }
+            const GeometryPool::Stats& pool = GeometryPool::Get().GetStats();
+            size_t triangles = pool.triangles;
+            unsigned int patches = 0;
+            for (PlanetTerrain* terrain : terrainDraws)
+            {
+                triangles += terrain->GetStats().triangles;
+                patches += terrain->GetStats().drawn;
+            }
+            MemoryUsage textures = TextureManager::Get().Memory();
+            textures += atlas.Memory();
+            textures += skybox.Memory();
+            textures += environment.Memory();
+            textures += eclipseShadows.Memory();
+            textures += text.Memory();
+            textures += postProcess.Memory();
+            perfOverlay.Counter("draw calls %u (%u commands), %u queued items", pool.drawCalls + static_cast<unsigned int>(terrainDraws.size()), pool.commands, renderQueue.GetStats().items);
+            perfOverlay.Counter("triangles %.2f M%s, terrain patches %u", triangles / 1e6, gpuBelt ? " + GPU-culled belt" : "", patches);
+            perfOverlay.Counter("state changes %u of %u requested", stateIssued, stateRequested);
+            perfOverlay.Counter("textures %.1f MB, geometry %.1f MB, streamed %.1f MB", MemoryUsage::Megabytes(textures.gpuBytes),
+                                MemoryUsage::Megabytes(GeometryPool::Get().Memory().gpuBytes), MemoryUsage::Megabytes(textureStreamer.GetStats().bytesUploaded));
+            if (OCCLUSION_CULLING)
+                perfOverlay.Counter("occlusion %u of %u culled, raster %.2f ms", occlusion.GetStats().culled, occlusion.GetStats().tested,
+                                    occlusion.GetStats().rasterMs + occlusion.GetStats().pyramidMs);
+            perfOverlay.Counter("stars %u, text %u quads", starCatalog.GetStats().drawn, text.GetStats().quads);
+            perfOverlay.Counter("hdr %dx%d, %d bloom levels, %s exposure", postProcess.Width(), postProcess.Height(), postProcess.BloomLevelCount(),
+                                AUTO_EXPOSURE && postProcess.AutoExposureSupported() ? "auto" : "fixed");
+            if (PBR_SHADING)
+            {
+                const EclipseShadows::Stats& shadowStats = eclipseShadows.GetStats();
+                perfOverlay.Counter("eclipses: %u spheres, %u receivers, %u of %u pairs kept, %u caster maps, %.3f ms", shadowStats.spheres, shadowStats.receivers,
+                                    shadowStats.assigned, shadowStats.tested, shadowStats.casterMaps, shadowStats.selectMs);
+            }
+            perfOverlay.Draw(text, glm::vec2(10.0f, 8.0f));
+        }
+        else
+        {
+            char hud[64];
+            snprintf(hud, sizeof(hud), "%.2f ms (%.0f fps)", smoothedFrameMs, 1000.0f / glm::max(smoothedFrameMs, 0.001f));
+            text.Add(hud, glm::vec2(10.0f, 8.0f));
+        }
+        perfOverlay.BeginPass("text");
+        GLState::Get().SetDepthTest(false);
+        GLState::Get().SetBlend(true);
+        GLState::Get().SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        text.Draw(textShader, glm::vec2(SCR_WIDTH, SCR_HEIGHT));
+        GLState::Get().SetBlend(false);
+        GLState::Get().SetDepthTest(true);
+        perfOverlay.EndPass();
+        perfOverlay.Phase("hud");
+
+        frameUniforms.EndFrame();
+        if (GLState::Get().Debug())
+            GLState::Get().Validate();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        perfOverlay.Phase("present");
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
+    hotReload.reset(); // waits for reloads still running on workers
+    watcher.reset();
     
-    glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &skyboxVBO);
+    skybox.Delete();
+    environment.Delete();
+    eclipseShadows.Delete();
+    starCatalog.Delete();
+    text.Delete();
+    perfOverlay.Delete();
+    postProcess.Delete();
+    glDeleteVertexArrays(1, &emptyVAO);
+    GLState::Get().VertexArrayDeleted(emptyVAO);
+    glDeleteTextures(1, &occlusionTexture);
+    GLState::Get().TextureDeleted(occlusionTexture);
+    atlas.Delete();
+    beltCulling.Delete();
+    mercuryTerrain.Delete();
+    moonTerrain.Delete();
+    frameUniforms.Delete();
+    GeometryPool::Get().Shutdown();
+    TextureManager::Get().SetStreamer(nullptr);
+    TextureManager::Get().Shutdown(); // the models outlive the context, so free their textures now
+    textureStreamer.Shutdown();
 
 
 
@@ -434,6 +984,21 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    bool occlusionKey = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (occlusionKey && !occlusionKeyDown)
+        showOcclusionBuffer = !showOcclusionBuffer;
+    occlusionKeyDown = occlusionKey;
+
+    bool labelsKey = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    if (labelsKey && !labelsKeyDown)
+        showLabels = !showLabels;
+    labelsKeyDown = labelsKey;
+
+    bool perfKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (perfKey && !perfKeyDown)
+        showPerfOverlay = !showPerfOverlay;
+    perfKeyDown = perfKey;
+
     float cameraSpeed = 20.0f * deltaTime; // Adjust the camera speed here
 
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
@@ -0,0 +1,47 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;  // the next larger level, or the frame for the first one
+uniform bool firstLevel;
+
+float luma(vec3 color)
+{
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// halves 'source' with 13 bilinear taps: five overlapping 2x2 texel boxes, the inner one weighted
+// 0.5 and the corner ones 0.125 each, which doesn't alias the way a plain 2x2 average does. On the
+// first level each box also counts 1 / (1 + luma), so a lone very bright pixel can't flicker through
+// the whole chain as it moves.
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec3 a = texture(source, TexCoords + texel * vec2(-2.0, 2.0)).rgb;
+    vec3 b = texture(source, TexCoords + texel * vec2(0.0, 2.0)).rgb;
+    vec3 c = texture(source, TexCoords + texel * vec2(2.0, 2.0)).rgb;
+    vec3 d = texture(source, TexCoords + texel * vec2(-2.0, 0.0)).rgb;
+    vec3 e = texture(source, TexCoords).rgb;
+    vec3 f = texture(source, TexCoords + texel * vec2(2.0, 0.0)).rgb;
+    vec3 g = texture(source, TexCoords + texel * vec2(-2.0, -2.0)).rgb;
+    vec3 h = texture(source, TexCoords + texel * vec2(0.0, -2.0)).rgb;
+    vec3 i = texture(source, TexCoords + texel * vec2(2.0, -2.0)).rgb;
+    vec3 j = texture(source, TexCoords + texel * vec2(-1.0, 1.0)).rgb;
+    vec3 k = texture(source, TexCoords + texel * vec2(1.0, 1.0)).rgb;
+    vec3 l = texture(source, TexCoords + texel * vec2(-1.0, -1.0)).rgb;
+    vec3 m = texture(source, TexCoords + texel * vec2(1.0, -1.0)).rgb;
+
+    vec3 boxes[5] = vec3[5]((j + k + l + m) * 0.25, (a + b + d + e) * 0.25, (b + c + e + f) * 0.25,
+                            (d + e + g + h) * 0.25, (e + f + h + i) * 0.25);
+    float weights[5] = float[5](0.5, 0.125, 0.125, 0.125, 0.125);
+    vec3 color = vec3(0.0);
+    float total = 0.0;
+    for (int n = 0; n < 5; n++)
+    {
+        float weight = firstLevel ? weights[n] / (1.0 + luma(boxes[n])) : weights[n];
+        color += boxes[n] * weight;
+        total += weight;
+    }
+    FragColor = vec4(color / total, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source; // the next smaller level, its own blur and everything below added in
+uniform float radius;     // of the tent, in texels of 'source'
+
+// a 3x3 tent over the smaller level, blended additively into the larger one (see post_process.h);
+// level by level the sum widens into the glow without any pass reading more than nine taps
+void main()
+{
+    vec2 offset = radius / vec2(textureSize(source, 0));
+    vec3 a = texture(source, TexCoords + vec2(-offset.x, offset.y)).rgb;
+    vec3 b = texture(source, TexCoords + vec2(0.0, offset.y)).rgb;
+    vec3 c = texture(source, TexCoords + vec2(offset.x, offset.y)).rgb;
+    vec3 d = texture(source, TexCoords + vec2(-offset.x, 0.0)).rgb;
+    vec3 e = texture(source, TexCoords).rgb;
+    vec3 f = texture(source, TexCoords + vec2(offset.x, 0.0)).rgb;
+    vec3 g = texture(source, TexCoords + vec2(-offset.x, -offset.y)).rgb;
+    vec3 h = texture(source, TexCoords + vec2(0.0, -offset.y)).rgb;
+    vec3 i = texture(source, TexCoords + vec2(offset.x, -offset.y)).rgb;
+    FragColor = vec4((e * 4.0 + (b + d + f + h) * 2.0 + (a + c + g + i)) / 16.0, 1.0);
+}
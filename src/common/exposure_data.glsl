@@ -0,0 +1,10 @@
+// auto exposure state, shared by the two exposure passes (post_process.h)
+#define HISTOGRAM_BINS 256 // PostProcess::HISTOGRAM_BINS
+
+layout (std430, binding = 0) buffer ExposureData {
+    uint histogram[HISTOGRAM_BINS]; // pixels per log-luminance bin; bin 0 holds the black ones
+    float luminance;                // metered luminance, eased towards each frame's own
+    float exposure;                 // what the tonemap scales the frame by
+};
+
+uniform vec2 logLuminance; // x: log2 of the lowest luminance binned, y: log2 range the bins cover
@@ -0,0 +1,12 @@
+// per-frame camera and lighting data, written once a frame by FrameUniforms (frame_uniforms.h)
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 skyView;        // view without translation
+    vec3 cameraPosition;
+    float time;
+    vec4 clipPlanes;     // x: near, y: far, z: NDC depth of the far plane (0 with reverse-Z, else 1)
+    vec4 sunPosition;    // xyz: world position of the sun, w: its intensity
+    vec4 irradiance[9];  // sky irradiance as spherical harmonics, cosine-convolved (environment_lighting.h)
+};
@@ -0,0 +1,12 @@
+// the sun's occluders for this frame, written by EclipseShadows (eclipse_shadows.h)
+#define MAX_SPHERES 16
+#define MAX_RECEIVERS 32
+#define MAX_CASTER_MAPS 2
+layout (std140) uniform ShadowData {
+    vec4 sun;                              // xyz: position, w: radius
+    vec4 spheres[MAX_SPHERES];             // xyz: centre, w: radius
+    ivec4 receivers[MAX_RECEIVERS];        // per receiver, up to 4 indices into spheres, -1 past the last
+    mat4 casterMaps[MAX_CASTER_MAPS];      // world -> caster map texture coordinates and depth
+    vec4 casterFade[MAX_CASTER_MAPS];      // depth * x + y: 0 at the caster, 1 where its shadow has faded
+    ivec4 shadowCounts;                    // x: caster maps in use
+};
@@ -0,0 +1,40 @@
+#version 330 core
+out vec2 FragColor;
+
+in vec2 TexCoords; // x: N.V, y: roughness
+
+#include "common/ggx.glsl"
+
+const uint SAMPLE_COUNT = 512u;
+
+// Smith-Schlick visibility, with the k image-based lighting uses
+float geometrySmith(float NdotV, float NdotL, float roughness)
+{
+    float k = roughness * roughness * 0.5;
+    return (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+}
+
+// scale (x) and bias (y) to F0 of the specular BRDF integrated over the hemisphere
+void main()
+{
+    float NdotV = max(TexCoords.x, 0.001);
+    float roughness = TexCoords.y;
+    vec3 V = vec3(sqrt(1.0 - NdotV * NdotV), 0.0, NdotV);
+    vec3 N = vec3(0.0, 0.0, 1.0);
+    vec2 result = vec2(0.0);
+    for (uint i = 0u; i < SAMPLE_COUNT; i++)
+    {
+        vec3 H = importanceSampleGGX(hammersley(i, SAMPLE_COUNT), N, roughness);
+        vec3 L = normalize(2.0 * dot(V, H) * H - V);
+        float NdotL = max(L.z, 0.0);
+        float NdotH = max(H.z, 0.0);
+        float VdotH = max(dot(V, H), 0.0);
+        if (NdotL > 0.0)
+        {
+            float visibility = geometrySmith(NdotV, NdotL, roughness) * VdotH / (NdotH * NdotV);
+            float fresnel = pow(1.0 - VdotH, 5.0);
+            result += vec2((1.0 - fresnel) * visibility, fresnel * visibility);
+        }
+    }
+    FragColor = result / float(SAMPLE_COUNT);
+}
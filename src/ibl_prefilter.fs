@@ -0,0 +1,59 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "common/ggx.glsl"
+
+uniform samplerCube environment; // the sky, sRGB with its mip chain
+uniform float environmentSize;   // texels along a face of its level 0
+uniform int face;                // cube face being drawn, GL order
+uniform float size;              // texels along a face of the level being drawn
+uniform float roughness;
+
+const uint SAMPLE_COUNT = 256u;
+
+// the GL cube face layout, as in skybox.h
+vec3 faceDirection(int face, vec2 st)
+{
+    if (face == 0) return vec3(1.0, -st.y, -st.x);
+    if (face == 1) return vec3(-1.0, -st.y, st.x);
+    if (face == 2) return vec3(st.x, 1.0, st.y);
+    if (face == 3) return vec3(st.x, -1.0, -st.y);
+    if (face == 4) return vec3(st.x, -st.y, 1.0);
+    return vec3(-st.x, -st.y, -1.0);
+}
+
+vec3 sky(vec3 direction, float lod)
+{
+    return pow(textureLod(environment, direction, lod).rgb, vec3(2.2));
+}
+
+// the sky convolved with the GGX lobe around N, taking V = R = N (the split-sum approximation).
+// Each sample reads the sky mip whose texels cover about the solid angle the sample stands for,
+// so bright stars don't turn into speckles with this few samples.
+void main()
+{
+    vec3 N = normalize(faceDirection(face, gl_FragCoord.xy / size * 2.0 - 1.0));
+    if (roughness == 0.0)
+    {
+        FragColor = vec4(sky(N, log2(environmentSize / size)), 1.0);
+        return;
+    }
+    float texelSolidAngle = 4.0 * PI / (6.0 * environmentSize * environmentSize);
+    vec3 sum = vec3(0.0);
+    float weight = 0.0;
+    for (uint i = 0u; i < SAMPLE_COUNT; i++)
+    {
+        vec3 H = importanceSampleGGX(hammersley(i, SAMPLE_COUNT), N, roughness);
+        vec3 L = normalize(2.0 * dot(N, H) * H - N);
+        float NdotL = dot(N, L);
+        if (NdotL <= 0.0)
+            continue;
+        // pdf of L is D * N.H / (4 * H.V), and H.V = N.H when V = N
+        float pdf = distributionGGX(max(dot(N, H), 0.0), roughness) * 0.25 + 0.0001;
+        float sampleSolidAngle = 1.0 / (float(SAMPLE_COUNT) * pdf + 0.0001);
+        float lod = 0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0;
+        sum += sky(L, max(lod, 0.0)) * NdotL;
+        weight += NdotL;
+    }
+    FragColor = vec4(sum / max(weight, 0.0001), 1.0);
+}
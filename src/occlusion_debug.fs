@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D depth; // occlusion buffer, near is bright
+
+void main()
+{
+    float value = texture(depth, TexCoords).r;
+    FragColor = vec4(vec3(value), 1.0);
+}
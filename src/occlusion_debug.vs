@@ -0,0 +1,10 @@
+#version 330 core
+out vec2 TexCoords;
+
+// a 300x150 pixel quad in the lower left corner of the 1000x800 window, the occlusion buffer's 2:1;
+// the corners come from gl_VertexID, so no vertex buffer is bound
+void main()
+{
+    TexCoords = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(mix(vec2(-0.98, -0.98), vec2(-0.38, -0.605), TexCoords), 0.0, 1.0);
+}
@@ -0,0 +1,151 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+flat in vec4 AtlasRect;   // xy: offset, zw: scale of this mesh's image inside the layer
+flat in float AtlasLayer;
+
+#ifdef ATLAS
+uniform sampler2DArray texture_atlas;
+#else
+uniform sampler2D texture_diffuse1;
+#endif
+
+#ifdef PBR
+in vec3 WorldPos;
+in vec3 Normal;
+flat in vec2 Material;    // x: metallic, or below 0 for an emissive (unlit) surface; y: roughness
+flat in int Receiver;
+
+#include "common/frame_data.glsl"
+#include "common/shadow_data.glsl"
+
+uniform samplerCube prefilterMap; // the sky blurred for roughness 0 ... 1 down the mips
+uniform sampler2D brdfLUT;        // scale and bias to F0 by (N.V, roughness)
+uniform sampler2DArrayShadow casterShadows; // depth of the casters that are not spheres
+
+#include "common/ggx.glsl"
+
+const float PREFILTER_LEVELS = 6.0; // EnvironmentLighting::PREFILTER_LEVELS
+
+// Smith-Schlick visibility with the k of direct lights
+float geometrySmith(float NdotV, float NdotL, float roughness)
+{
+    float k = (roughness + 1.0) * (roughness + 1.0) / 8.0;
+    return (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+}
+
+vec3 fresnelSchlick(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+// irradiance arriving from the sky around n, from the 9 harmonics in FrameData
+vec3 skyIrradiance(vec3 n)
+{
+    return irradiance[0].rgb * 0.282095
+         + irradiance[1].rgb * 0.488603 * n.y + irradiance[2].rgb * 0.488603 * n.z + irradiance[3].rgb * 0.488603 * n.x
+         + irradiance[4].rgb * 1.092548 * n.x * n.y + irradiance[5].rgb * 1.092548 * n.y * n.z
+         + irradiance[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0) + irradiance[7].rgb * 1.092548 * n.x * n.z
+         + irradiance[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// the part of the sun's disc seen from P that no sphere of this receiver's list and no caster map
+// hides. A sphere covering angle a of a sun of angle s at separation d hides up to (a / s)^2 of it,
+// easing in from where the discs touch (d = s + a) to where one is inside the other (d = |s - a|).
+float sunVisibility(vec3 P, vec3 L)
+{
+    float visibility = 1.0;
+    float sunDistance = length(sun.xyz - P);
+    float sunAngle = asin(min(sun.w / sunDistance, 1.0));
+    if (Receiver >= 0)
+    {
+        ivec4 occluders = receivers[Receiver];
+        for (int i = 0; i < 4; i++)
+        {
+            if (occluders[i] < 0)
+                break;
+            vec4 sphere = spheres[occluders[i]];
+            vec3 toSphere = sphere.xyz - P;
+            float distance = length(toSphere);
+            if (distance <= sphere.w || dot(toSphere, L) <= 0.0)
+                continue; // P is on or in it, or it is behind P
+            float sphereAngle = asin(sphere.w / distance);
+            float separation = acos(clamp(dot(toSphere / distance, L), -1.0, 1.0));
+            float covered = min(sphereAngle * sphereAngle / (sunAngle * sunAngle), 1.0);
+            visibility *= 1.0 - covered * (1.0 - smoothstep(abs(sunAngle - sphereAngle), sunAngle + sphereAngle, separation));
+        }
+    }
+    for (int i = 0; i < shadowCounts.x; i++)
+    {
+        vec4 coord = casterMaps[i] * vec4(P, 1.0);
+        if (any(lessThan(coord.xyz, vec3(0.0))) || any(greaterThan(coord.xyz, vec3(1.0))))
+            continue;
+        // 3x3 bilinear comparisons, and the shadow thinning out behind the caster as the sun's disc
+        // gets round it
+        float lit = 0.0;
+        vec2 texel = 1.0 / vec2(textureSize(casterShadows, 0).xy);
+        for (int y = -1; y <= 1; y++)
+            for (int x = -1; x <= 1; x++)
+                lit += texture(casterShadows, vec4(coord.xy + vec2(x, y) * texel, float(i), coord.z));
+        float fade = clamp(coord.z * casterFade[i].x + casterFade[i].y, 0.0, 1.0);
+        visibility *= mix(lit / 9.0, 1.0, fade);
+    }
+    return visibility;
+}
+
+// Cook-Torrance under the sun, plus the sky as image-based light (split sum)
+vec3 shade(vec3 albedo, float metallic, float roughness)
+{
+    vec3 N = normalize(Normal);
+    vec3 V = normalize(cameraPosition - WorldPos);
+    float NdotV = max(dot(N, V), 0.0001);
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+
+    // the sun is a point light with no falloff: the distances in the scene are not to scale
+    vec3 L = normalize(sunPosition.xyz - WorldPos);
+    vec3 H = normalize(V + L);
+    float NdotL = max(dot(N, L), 0.0);
+    vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0, 0.0);
+    vec3 specular = distributionGGX(max(dot(N, H), 0.0), roughness) * geometrySmith(NdotV, NdotL, roughness) * F / (4.0 * NdotV * max(NdotL, 0.0001));
+    vec3 diffuse = (1.0 - F) * (1.0 - metallic) * albedo / PI;
+    vec3 direct = (diffuse + specular) * sunPosition.w * NdotL;
+    if (NdotL > 0.0)
+        direct *= sunVisibility(WorldPos, L);
+
+    vec3 ambientF = fresnelSchlick(NdotV, F0, roughness);
+    vec3 ambientDiffuse = (1.0 - ambientF) * (1.0 - metallic) * albedo * skyIrradiance(N) / PI;
+    vec3 R = reflect(-V, N);
+    vec3 prefiltered = textureLod(prefilterMap, R, roughness * (PREFILTER_LEVELS - 1.0)).rgb;
+    vec2 brdf = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+    vec3 ambientSpecular = prefiltered * (ambientF * brdf.x + brdf.y);
+    return direct + ambientDiffuse + ambientSpecular;
+}
+#endif
+
+void main()
+{
+#ifdef ATLAS
+    // fract() keeps GL_REPEAT behaviour inside the sub-rectangle; the gradients come from the
+    // unwrapped coordinates so the wrap doesn't drop to the smallest mip along the seam
+    vec2 uv = AtlasRect.xy + fract(TexCoords) * AtlasRect.zw;
+    vec2 dx = dFdx(TexCoords) * AtlasRect.zw;
+    vec2 dy = dFdy(TexCoords) * AtlasRect.zw;
+    vec4 base = textureGrad(texture_atlas, vec3(uv, AtlasLayer), dx, dy);
+#else
+    vec4 base = texture(texture_diffuse1, TexCoords);
+#endif
+    // the maps are sRGB; the frame is linear HDR, encoded for the screen by the tonemap (post_process.h)
+    vec3 albedo = pow(base.rgb, vec3(2.2));
+#ifdef PBR
+    if (Material.x < 0.0)
+    {
+        // emissive: as bright as the sun's intensity makes it, well over 1, so it blooms
+        FragColor = vec4(albedo * sunPosition.w, base.a);
+        return;
+    }
+    FragColor = vec4(shade(albedo, Material.x, clamp(Material.y, 0.04, 1.0)), base.a);
+#else
+    FragColor = vec4(albedo, base.a);
+#endif
+}
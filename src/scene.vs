@@ -0,0 +1,67 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+layout (location = 7) in mat4 aModel;      // per draw, takes locations 7-10
+layout (location = 11) in vec4 aAtlasRect; // per draw
+layout (location = 12) in vec4 aParams;    // per draw, x: atlas layer, zw: material (see below)
+layout (location = 13) in vec4 aLighting;  // per draw, x: eclipse receiver
+#else
+uniform mat4 model;
+uniform vec4 atlasRect = vec4(0.0, 0.0, 1.0, 1.0);
+uniform float atlasLayer = -1.0;
+uniform vec2 material = vec2(0.0, 0.9);
+uniform float receiver = -1.0;
+#endif
+
+#include "common/frame_data.glsl"
+
+out vec2 TexCoords;
+flat out vec4 AtlasRect;
+flat out float AtlasLayer;
+#ifdef PBR
+out vec3 WorldPos;
+out vec3 Normal;
+flat out vec2 Material; // x: metallic, or below 0 for an emissive (unlit) surface; y: roughness
+flat out int Receiver;  // this draw's occluder list in ShadowData, -1 for none
+#endif
+
+void main()
+{
+    TexCoords = aTexCoords;
+#ifdef INSTANCED
+    AtlasRect = aAtlasRect;
+    AtlasLayer = aParams.x;
+    mat4 world = aModel;
+#ifdef PBR
+    Material = aParams.zw;
+    Receiver = int(aLighting.x);
+#endif
+#else
+    AtlasRect = atlasRect;
+    AtlasLayer = atlasLayer;
+    mat4 world = model;
+#ifdef PBR
+    Material = material;
+    Receiver = int(receiver);
+#endif
+#endif
+    vec4 position = world * vec4(aPos, 1.0f);
+#ifdef PBR
+    // every body is scaled uniformly, so the model matrix itself turns the normals
+    WorldPos = position.xyz;
+    Normal = mat3(world) * aNormal;
+#endif
+    gl_Position = viewProjection * position;
+#ifdef LOG_DEPTH
+    // per-vertex logarithmic depth: spreads precision evenly over [near, far] on a log scale.
+    // Reverse-Z clips to [0, w] and keeps the nearer fragment with GEQUAL, so there the mapping
+    // falls from w to 0 with distance; otherwise it rises through the usual [-w, w]
+    float logDepth = log2(max(1e-6, 1.0 + gl_Position.w)) / log2(clipPlanes.y + 1.0);
+    if (clipPlanes.z == 0.0)
+        gl_Position.z = (1.0 - logDepth) * gl_Position.w;
+    else
+        gl_Position.z = (logDepth * 2.0 - 1.0) * gl_Position.w;
+#endif
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+// depth only; the caster maps have no color attachment
+void main()
+{
+}
@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 lightMatrix; // the caster map's view and projection (eclipse_shadows.h)
+uniform mat4 model;
+
+void main()
+{
+    gl_Position = lightMatrix * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Color;
+
+// a soft round sprite; blended additively over the sky
+void main()
+{
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    float r2 = dot(offset, offset);
+    if (r2 > 1.0)
+        discard;
+    FragColor = vec4(Color * exp(-4.0 * r2), 1.0);
+}
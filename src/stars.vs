@@ -0,0 +1,41 @@
+#version 330 core
+layout (location = 0) in vec3 aDirection;  // unit direction towards the star
+layout (location = 1) in float aMagnitude; // apparent magnitude, times 1000
+layout (location = 2) in vec3 aColor;
+
+out vec3 Color;
+
+#include "common/frame_data.glsl"
+
+uniform float limitingMagnitude;
+uniform float pixelsPerRadian; // viewport height over the vertical field of view
+
+const float STAR_ANGLE = 0.0015;   // sprite diameter of an unsaturated star, radians (2 px at 1080p, 45 degrees)
+const float MIN_SPRITE = 2.0;      // pixels; smaller sprites get dimmer instead, keeping their light
+const float SATURATION = 5.5;      // magnitudes above the limit where a star reaches full intensity
+
+// stars brighter than the limit get brighter, past full intensity they grow; sizes are angles, so a
+// star covers the same part of the sky and sends the same light at any resolution
+void main()
+{
+    float magnitude = aMagnitude * 0.001;
+    if (magnitude > limitingMagnitude)
+    {
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0); // outside the clip volume
+        gl_PointSize = 1.0;
+        Color = vec3(0.0);
+        return;
+    }
+    float flux = pow(10.0, -0.4 * (magnitude - (limitingMagnitude - SATURATION)));
+    float size = STAR_ANGLE * pixelsPerRadian * pow(max(flux, 1.0), 0.25);
+    float intensity = sqrt(min(flux, 1.0)) * smoothstep(limitingMagnitude, limitingMagnitude - 0.5, magnitude);
+    if (size < MIN_SPRITE)
+    {
+        intensity *= (size * size) / (MIN_SPRITE * MIN_SPRITE);
+        size = MIN_SPRITE;
+    }
+    Color = aColor * intensity;
+    gl_PointSize = size;
+    vec4 pos = projection * skyView * vec4(aDirection, 1.0);
+    gl_Position = vec4(pos.xy, clipPlanes.z * pos.w, pos.w); // at the far plane, behind everything
+}
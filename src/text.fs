@@ -0,0 +1,19 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec4 Color;
+
+uniform sampler2D glyphAtlas; // signed distance to the glyph outline in the red channel
+
+const float EDGE = 128.0 / 255.0; // TextRenderer::SDF_ON_EDGE
+
+// the outline is where the distance crosses EDGE; blending over about one screen pixel around it
+// keeps the edge sharp and antialiased at any scale the atlas is drawn at
+void main()
+{
+    float distance = texture(glyphAtlas, TexCoords).r;
+    float width = max(0.7 * length(vec2(dFdx(distance), dFdy(distance))), 0.001); // never 0, smoothstep needs a range
+    float coverage = smoothstep(EDGE - width, EDGE + width, distance);
+    FragColor = vec4(Color.rgb, Color.a * coverage);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;    // the HDR frame, linear
+uniform sampler2D bloom;    // the first bloom level, with the whole chain added up into it
+uniform sampler2D exposure; // 1x1, written by the exposure passes, or set once without them
+uniform float bloomStrength;
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 aces(vec3 x)
+{
+    return clamp(x * (2.51 * x + 0.03) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+// the only pass that writes the window: bloom, exposure, the curve and the gamma encoding together
+void main()
+{
+    vec3 color = mix(texture(scene, TexCoords).rgb, texture(bloom, TexCoords).rgb, bloomStrength);
+    color = aces(color * texelFetch(exposure, ivec2(0), 0).r);
+    FragColor = vec4(pow(color, vec3(1.0 / 2.2)), 1.0);
+}